@@ -0,0 +1,382 @@
+#include "bcache.h"
+
+#include "lib.h"
+#include "paging.h"
+#include "tasks.h"
+
+#define BCACHE_TEXT_LENGTH 128
+
+static int32_t bcache_dev_open(int32_t fd, const uint8_t* filename);
+static int32_t bcache_dev_read(int32_t fd, void* buf, int32_t nbytes);
+static int32_t bcache_dev_write(int32_t fd, const void* buf, int32_t nbytes);
+static int32_t bcache_dev_close(int32_t fd);
+static int32_t bcache_dev_poll(int32_t fd);
+
+file_operations_t bcache_op_table = {bcache_dev_open, bcache_dev_read, bcache_dev_write, bcache_dev_close, bcache_dev_poll};
+
+static block_device_t* device;
+static bcache_buf_t bufs[BCACHE_ENTRIES];
+static bcache_buf_t* hash[BCACHE_HASH];
+static bcache_buf_t lru; // lru.lru_next is the most recently used
+static uint32_t num_frames; // unpinned blocks holding a frame
+static uint32_t num_pinned; // pinned blocks, never more than BCACHE_PINNED_MAX
+static uint32_t last_block; // block of the last get, a get of the one after is sequential
+static bcache_stats_t stats;
+
+#define hash_slot(block) ((block) & (BCACHE_HASH - 1))
+
+/* lookup
+Description: finds a cached block
+Input: block
+Output: entry, 0 if the block isn't cached
+*/
+static bcache_buf_t* lookup(uint32_t block) {
+    bcache_buf_t* b;
+    for (b = hash[hash_slot(block)]; b; b = b->hash_next) {
+        if (b->block == block) return b;
+    }
+    return 0;
+}
+
+/* lru_remove
+Description: takes an entry off the lru list
+Input: entry
+Output: none
+*/
+static void lru_remove(bcache_buf_t* b) {
+    b->lru_prev->lru_next = b->lru_next;
+    b->lru_next->lru_prev = b->lru_prev;
+}
+
+/* lru_push
+Description: puts an entry at the most recently used end of the lru list
+Input: entry
+Output: none
+*/
+static void lru_push(bcache_buf_t* b) {
+    b->lru_next = lru.lru_next;
+    b->lru_prev = &lru;
+    lru.lru_next->lru_prev = b;
+    lru.lru_next = b;
+}
+
+/* drop_entry
+Description: forgets a cached block without writing it back, the frame is
+only freed once nothing else holds a reference to it
+Input: entry
+Output: none
+*/
+static void drop_entry(bcache_buf_t* b) {
+    bcache_buf_t** p;
+    for (p = &hash[hash_slot(b->block)]; *p != b; p = &(*p)->hash_next);
+    *p = b->hash_next;
+    if (!b->pinned) {
+        lru_remove(b);
+        num_frames--;
+    }
+    else num_pinned--;
+    put_frame((uint32_t)b->data);
+    b->data = 0;
+}
+
+/* evict
+Description: drops the least recently used block nobody has, writing it back first if changed
+Input: none
+Output: the free entry, 0 if every block is in use
+*/
+static bcache_buf_t* evict() {
+    bcache_buf_t* b;
+    for (b = lru.lru_prev; b != &lru; b = b->lru_prev) {
+        if (b->refs) continue;
+        if (b->dirty) {
+            // a block that can't be written stays, it's the only copy of the change
+            if (-1 == device->write(device, b->block, 1, &b->data)) continue;
+            stats.writes++;
+        }
+        drop_entry(b);
+        stats.evictions++;
+        return b;
+    }
+    return 0;
+}
+
+/* new_entry
+Description: sets up an entry with an empty frame for a block, evicting one
+once BCACHE_BUFFERS frames are held
+Input: block
+Output: entry, 0 if no entry or frame was left
+*/
+static bcache_buf_t* new_entry(uint32_t block) {
+    uint32_t i;
+    bcache_buf_t* b = (num_frames >= BCACHE_BUFFERS) ? evict() : 0;
+    for (i = 0; !b && i < BCACHE_ENTRIES; i++) {
+        if (!bufs[i].data) b = &bufs[i];
+    }
+    if (!b && !(b = evict())) return 0;
+    if (0 == (b->data = (uint8_t*)alloc_frame())) {
+        // the pool is out, so take the frame of a cached block
+        if (!evict() || 0 == (b->data = (uint8_t*)alloc_frame())) return 0;
+    }
+    b->block = block;
+    b->refs = 0;
+    b->dirty = 0;
+    b->pinned = 0;
+    b->hash_next = hash[hash_slot(block)];
+    hash[hash_slot(block)] = b;
+    lru_push(b);
+    num_frames++;
+    return b;
+}
+
+/* bcache_init
+Description: drops everything cached, writing back nothing, and caches dev from now on
+Input: device
+Output: none
+*/
+void bcache_init(block_device_t* dev) {
+    uint32_t i, flags;
+    cli_and_save(flags);
+    for (i = 0; i < BCACHE_ENTRIES; i++) {
+        if (bufs[i].data) put_frame((uint32_t)bufs[i].data);
+    }
+    memset(bufs, 0, sizeof(bufs));
+    memset(hash, 0, sizeof(hash));
+    memset(&stats, 0, sizeof(stats));
+    lru.lru_next = lru.lru_prev = &lru;
+    num_frames = 0;
+    num_pinned = 0;
+    last_block = 0xFFFFFFFF;
+    device = dev;
+    restore_flags(flags);
+}
+
+/* bcache_get
+Description: gets a block, reading it from the device on a miss, a miss right
+after the block before it also reads up to BCACHE_READ_AHEAD blocks that follow
+Input: block
+Output: block data, stays put until bcache_put, 0 if it couldn't be read
+*/
+uint8_t* bcache_get(uint32_t block) {
+    bcache_buf_t* run[BCACHE_READ_AHEAD + 1];
+    uint8_t* data[BCACHE_READ_AHEAD + 1];
+    uint32_t i, n, ahead, flags;
+    bcache_buf_t* b;
+    cli_and_save(flags);
+    if (!device || block >= device->num_blocks) {
+        restore_flags(flags);
+        return 0;
+    }
+    ahead = (block == last_block + 1) ? BCACHE_READ_AHEAD : 0;
+    last_block = block;
+    if ((b = lookup(block))) {
+        stats.hits++;
+        if (!b->pinned) {
+            lru_remove(b);
+            lru_push(b);
+        }
+        b->refs++;
+        restore_flags(flags);
+        return b->data;
+    }
+    stats.misses++;
+    // the blocks that follow go in the same read until one is already cached,
+    // each is held while the next is set up so it can't be evicted for it
+    for (n = 0; n <= ahead && block + n < device->num_blocks; n++) {
+        if (n > 0 && lookup(block + n)) break;
+        if (0 == (run[n] = new_entry(block + n))) break;
+        run[n]->refs = 1;
+        data[n] = run[n]->data;
+    }
+    if (n == 0 || -1 == device->read(device, block, n, data)) {
+        for (i = 0; i < n; i++) drop_entry(run[i]);
+        restore_flags(flags);
+        return 0;
+    }
+    for (i = 1; i < n; i++) run[i]->refs = 0;
+    stats.read_ahead += n - 1;
+    restore_flags(flags);
+    return run[0]->data;
+}
+
+/* bcache_put
+Description: gives back a block from bcache_get
+Input: block, 1 if it was changed
+Output: none
+*/
+void bcache_put(uint32_t block, int32_t dirty) {
+    uint32_t flags;
+    bcache_buf_t* b;
+    cli_and_save(flags);
+    if ((b = lookup(block))) {
+        if (b->refs) b->refs--;
+        if (dirty) b->dirty = 1;
+    }
+    restore_flags(flags);
+}
+
+/* bcache_zero
+Description: sets a block to zeros without reading it, the zeros are written back later
+Input: block
+Output: 0 on success, -1 if no buffer was left for it
+*/
+int32_t bcache_zero(uint32_t block) {
+    uint32_t flags;
+    bcache_buf_t* b;
+    cli_and_save(flags);
+    if (!device || block >= device->num_blocks) {
+        restore_flags(flags);
+        return -1;
+    }
+    // frames come zeroed from alloc_frame
+    if ((b = lookup(block))) memset(b->data, 0, BCACHE_BLOCK_SIZE);
+    else if (0 == (b = new_entry(block))) {
+        restore_flags(flags);
+        return -1;
+    }
+    b->dirty = 1;
+    restore_flags(flags);
+    return 0;
+}
+
+/* bcache_pin
+Description: gets a block that is never evicted, for metadata held by pointer,
+a pin lasts until bcache_init so at most BCACHE_PINNED_MAX blocks can be pinned,
+which leaves the other entries to blocks that can be evicted
+Input: block
+Output: block data, 0 if it couldn't be read or BCACHE_PINNED_MAX blocks are pinned
+*/
+uint8_t* bcache_pin(uint32_t block) {
+    uint32_t flags;
+    bcache_buf_t* b;
+    uint8_t* data;
+    cli_and_save(flags);
+    if ((b = lookup(block)) && b->pinned) {
+        restore_flags(flags);
+        return b->data;
+    }
+    if (num_pinned >= BCACHE_PINNED_MAX || 0 == (data = bcache_get(block))) {
+        restore_flags(flags);
+        return 0;
+    }
+    b = lookup(block);
+    b->refs--;
+    b->pinned = 1;
+    lru_remove(b);
+    num_frames--;
+    num_pinned++;
+    restore_flags(flags);
+    return data;
+}
+
+/* bcache_dirty
+Description: marks a cached block as changed
+Input: block
+Output: none
+*/
+void bcache_dirty(uint32_t block) {
+    uint32_t flags;
+    bcache_buf_t* b;
+    cli_and_save(flags);
+    if ((b = lookup(block))) b->dirty = 1;
+    restore_flags(flags);
+}
+
+/* bcache_sync
+Description: writes every changed block back to the device, the device is only
+flushed if something was written
+Input: none
+Output: 0 on success, -1 if a write failed
+*/
+int32_t bcache_sync() {
+    uint32_t i, flags, written = 0;
+    int32_t ret = 0;
+    cli_and_save(flags);
+    if (!device) {
+        restore_flags(flags);
+        return 0;
+    }
+    for (i = 0; i < BCACHE_ENTRIES; i++) {
+        if (!bufs[i].data || !bufs[i].dirty) continue;
+        if (-1 == device->write(device, bufs[i].block, 1, &bufs[i].data)) {
+            ret = -1;
+            continue;
+        }
+        bufs[i].dirty = 0;
+        stats.writes++;
+        written++;
+    }
+    if (written && device->flush && -1 == device->flush(device)) ret = -1;
+    restore_flags(flags);
+    return ret;
+}
+
+/* bcache_get_stats
+Description: copies out the counters
+Input: stats to fill in
+Output: none
+*/
+void bcache_get_stats(bcache_stats_t* st) {
+    uint32_t flags;
+    cli_and_save(flags);
+    *st = stats;
+    restore_flags(flags);
+}
+
+/* bcache_dev_open
+Description: nothing to set up
+Output: always 0
+*/
+static int32_t bcache_dev_open(int32_t fd, const uint8_t* filename) {
+    return 0;
+}
+
+/* bcache_dev_read
+Description: reads the counters as "name value" lines, the position moves
+through the text so cat stops at the end
+Input: fd, buf, nbytes
+Output: bytes read, 0 at the end
+*/
+static int32_t bcache_dev_read(int32_t fd, void* buf, int32_t nbytes) {
+    static const int8_t* names[] = {"hits ", "misses ", "read_ahead ", "writes ", "evictions "};
+    int8_t text[BCACHE_TEXT_LENGTH];
+    uint32_t i, length = 0, pos = fd_file(fd)->file_position;
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        strcpy(text + length, (int8_t*)names[i]);
+        length += strlen((int8_t*)names[i]);
+        itoa(((uint32_t*)&st)[i], text + length, 10);
+        length += strlen(text + length);
+        text[length++] = '\n';
+    }
+    if (nbytes < 0) return -1;
+    if (pos >= length) return 0;
+    if ((uint32_t)nbytes > length - pos) nbytes = length - pos;
+    memcpy(buf, text + pos, nbytes);
+    fd_file(fd)->file_position += nbytes;
+    return nbytes;
+}
+
+/* bcache_dev_write
+Description: the counters can't be written
+Output: always -1
+*/
+static int32_t bcache_dev_write(int32_t fd, const void* buf, int32_t nbytes) {
+    return -1;
+}
+
+/* bcache_dev_close
+Description: nothing to free
+Output: always 0
+*/
+static int32_t bcache_dev_close(int32_t fd) {
+    return 0;
+}
+
+/* bcache_dev_poll
+Description: the counters can always be read
+Output: POLLIN
+*/
+static int32_t bcache_dev_poll(int32_t fd) {
+    return POLLIN;
+}
@@ -0,0 +1,107 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "types.h"
+#include "vfs.h"
+
+#define BCACHE_BLOCK_SIZE 4096
+#define BCACHE_ENTRIES 1024   // blocks the cache can track, pinned ones included
+#define BCACHE_BUFFERS 256    // frames held by blocks that can be evicted
+#define BCACHE_PINNED_MAX (BCACHE_ENTRIES - BCACHE_BUFFERS) // blocks that can be pinned
+#define BCACHE_HASH 256       // power of 2
+#define BCACHE_READ_AHEAD 8   // blocks read past a sequential miss
+
+/* a disk the cache reads through, blocks are BCACHE_BLOCK_SIZE, bufs holds
+ * one frame per block so a run doesn't need contiguous memory */
+typedef struct block_device {
+    uint32_t num_blocks;
+    int32_t (*read)(struct block_device* dev, uint32_t block, uint32_t count, uint8_t* const* bufs);
+    int32_t (*write)(struct block_device* dev, uint32_t block, uint32_t count, uint8_t* const* bufs);
+    int32_t (*flush)(struct block_device* dev); // 0 if writes need no flush
+    uint32_t priv; // for the driver
+} block_device_t;
+
+/* one cached block, unpinned ones are on the lru list while they have a frame */
+typedef struct bcache_buf {
+    uint32_t block;
+    uint8_t* data;  // frame, 0 if the entry is free
+    uint32_t refs;  // gets without a put
+    uint8_t  dirty;
+    uint8_t  pinned;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_prev;
+    struct bcache_buf* lru_next;
+} bcache_buf_t;
+
+typedef struct bcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t read_ahead; // blocks read past a miss
+    uint32_t writes;     // blocks written back
+    uint32_t evictions;
+} bcache_stats_t;
+
+// /dev/bcache, reads back the counters as text
+extern file_operations_t bcache_op_table;
+
+/* bcache_init
+Description: drops everything cached, writing back nothing, and caches dev from now on
+Input: device
+Output: none
+*/
+extern void bcache_init(block_device_t* dev);
+
+/* bcache_get
+Description: gets a block, reading it from the device on a miss, a miss right
+after the block before it also reads up to BCACHE_READ_AHEAD blocks that follow
+Input: block
+Output: block data, stays put until bcache_put, 0 if it couldn't be read
+*/
+extern uint8_t* bcache_get(uint32_t block);
+
+/* bcache_put
+Description: gives back a block from bcache_get
+Input: block, 1 if it was changed
+Output: none
+*/
+extern void bcache_put(uint32_t block, int32_t dirty);
+
+/* bcache_zero
+Description: sets a block to zeros without reading it, the zeros are written back later
+Input: block
+Output: 0 on success, -1 if no buffer was left for it
+*/
+extern int32_t bcache_zero(uint32_t block);
+
+/* bcache_pin
+Description: gets a block that is never evicted, for metadata held by pointer,
+a pin lasts until bcache_init so at most BCACHE_PINNED_MAX blocks can be pinned,
+which leaves the other entries to blocks that can be evicted
+Input: block
+Output: block data, 0 if it couldn't be read or BCACHE_PINNED_MAX blocks are pinned
+*/
+extern uint8_t* bcache_pin(uint32_t block);
+
+/* bcache_dirty
+Description: marks a cached block as changed
+Input: block
+Output: none
+*/
+extern void bcache_dirty(uint32_t block);
+
+/* bcache_sync
+Description: writes every changed block back to the device, the device is only
+flushed if something was written
+Input: none
+Output: 0 on success, -1 if a write failed
+*/
+extern int32_t bcache_sync();
+
+/* bcache_get_stats
+Description: copies out the counters
+Input: stats to fill in
+Output: none
+*/
+extern void bcache_get_stats(bcache_stats_t* st);
+
+#endif
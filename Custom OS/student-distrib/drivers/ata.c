@@ -0,0 +1,223 @@
+#include "ata.h"
+#include "../lib.h"
+
+#define ATA_PRIMARY 0x1F0
+#define ATA_SECONDARY 0x170
+#define ATA_PRIMARY_CTRL 0x3F6
+#define ATA_SECONDARY_CTRL 0x376
+// registers as offsets from the bus base
+#define ATA_DATA 0
+#define ATA_COUNT 2
+#define ATA_LBA_LO 3
+#define ATA_LBA_MID 4
+#define ATA_LBA_HI 5
+#define ATA_DRIVE 6
+#define ATA_STATUS 7
+#define ATA_COMMAND 7
+// status bits
+#define ATA_SR_ERR 0x01
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_DF 0x20
+#define ATA_SR_BSY 0x80
+#define ATA_CMD_READ 0x20
+#define ATA_CMD_WRITE 0x30
+#define ATA_CMD_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CTRL_NIEN 0x02   // no interrupts from the disks on this bus
+#define ATA_DRIVE_LBA 0xE0   // LBA addressing, the slave bit is 0x10
+#define ATA_WORDS 256        // words in a sector
+#define ATA_MAX_SECTORS 256  // sectors one command can move, sent as a count of 0
+#define ATA_LBA28_SECTORS 0x10000000
+#define ATA_TIMEOUT 1000000  // status reads before giving up on a disk
+
+typedef struct ata_disk {
+    uint16_t base;
+    uint16_t ctrl;
+    uint8_t  slave;
+    block_device_t dev;
+} ata_disk_t;
+
+static ata_disk_t disks[ATA_MAX_DRIVES];
+static uint32_t num_disks = 0;
+
+static int32_t ata_read(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs);
+static int32_t ata_write(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs);
+static int32_t ata_flush(block_device_t* dev);
+
+/*
+* select_drive
+* DESCRIPTION: picks the master or slave of a bus and sets the top bits of the
+*              LBA, then waits the 400ns the status needs to catch up
+* INPUTS: disk, LBA
+* OUTPUTS: none
+*/
+static void select_drive(ata_disk_t* d, uint32_t lba) {
+    uint32_t i;
+    outb(ATA_DRIVE_LBA | (d->slave << 4) | ((lba >> 24) & 0x0F), d->base + ATA_DRIVE);
+    // each read of the alternate status takes about 100ns
+    for (i = 0; i < 4; i++) inb(d->ctrl);
+}
+
+/*
+* wait_ready
+* DESCRIPTION: polls until the disk isn't busy
+* INPUTS: disk, 1 to also wait for it to have data to move
+* OUTPUTS: 0 when ready, -1 on an error or if it never got ready
+*/
+static int32_t wait_ready(ata_disk_t* d, int32_t drq) {
+    uint32_t i, status;
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(d->base + ATA_STATUS);
+        if (status & ATA_SR_BSY) continue;
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) return -1;
+        if (!drq || (status & ATA_SR_DRQ)) return 0;
+    }
+    return -1;
+}
+
+/*
+* identify
+* DESCRIPTION: asks a drive what it is, only ATA disks answer without an error
+* INPUTS: disk with its bus and slave bit set
+* OUTPUTS: number of sectors LBA28 can reach, 0 if there is no ATA disk
+*/
+static uint32_t identify(ata_disk_t* d) {
+    uint16_t id[ATA_WORDS];
+    uint32_t i, status, sectors;
+    outb(ATA_CTRL_NIEN, d->ctrl);
+    select_drive(d, 0);
+    outb(0, d->base + ATA_COUNT);
+    outb(0, d->base + ATA_LBA_LO);
+    outb(0, d->base + ATA_LBA_MID);
+    outb(0, d->base + ATA_LBA_HI);
+    outb(ATA_CMD_IDENTIFY, d->base + ATA_COMMAND);
+    // nothing on the bus reads as all ones, no drive there as 0
+    status = inb(d->base + ATA_STATUS);
+    if (status == 0 || status == 0xFF) return 0;
+    for (i = 0; i < ATA_TIMEOUT && (inb(d->base + ATA_STATUS) & ATA_SR_BSY); i++);
+    // ATAPI and SATA devices set these to their signature
+    if (inb(d->base + ATA_LBA_MID) || inb(d->base + ATA_LBA_HI)) return 0;
+    if (-1 == wait_ready(d, 1)) return 0;
+    for (i = 0; i < ATA_WORDS; i++) id[i] = inw(d->base + ATA_DATA);
+    sectors = id[60] | ((uint32_t)id[61] << 16);
+    return (sectors > ATA_LBA28_SECTORS) ? ATA_LBA28_SECTORS : sectors;
+}
+
+/*
+* ata_init
+* DESCRIPTION: looks for ATA disks on both buses with IDENTIFY, interrupts from the
+*              disks are turned off since every transfer is polled PIO
+* INPUTS: none
+* OUTPUTS: number of disks found
+*/
+int32_t ata_init() {
+    static const uint16_t bases[] = {ATA_PRIMARY, ATA_SECONDARY};
+    static const uint16_t ctrls[] = {ATA_PRIMARY_CTRL, ATA_SECONDARY_CTRL};
+    uint32_t bus, slave, sectors;
+    ata_disk_t* d;
+    num_disks = 0;
+    for (bus = 0; bus < 2; bus++) {
+        for (slave = 0; slave < 2; slave++) {
+            d = &disks[num_disks];
+            d->base = bases[bus];
+            d->ctrl = ctrls[bus];
+            d->slave = slave;
+            if (0 == (sectors = identify(d)) || sectors < ATA_SECTORS_PER_BLOCK) continue;
+            d->dev.num_blocks = sectors / ATA_SECTORS_PER_BLOCK;
+            d->dev.read = ata_read;
+            d->dev.write = ata_write;
+            d->dev.flush = ata_flush;
+            d->dev.priv = num_disks;
+            num_disks++;
+        }
+    }
+    return num_disks;
+}
+
+/*
+* ata_drive
+* DESCRIPTION: gets a disk found by ata_init as a block device of 4KB blocks,
+*              a partial block at the end of the disk is left out
+* INPUTS: index of disk, in bus then master/slave order of the ones found
+* OUTPUTS: the disk, 0 if there aren't that many
+*/
+block_device_t* ata_drive(uint32_t index) {
+    return (index < num_disks) ? &disks[index].dev : 0;
+}
+
+/*
+* ata_transfer
+* DESCRIPTION: moves whole blocks with READ/WRITE SECTORS, as many sectors per
+*              command as it takes, one sector of PIO at a time
+* INPUTS: device, first block, number of blocks, one buffer per block, 1 to write
+* OUTPUTS: 0 on success, -1 on a disk error
+*/
+static int32_t ata_transfer(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs, int32_t write) {
+    ata_disk_t* d = &disks[dev->priv];
+    uint32_t i, j, n, lba, sectors;
+    uint16_t* p;
+    if (block >= dev->num_blocks || count > dev->num_blocks - block) return -1;
+    while (count > 0) {
+        n = (count > ATA_MAX_SECTORS / ATA_SECTORS_PER_BLOCK) ? ATA_MAX_SECTORS / ATA_SECTORS_PER_BLOCK : count;
+        lba = block * ATA_SECTORS_PER_BLOCK;
+        sectors = n * ATA_SECTORS_PER_BLOCK;
+        if (-1 == wait_ready(d, 0)) return -1;
+        select_drive(d, lba);
+        // a count of 0 means 256
+        outb(sectors & 0xFF, d->base + ATA_COUNT);
+        outb(lba & 0xFF, d->base + ATA_LBA_LO);
+        outb((lba >> 8) & 0xFF, d->base + ATA_LBA_MID);
+        outb((lba >> 16) & 0xFF, d->base + ATA_LBA_HI);
+        outb((write) ? ATA_CMD_WRITE : ATA_CMD_READ, d->base + ATA_COMMAND);
+        for (i = 0; i < sectors; i++) {
+            if (-1 == wait_ready(d, 1)) return -1;
+            p = (uint16_t*)(bufs[i / ATA_SECTORS_PER_BLOCK] + (i % ATA_SECTORS_PER_BLOCK) * ATA_SECTOR_SIZE);
+            if (write) {
+                for (j = 0; j < ATA_WORDS; j++) outw(p[j], d->base + ATA_DATA);
+            }
+            else {
+                for (j = 0; j < ATA_WORDS; j++) p[j] = inw(d->base + ATA_DATA);
+            }
+        }
+        // the last sector written is only done once the disk stops being busy
+        if (write && -1 == wait_ready(d, 0)) return -1;
+        block += n;
+        bufs += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/*
+* ata_read
+* DESCRIPTION: reads blocks from a disk
+* INPUTS: device, first block, number of blocks, one buffer per block
+* OUTPUTS: 0 on success, -1 on a disk error
+*/
+static int32_t ata_read(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs) {
+    return ata_transfer(dev, block, count, bufs, 0);
+}
+
+/*
+* ata_write
+* DESCRIPTION: writes blocks to a disk, they may sit in its cache until ata_flush
+* INPUTS: device, first block, number of blocks, one buffer per block
+* OUTPUTS: 0 on success, -1 on a disk error
+*/
+static int32_t ata_write(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs) {
+    return ata_transfer(dev, block, count, bufs, 1);
+}
+
+/*
+* ata_flush
+* DESCRIPTION: makes the disk write out its own cache
+* INPUTS: device
+* OUTPUTS: 0 on success, -1 on a disk error
+*/
+static int32_t ata_flush(block_device_t* dev) {
+    ata_disk_t* d = &disks[dev->priv];
+    if (-1 == wait_ready(d, 0)) return -1;
+    select_drive(d, 0);
+    outb(ATA_CMD_FLUSH, d->base + ATA_COMMAND);
+    return wait_ready(d, 0);
+}
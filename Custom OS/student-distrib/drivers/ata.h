@@ -0,0 +1,29 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "../types.h"
+#include "../bcache.h"
+
+#define ATA_MAX_DRIVES 4 // master and slave on the primary and secondary bus
+#define ATA_SECTOR_SIZE 512
+#define ATA_SECTORS_PER_BLOCK (BCACHE_BLOCK_SIZE / ATA_SECTOR_SIZE)
+
+/*
+* ata_init
+* DESCRIPTION: looks for ATA disks on both buses with IDENTIFY, interrupts from the
+*              disks are turned off since every transfer is polled PIO
+* INPUTS: none
+* OUTPUTS: number of disks found
+*/
+extern int32_t ata_init();
+
+/*
+* ata_drive
+* DESCRIPTION: gets a disk found by ata_init as a block device of 4KB blocks,
+*              a partial block at the end of the disk is left out
+* INPUTS: index of disk, in bus then master/slave order of the ones found
+* OUTPUTS: the disk, 0 if there aren't that many
+*/
+extern block_device_t* ata_drive(uint32_t index);
+
+#endif
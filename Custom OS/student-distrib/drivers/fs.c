@@ -3,15 +3,45 @@
 #include "../tasks.h"
 #include "../types.h"
 #include "../lib.h"
+#include "../paging.h"
+#include "../bcache.h"
 
 #define MAX_NAME_LENGTH 32
+#define GROW_BLOCKS 64 // blocks a write adds to a file at a time
 
-int32_t* fs_op_table[4] = {(int32_t*)file_open, (int32_t*)file_read, (int32_t*)file_write, (int32_t*)file_close};
+file_operations_t fs_op_table = {file_open, file_read, file_write, file_close, file_poll, file_truncate, file_unlink, file_mkdir, file_getdents, file_stat, file_fstat};
 
 static boot_block_t* b_block;
-static inode_t* inodes;
-static d_block_t* d_blocks;
+static uint32_t fs_start;   // address of the image, 0 when it is read through the buffer cache
 static uint32_t fs_end;
+static uint32_t data_start; // image block holding data block 0
+static block_device_t* fs_dev; // device under the buffer cache, 0 for an image in memory
+static int32_t fs_changing; // 1 while a change is made, metadata looked at is written back
+static int32_t meta_error;  // set when a metadata block couldn't be read, cleared by whoever checks it
+
+static uint8_t* block_bitmap; // bitmap in the image, 0 if the image can't be written
+static uint32_t inode_opens[FS_MAX_INODES]; // open files on each inode
+static uint8_t inode_orphan[FS_MAX_INODES]; // 1 if unlinked while open, freed on the last close
+
+#define bit_test(map, i) ((map)[(i) >> 3] & (1 << ((i) & 7)))
+#define bit_set(map, i) ((map)[(i) >> 3] |= (1 << ((i) & 7)))
+#define bit_clear(map, i) ((map)[(i) >> 3] &= ~(1 << ((i) & 7)))
+
+#define inode_at(inode) ((inode_t*)meta_block(1 + (inode)))
+#define ext_inode(inode) ((extent_inode_t*)inode_at(inode))
+#define is_extent_inode(in) ((in)->magic == EXTENT_MAGIC || (in)->magic == DIR_MAGIC)
+#define ext_block(block) ((extent_block_t*)meta_block(data_start + (block)))
+#define is_dot_name(name) (strncmp((int8_t*)(name), ".", NAME_LENGTH) == 0 || strncmp((int8_t*)(name), "..", NAME_LENGTH) == 0)
+
+// what the root looks like as an entry of a directory
+static const dentry_t root_dentry = {".", FILE_TYPE_DIR, 0, {0}};
+
+static void bitmaps_init();
+static int32_t block_referenced(uint32_t block);
+static uint8_t* meta_block(uint32_t n);
+static int32_t inode_length(uint32_t inode);
+static dentry_t* dir_entry(uint32_t dir, uint32_t index);
+static int32_t dir_rehash(uint32_t dir);
 
 /*
 filesystem_init
@@ -22,40 +52,832 @@ Output: None
 int32_t filesystem_init(uint32_t module_start, uint32_t module_end) {
     // filter bad input
     if (!module_start || !module_end) return -1;
+    fs_dev = 0;
+    fs_start = module_start;
     b_block = (boot_block_t*) module_start;
-    inodes = (inode_t*) (module_start + BLOCK_SIZE);
-    d_blocks = (d_block_t*) (module_start + BLOCK_SIZE + (b_block->num_inodes*BLOCK_SIZE));
+    data_start = 1 + b_block->num_inodes;
     fs_end = module_end;
+    bitmaps_init();
+    return 0;
+}
+/*
+mount_back
+Description: goes back to the filesystem used before a disk that couldn't be mounted,
+the image it was on is checked and read again like the first time
+Input: device, start and end of the image in memory, both 0 when the old one was on a device
+Output: -1
+*/
+static int32_t mount_back(block_device_t* dev, uint32_t start, uint32_t end) {
+    bcache_init(0);
+    fs_dev = 0;
+    fs_start = 0;
+    b_block = 0;
+    block_bitmap = 0;
+    if (dev) filesystem_init_disk(dev);
+    else if (start) filesystem_init(start, end);
+    return -1;
+}
+/*
+filesystem_init_disk
+Description: switches to an image on a block device, read through the buffer cache,
+the device is checked first so one without an image leaves the current filesystem as it is,
+metadata is pinned in the cache for good, so an image whose tree needs more than
+BCACHE_PINNED_MAX blocks of it is refused here too
+Input: device
+Output: 0 on success, -1 if the device doesn't hold an image or it doesn't fit
+*/
+int32_t filesystem_init_disk(block_device_t* dev) {
+    block_device_t* old_dev = fs_dev;
+    uint32_t old_start = fs_start, old_end = fs_end;
+    boot_block_t* b;
+    uint8_t* frame;
+    int32_t good;
+    if (0 == (frame = (uint8_t*)alloc_frame())) return -1;
+    b = (boot_block_t*)frame;
+    // anything else on a disk is very unlikely to start with the root's . entry and fit
+    good = 0 == dev->read(dev, 0, 1, &frame) && b->num_dentries != 0 && b->num_dentries <= MAX_DENTRIES &&
+        b->num_inodes != 0 && b->num_inodes < dev->num_blocks && b->num_datablocks <= dev->num_blocks - 1 - b->num_inodes &&
+        strncmp((int8_t*)b->dentries[0].f_name, ".", NAME_LENGTH) == 0;
+    put_frame((uint32_t)frame);
+    if (!good) return -1;
+    // changes to the image being left go to its device before the cache is emptied
+    if (fs_dev) bcache_sync();
+    bcache_init(dev);
+    if (0 == (b = (boot_block_t*)bcache_pin(0))) return mount_back(old_dev, old_start, old_end);
+    fs_dev = dev;
+    fs_start = 0;
+    b_block = b;
+    data_start = 1 + b->num_inodes;
+    fs_end = 0;
+    bitmaps_init();
+    // walking the whole tree pins all of its metadata, so calls on what is already
+    // there can't fail later for want of pins, only making new files or blocks can
+    meta_error = 0;
+    if (block_referenced(b->num_datablocks)) return mount_back(old_dev, old_start, old_end);
+    return 0;
+}
+/*
+meta_block
+Description: finds a block of the image holding metadata, through the buffer cache
+it is pinned until the next mount so pointers into it stay good, and marked changed
+while a change is made
+Input: image block
+Output: pointer to the block, 0 if the disk failed or BCACHE_PINNED_MAX blocks are
+pinned already, which also sets meta_error
+*/
+static uint8_t* meta_block(uint32_t n) {
+    uint8_t* data;
+    if (!fs_dev) return (uint8_t*)(fs_start + n * BLOCK_SIZE);
+    if (0 == (data = bcache_pin(n))) {
+        meta_error = 1;
+        return 0;
+    }
+    if (fs_changing) bcache_dirty(n);
+    return data;
+}
+/*
+inode_length
+Description: gets the length of a file or directory
+Input: inode
+Output: length in bytes, -1 if the inode couldn't be read
+*/
+static int32_t inode_length(uint32_t inode) {
+    inode_t* in = inode_at(inode);
+    return (in) ? (int32_t)in->length : -1;
+}
+/*
+data_get
+Description: gets a data block, through the buffer cache one block at a time,
+in memory the blocks after it follow it
+Input: data block index
+Output: pointer to the block, 0 if it couldn't be read
+*/
+static uint8_t* data_get(uint32_t block) {
+    if (!fs_dev) return (uint8_t*)(fs_start + (data_start + block) * BLOCK_SIZE);
+    return bcache_get(data_start + block);
+}
+/*
+data_put
+Description: gives back a block from data_get
+Input: data block index, 1 if it was changed
+Output: none
+*/
+static void data_put(uint32_t block, int32_t dirty) {
+    if (fs_dev) bcache_put(data_start + block, dirty);
+}
+/*
+data_zero
+Description: zeroes a data block, through the buffer cache without reading it first
+Input: data block index
+Output: none
+*/
+static void data_zero(uint32_t block) {
+    if (!fs_dev) memset((uint8_t*)(fs_start + (data_start + block) * BLOCK_SIZE), 0, BLOCK_SIZE);
+    else bcache_zero(data_start + block);
+}
+/*
+change_begin
+Description: starts a change to the metadata, blocks of it looked at from now
+on get written back
+Input: none
+Output: none
+*/
+static void change_begin() {
+    fs_changing = 1;
+}
+/*
+change_end
+Description: ends a change to the metadata
+Input: 1 to write back everything changed so far
+Output: none
+*/
+static void change_end(int32_t sync) {
+    fs_changing = 0;
+    if (!fs_dev) return;
+    // the boot block and block bitmap are kept by pointer, not looked up
+    bcache_dirty(0);
+    if (block_bitmap) bcache_dirty(data_start + b_block->bitmap_block);
+    if (sync) bcache_sync();
+}
+/*
+chain_block
+Description: finds an indirect extent block of an extent inode
+Input: inode, position of the block in the chain
+Output: data block index, EXTENT_NONE if the chain is shorter or couldn't be read
+*/
+static uint32_t chain_block(uint32_t inode, uint32_t n) {
+    extent_inode_t* in = ext_inode(inode);
+    extent_block_t* blk;
+    uint32_t b;
+    if (!in) return EXTENT_NONE;
+    b = in->indirect;
+    while (n-- > 0 && b < b_block->num_datablocks) {
+        if (0 == (blk = ext_block(b))) return EXTENT_NONE;
+        b = blk->next;
+    }
+    return (b < b_block->num_datablocks) ? b : EXTENT_NONE;
+}
+/*
+get_extent
+Description: finds an extent of an extent inode, in the inode or an indirect block
+Input: inode, index of the extent
+Output: pointer to the extent, 0 if the chain is broken or couldn't be read
+*/
+static extent_t* get_extent(uint32_t inode, uint32_t index) {
+    extent_inode_t* in;
+    extent_block_t* blk;
+    uint32_t b;
+    if (index < INODE_EXTENTS) return (in = ext_inode(inode)) ? &in->extents[index] : 0;
+    index -= INODE_EXTENTS;
+    if (EXTENT_NONE == (b = chain_block(inode, index / BLOCK_EXTENTS))) return 0;
+    if (0 == (blk = ext_block(b))) return 0;
+    return &blk->extents[index % BLOCK_EXTENTS];
+}
+/*
+block_run
+Description: finds where a block of a file is and how many blocks from there on
+follow each other in the image
+Input: inode, index of block within the file, where to put the run length
+Output: data block index, -1 if the file has no such block or it couldn't be read
+*/
+static int32_t block_run(uint32_t inode, uint32_t block, uint32_t* run) {
+    extent_inode_t* in = ext_inode(inode);
+    extent_block_t* blk;
+    extent_t* e;
+    uint32_t i, start, left = INODE_EXTENTS, next;
+    if (!in) return -1;
+    if (!is_extent_inode(in)) {
+        // old inodes list every block, a run is blocks that happen to be in order
+        if (block >= INODE_BLOCKS) return -1;
+        start = ((inode_t*)in)->db_index[block];
+        for (i = 1; block + i < INODE_BLOCKS && ((inode_t*)in)->db_index[block + i] == start + i; i++);
+        *run = i;
+    }
+    else {
+        e = in->extents;
+        next = in->indirect;
+        // walk the extents in order, moving to the next indirect block when one runs out
+        for (i = 0; i < in->num_extents && block >= e->count; i++, e++, left--) {
+            block -= e->count;
+            if (left > 1) continue;
+            if (next >= b_block->num_datablocks) return -1;
+            if (0 == (blk = ext_block(next))) return -1;
+            e = blk->extents - 1;
+            left = BLOCK_EXTENTS + 1;
+            next = blk->next;
+        }
+        if (i == in->num_extents) return -1;
+        start = e->start + block;
+        *run = e->count - block;
+    }
+    if (start >= b_block->num_datablocks) return -1;
+    if (*run > b_block->num_datablocks - start) *run = b_block->num_datablocks - start;
+    return start;
+}
+/*
+mark_inode_blocks
+Description: looks through every block an inode uses, data and indirect extent blocks
+Input: inode, block to look for, 1 to set the bit of every block in the block bitmap instead
+Output: 1 if the block is used, 0 if not, -1 if the inode couldn't be read
+*/
+static int32_t mark_inode_blocks(uint32_t inode, uint32_t block, int32_t mark) {
+    extent_inode_t* in;
+    uint32_t i, j, run, n;
+    int32_t start;
+    if (0 == (in = ext_inode(inode))) return -1;
+    n = (in->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (i = 0; i < n; i += run) {
+        if (-1 == (start = block_run(inode, i, &run))) break;
+        if (run > n - i) run = n - i;
+        if (mark) {
+            for (j = 0; j < run; j++) bit_set(block_bitmap, start + j);
+        }
+        else if (block >= start && block < start + run) return 1;
+    }
+    for (i = 0; is_extent_inode(in) && EXTENT_NONE != (start = chain_block(inode, i)); i++) {
+        if (mark) bit_set(block_bitmap, start);
+        else if (block == start) return 1;
+    }
+    return (meta_error) ? -1 : 0;
+}
+/*
+visit_tree
+Description: goes through every file and directory under a directory, either
+setting their inodes and blocks in the bitmaps or looking for a block
+Input: directory inode, block to look for, 1 to mark the bitmaps instead, how deep dir is
+Output: 1 if the block is used, 0 if not, -1 if part of the tree couldn't be read
+*/
+static int32_t visit_tree(uint32_t dir, uint32_t block, int32_t mark, uint32_t depth) {
+    uint32_t i;
+    int32_t ret;
+    dentry_t* d;
+    if (depth > FS_MAX_DEPTH) return 0;
+    for (i = 0; (d = dir_entry(dir, i)); i++) {
+        if (d->f_name[0] == '\0' || d->inode_index == 0 || d->inode_index >= b_block->num_inodes) continue;
+        if (d->f_type != FILE_TYPE_FILE && d->f_type != FILE_TYPE_DIR) continue;
+        if (d->f_type == FILE_TYPE_DIR && is_dot_name(d->f_name)) continue;
+        if (mark) bit_set(b_block->inode_bitmap, d->inode_index);
+        if (0 != (ret = mark_inode_blocks(d->inode_index, block, mark))) return ret;
+        if (d->f_type == FILE_TYPE_DIR && 0 != (ret = visit_tree(d->inode_index, block, mark, depth + 1))) return ret;
+    }
+    // a directory block that couldn't be read looks like the end of the directory
+    return (meta_error) ? -1 : 0;
+}
+/*
+block_referenced
+Description: checks if any file or directory uses a data block
+Input: data block index
+Output: 1 if used or the tree couldn't be read, 0 if not
+*/
+static int32_t block_referenced(uint32_t block) {
+    return visit_tree(0, block, 0, 0) != 0;
+}
+/*
+bitmaps_init
+Description: finds the allocation bitmaps of the image, images made without them
+get them built from what the dentries use, the image stays read only if they don't fit
+or the tree couldn't be read
+Input: none
+Output: none
+*/
+static void bitmaps_init() {
+    uint32_t i;
+    int32_t bitmap = -1;
+    block_bitmap = 0;
+    if (b_block->num_inodes > FS_MAX_INODES || b_block->num_datablocks > BLOCK_SIZE * 8) return;
+    meta_error = 0;
+    if (b_block->fs_magic == FS_MAGIC) {
+        if (b_block->bitmap_block < b_block->num_datablocks) block_bitmap = meta_block(data_start + b_block->bitmap_block);
+        return;
+    }
+    // block bitmap goes in the last block no file uses
+    for (i = b_block->num_datablocks; i-- > 0 && bitmap == -1; ) {
+        if (!block_referenced(i)) bitmap = i;
+    }
+    if (bitmap == -1 || meta_error) return;
+    change_begin();
+    if (0 == (block_bitmap = meta_block(data_start + bitmap))) {
+        change_end(0);
+        return;
+    }
+    memset(block_bitmap, 0, BLOCK_SIZE);
+    memset(b_block->inode_bitmap, 0, sizeof(b_block->inode_bitmap));
+    bit_set(block_bitmap, bitmap);
+    // inode 0 belongs to the directory and devices
+    bit_set(b_block->inode_bitmap, 0);
+    // a bitmap missing blocks would hand them out twice, so it isn't kept
+    if (0 != visit_tree(0, 0, 1, 0)) {
+        block_bitmap = 0;
+        change_end(1);
+        return;
+    }
+    b_block->bitmap_block = bitmap;
+    b_block->fs_magic = FS_MAGIC;
+    change_end(1);
+}
+/*
+alloc_run
+Description: takes free data blocks for a file, the run starting at goal is used if
+it is free so the file stays contiguous, then the first run that is long enough,
+then the longest run there is
+Input: block to try first, blocks wanted, where to put the first block taken
+Output: number of blocks taken, all zeroed, 0 if the image is full
+*/
+static uint32_t alloc_run(uint32_t goal, uint32_t count, uint32_t* start) {
+    uint32_t b, run, best = 0, best_len = 0;
+    uint32_t n = b_block->num_datablocks;
+    for (run = 0; goal + run < n && run < count && !bit_test(block_bitmap, goal + run); run++);
+    if (run > 0) {
+        best = goal;
+        best_len = run;
+    }
+    for (b = 0; b < n && best_len < count; b += run + 1) {
+        for (run = 0; b + run < n && run < count && !bit_test(block_bitmap, b + run); run++);
+        if (run > best_len) {
+            best = b;
+            best_len = run;
+        }
+    }
+    for (b = best; b < best + best_len; b++) {
+        bit_set(block_bitmap, b);
+        data_zero(b);
+    }
+    *start = best;
+    return best_len;
+}
+/*
+free_chain
+Description: gives back a chain of indirect extent blocks
+Input: first block of the chain
+Output: none
+*/
+static void free_chain(uint32_t b) {
+    extent_block_t* blk;
+    while (b < b_block->num_datablocks) {
+        bit_clear(block_bitmap, b);
+        // the rest of a chain that can't be read stays taken
+        if (0 == (blk = ext_block(b))) return;
+        b = blk->next;
+    }
+}
+/*
+add_extent
+Description: adds blocks to the end of an extent inode, the last extent grows if
+they follow it, a new indirect block is chained on once the last one is full
+Input: inode, first data block, number of blocks
+Output: 0 on success, -1 if no block was left for the indirect block or the
+inode couldn't be read
+*/
+static int32_t add_extent(uint32_t inode, uint32_t start, uint32_t count) {
+    extent_inode_t* in = ext_inode(inode);
+    extent_block_t* blk;
+    extent_block_t* last;
+    extent_t* e;
+    uint32_t b, index;
+    if (!in) return -1;
+    index = in->num_extents;
+    if (index > 0 && (e = get_extent(inode, index - 1)) && e->start + e->count == start) {
+        e->count += count;
+        return 0;
+    }
+    if (index >= INODE_EXTENTS && (index - INODE_EXTENTS) % BLOCK_EXTENTS == 0) {
+        if (0 == alloc_run(0, 1, &b)) return -1;
+        last = (index == INODE_EXTENTS) ? 0 : ext_block(chain_block(inode, (index - INODE_EXTENTS) / BLOCK_EXTENTS - 1));
+        if (0 == (blk = ext_block(b)) || (index != INODE_EXTENTS && !last)) {
+            bit_clear(block_bitmap, b);
+            return -1;
+        }
+        blk->next = EXTENT_NONE;
+        if (index == INODE_EXTENTS) in->indirect = b;
+        else last->next = b;
+    }
+    if (0 == (e = get_extent(inode, index))) return -1;
+    e->start = start;
+    e->count = count;
+    in->num_extents++;
+    return 0;
+}
+/*
+drop_blocks
+Description: gives back the blocks of an extent inode past the first keep, and the
+indirect blocks no longer needed
+Input: inode, number of blocks to keep
+Output: none
+*/
+static void drop_blocks(uint32_t inode, uint32_t keep) {
+    extent_inode_t* in = ext_inode(inode);
+    extent_block_t* blk;
+    extent_t* e;
+    uint32_t i, b, kept, off = 0, total = 0;
+    if (!in) return;
+    for (i = 0; i < in->num_extents && (e = get_extent(inode, i)); i++) {
+        kept = (keep > off) ? keep - off : 0;
+        off += e->count;
+        if (kept >= e->count) {
+            total = i + 1;
+            continue;
+        }
+        for (b = e->start + kept; b < e->start + e->count; b++) bit_clear(block_bitmap, b);
+        e->count = kept;
+        if (kept) total = i + 1;
+    }
+    in->num_extents = total;
+    // indirect blocks still holding extents
+    kept = (total > INODE_EXTENTS) ? (total - INODE_EXTENTS + BLOCK_EXTENTS - 1) / BLOCK_EXTENTS : 0;
+    if (kept == 0) {
+        free_chain(in->indirect);
+        in->indirect = EXTENT_NONE;
+        return;
+    }
+    b = chain_block(inode, kept - 1);
+    if (b == EXTENT_NONE || 0 == (blk = ext_block(b))) return;
+    free_chain(blk->next);
+    blk->next = EXTENT_NONE;
+}
+/*
+convert_inode
+Description: rewrites an inode that lists every block as an extent inode
+Input: inode
+Output: 0 on success, -1 if it couldn't be done, the inode is left as it was
+*/
+static int32_t convert_inode(uint32_t inode) {
+    extent_inode_t* in = ext_inode(inode);
+    inode_t* saved;
+    uint32_t i, n;
+    if (!in) return -1;
+    n = (in->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    // the extents would overwrite the block list as it is read, so read from a copy
+    if (0 == (saved = (inode_t*)alloc_frame())) return -1;
+    memcpy(saved, in, BLOCK_SIZE);
+    in->magic = EXTENT_MAGIC;
+    in->num_extents = 0;
+    in->indirect = EXTENT_NONE;
+    for (i = 0; i < n; i++) {
+        if (-1 == add_extent(inode, saved->db_index[i], 1)) {
+            free_chain(in->indirect);
+            memcpy(in, saved, BLOCK_SIZE);
+            put_frame((uint32_t)saved);
+            return -1;
+        }
+    }
+    put_frame((uint32_t)saved);
+    return 0;
+}
+/*
+set_length
+Description: grows or shrinks a file, new blocks are taken in runs after the
+last block, bytes past the end are kept zero, old inodes become extent inodes
+Input: inode, new length
+Output: length the file ended up with, short of the new length if the image is full,
+0 with meta_error set if the inode couldn't be read
+*/
+static uint32_t set_length(uint32_t inode, uint32_t length) {
+    inode_t* in = inode_at(inode);
+    uint32_t have, need, start, n, run, end;
+    int32_t last;
+    uint8_t* data;
+    if (!in) return 0;
+    have = (in->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    need = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    end = (length < in->length) ? length : in->length;
+    if (!is_extent_inode((extent_inode_t*)in) && -1 == convert_inode(inode)) return in->length;
+    // clear the rest of the block the shorter length ends in
+    if ((end % BLOCK_SIZE) && -1 != (last = block_run(inode, end / BLOCK_SIZE, &run)) && (data = data_get(last))) {
+        memset(&data[end % BLOCK_SIZE], 0, BLOCK_SIZE - end % BLOCK_SIZE);
+        data_put(last, 1);
+    }
+    if (need <= have) drop_blocks(inode, need);
+    while (have < need) {
+        last = (have) ? block_run(inode, have - 1, &run) : -1;
+        if (0 == (n = alloc_run(last + 1, need - have, &start))) break;
+        if (-1 == add_extent(inode, start, n)) {
+            while (n--) bit_clear(block_bitmap, start + n);
+            break;
+        }
+        have += n;
+    }
+    if (have < need) length = have * BLOCK_SIZE;
+    in->length = length;
+    return length;
+}
+/*
+free_inode
+Description: gives back an inode and its blocks
+Input: inode
+Output: none
+*/
+static void free_inode(uint32_t inode) {
+    set_length(inode, 0);
+    bit_clear(b_block->inode_bitmap, inode);
+    inode_orphan[inode] = 0;
+}
+/*
+name_hash
+Description: hashes a name in a directory, djb2
+Input: name, at most NAME_LENGTH characters are used
+Output: hash
+*/
+static uint32_t name_hash(const uint8_t* name) {
+    uint32_t i, hash = 5381;
+    for (i = 0; i < NAME_LENGTH && name[i]; i++) hash = hash * 33 + name[i];
+    return hash;
+}
+/*
+dir_block
+Description: finds a block of a subdirectory
+Input: directory inode, block within the directory
+Output: pointer to the block, 0 if the directory is shorter or it couldn't be read
+*/
+static dir_block_t* dir_block(uint32_t dir, uint32_t n) {
+    uint32_t run;
+    int32_t start, length;
+    if (-1 == (length = inode_length(dir)) || n >= (uint32_t)length / BLOCK_SIZE) return 0;
+    if (-1 == (start = block_run(dir, n, &run))) return 0;
+    return (dir_block_t*)meta_block(data_start + start);
+}
+/*
+dir_entry
+Description: gets a dentry slot of a directory by position, slots of
+subdirectories can be empty
+Input: directory inode, slot number
+Output: pointer to the slot, 0 past the end of the directory or if it couldn't
+be read, which sets meta_error
+*/
+static dentry_t* dir_entry(uint32_t dir, uint32_t index) {
+    dir_block_t* blk;
+    if (dir == 0) return (index < b_block->num_dentries) ? &b_block->dentries[index] : 0;
+    if (0 == (blk = dir_block(dir, index / DIR_ENTRIES))) return 0;
+    return &blk->entries[index % DIR_ENTRIES];
+}
+/*
+find_entry
+Description: looks up a name in a directory, subdirectories only search the
+chain of the bucket the name hashes to
+Input: directory inode, name
+Output: pointer to the dentry, 0 if there is none
+*/
+static dentry_t* find_entry(uint32_t dir, const uint8_t* name) {
+    uint32_t i, b, hops, n;
+    dentry_t* d;
+    dir_block_t* blk;
+    if (dir == 0) {
+        for (i = 0; (d = dir_entry(0, i)); i++) {
+            if (strncmp((int8_t*)d->f_name, (int8_t*)name, NAME_LENGTH) == 0) return d;
+        }
+        return 0;
+    }
+    if (0 == (blk = dir_block(dir, 0)) || blk->num_buckets == 0) return 0;
+    b = name_hash(name) % blk->num_buckets;
+    n = inode_length(dir) / BLOCK_SIZE;
+    // a chain can't be longer than the directory, so a bad image can't loop forever
+    for (hops = 0; hops < n && (blk = dir_block(dir, b)); hops++) {
+        for (i = 0; i < DIR_ENTRIES; i++) {
+            d = &blk->entries[i];
+            if (d->f_name[0] && strncmp((int8_t*)d->f_name, (int8_t*)name, NAME_LENGTH) == 0) return d;
+        }
+        if (0 == (b = blk->next)) break;
+    }
+    return 0;
+}
+/*
+walk_path
+Description: follows a path from the root directory, names are split by /,
+only the first NAME_LENGTH characters of a name are compared, as dentries hold no more
+Input: path, where to put the directory inode holding the last name and the last name,
+the directory is EXTENT_NONE if one on the way is missing or the path is the root
+Output: dentry of the last name, 0 if it doesn't exist
+*/
+static dentry_t* walk_path(const uint8_t* path, uint32_t* parent, uint8_t* name) {
+    uint32_t dir, len, n;
+    dentry_t* d = (dentry_t*)&root_dentry;
+    *parent = EXTENT_NONE;
+    name[0] = '\0';
+    while (1) {
+        while (*path == '/') path++;
+        if (*path == '\0') return d;
+        for (len = 0; path[len] && path[len] != '/'; len++);
+        // only directories can be walked into
+        if (d->f_type != FILE_TYPE_DIR || d->inode_index >= b_block->num_inodes) {
+            *parent = EXTENT_NONE;
+            return 0;
+        }
+        dir = d->inode_index;
+        // longer names match on their first NAME_LENGTH characters
+        n = (len > NAME_LENGTH) ? NAME_LENGTH : len;
+        memcpy(name, path, n);
+        name[n] = '\0';
+        path += len;
+        *parent = dir;
+        // the root has no .. entry
+        if (dir == 0 && strncmp((int8_t*)name, "..", NAME_LENGTH) == 0) {
+            d = (dentry_t*)&root_dentry;
+            continue;
+        }
+        if (0 == (d = find_entry(dir, name))) {
+            // only the last name may be missing
+            while (*path == '/') path++;
+            if (*path) *parent = EXTENT_NONE;
+            return 0;
+        }
+    }
+}
+/*
+fill_entry
+Description: sets up a dentry
+Input: dentry, name, type, inode
+Output: none
+*/
+static void fill_entry(dentry_t* d, const uint8_t* name, uint32_t type, uint32_t inode) {
+    memset(d, 0, sizeof(dentry_t));
+    strncpy((int8_t*)d->f_name, (int8_t*)name, NAME_LENGTH);
+    d->f_type = type;
+    d->inode_index = inode;
+}
+/*
+dir_insert
+Description: finds a free dentry slot for a name, the first block of the
+bucket's chain with room, or a new block added to the end of the chain,
+a chain already DIR_CHAIN_MAX blocks long gets the buckets doubled first
+Input: directory inode, name
+Output: pointer to the slot, 0 if the directory is full or couldn't be read
+*/
+static dentry_t* dir_insert(uint32_t dir, const uint8_t* name) {
+    uint32_t i, b, n, buckets, hops = 1;
+    dir_block_t* blk;
+    dir_block_t* last;
+    if (dir == 0) return (b_block->num_dentries < MAX_DENTRIES) ? &b_block->dentries[b_block->num_dentries++] : 0;
+    if (0 == (blk = dir_block(dir, 0)) || blk->num_buckets == 0) return 0;
+    buckets = blk->num_buckets;
+    b = name_hash(name) % buckets;
+    while (1) {
+        if (0 == (blk = dir_block(dir, b))) return 0;
+        if (blk->count < DIR_ENTRIES) {
+            for (i = 0; blk->entries[i].f_name[0]; i++);
+            blk->count++;
+            return &blk->entries[i];
+        }
+        if (blk->next == 0) break;
+        b = blk->next;
+        hops++;
+    }
+    // a long chain means too few buckets for the directory, spread it out and try again
+    if (hops >= DIR_CHAIN_MAX && buckets < DIR_MAX_BUCKETS && 0 == dir_rehash(dir)) return dir_insert(dir, name);
+    // chain is full, the new block starts out zeroed
+    n = inode_length(dir) / BLOCK_SIZE;
+    if (set_length(dir, (n + 1) * BLOCK_SIZE) != (n + 1) * BLOCK_SIZE) return 0;
+    if (0 == (last = dir_block(dir, b)) || 0 == (blk = dir_block(dir, n))) return 0;
+    last->next = n;
+    blk->count = 1;
+    return &blk->entries[0];
+}
+/*
+dir_remove
+Description: empties a dentry slot, the root is kept packed by moving its last dentry into the hole
+Input: directory inode, dentry in it
+Output: none
+*/
+static void dir_remove(uint32_t dir, dentry_t* d) {
+    dir_block_t* blk;
+    if (dir == 0) {
+        b_block->num_dentries--;
+        *d = b_block->dentries[b_block->num_dentries];
+        memset(&b_block->dentries[b_block->num_dentries], 0, sizeof(dentry_t));
+        return;
+    }
+    blk = (dir_block_t*)((uint8_t*)d - ((uint32_t)d - fs_start) % BLOCK_SIZE);
+    memset(d, 0, sizeof(dentry_t));
+    blk->count--;
+}
+/*
+dir_rehash
+Description: doubles the hash buckets of a subdirectory, the blocks where the new
+chains start are moved to the end of the directory, then each name whose bucket
+changed moves to its new chain, every block needed is added first so it can't
+stop half done
+Input: directory inode
+Output: 0 on success, -1 if the image is full or the directory couldn't be read
+*/
+static int32_t dir_rehash(uint32_t dir) {
+    uint32_t i, j, b, h, hops, moved, old, n, m, end, len, spare = 0;
+    dir_block_t* blk;
+    dir_block_t* to;
+    dentry_t* d;
+    if (0 == (blk = dir_block(dir, 0))) return -1;
+    old = blk->num_buckets;
+    n = inode_length(dir) / BLOCK_SIZE;
+    // blocks old to m-1 are in the way of the new heads, they go to end onwards
+    m = (n < 2 * old) ? n : 2 * old;
+    end = (n > 2 * old) ? n : 2 * old;
+    // the new chains need more blocks past their head if a lot of names move
+    for (h = 0; h < old; h++) {
+        for (b = h, hops = 0, moved = 0; hops < n; hops++) {
+            if (0 == (blk = dir_block(dir, b))) return -1;
+            for (i = 0; i < DIR_ENTRIES; i++) {
+                if (blk->entries[i].f_name[0] && name_hash(blk->entries[i].f_name) % (2 * old) != h) moved++;
+            }
+            if (0 == (b = blk->next)) break;
+        }
+        if (moved) spare += (moved - 1) / DIR_ENTRIES;
+    }
+    len = end + (m - old) + spare;
+    if (set_length(dir, len * BLOCK_SIZE) != len * BLOCK_SIZE) return -1;
+    // every block is read now, once cached they stay, so nothing below can fail
+    for (i = 0; i < len; i++) {
+        if (!dir_block(dir, i)) return -1;
+    }
+    for (j = old; j < m; j++) {
+        memcpy(dir_block(dir, end + j - old), dir_block(dir, j), BLOCK_SIZE);
+        memset(dir_block(dir, j), 0, BLOCK_SIZE);
+    }
+    // chains going through a moved block follow it
+    for (i = 0; i < len; i++) {
+        blk = dir_block(dir, i);
+        if (blk->next >= old && blk->next < m) blk->next += end - old;
+    }
+    dir_block(dir, 0)->num_buckets = 2 * old;
+    // a name in chain h either stays or goes to chain h + old
+    spare = end + m - old;
+    for (h = 0; h < old; h++) {
+        to = dir_block(dir, h + old);
+        for (b = h, hops = 0; hops < len; hops++) {
+            blk = dir_block(dir, b);
+            for (i = 0; i < DIR_ENTRIES; i++) {
+                d = &blk->entries[i];
+                if (!d->f_name[0] || name_hash(d->f_name) % (2 * old) == h) continue;
+                if (to->count == DIR_ENTRIES) {
+                    to->next = spare;
+                    to = dir_block(dir, spare++);
+                }
+                for (j = 0; to->entries[j].f_name[0]; j++);
+                memcpy(&to->entries[j], d, sizeof(dentry_t));
+                to->count++;
+                memset(d, 0, sizeof(dentry_t));
+                blk->count--;
+            }
+            if (0 == (b = blk->next)) break;
+        }
+    }
+    return 0;
+}
+/*
+create_entry
+Description: makes an empty file or directory with a new inode in a directory,
+directories get DIR_BUCKETS blocks and . and .. entries
+Input: parent directory inode, name, FILE_TYPE_FILE or FILE_TYPE_DIR
+Output: dentry of the new entry, 0 if the name is bad, the image is full or
+couldn't be read
+*/
+static dentry_t* create_entry(uint32_t parent, const uint8_t* name, uint32_t type) {
+    uint32_t inode;
+    extent_inode_t* in;
+    dir_block_t* blk;
+    dentry_t* d;
+    dentry_t* dot;
+    if (name[0] == '\0' || is_dot_name(name)) return 0;
+    for (inode = 1; inode < b_block->num_inodes && bit_test(b_block->inode_bitmap, inode); inode++);
+    if (inode == b_block->num_inodes) return 0;
+    if (0 == (in = ext_inode(inode))) return 0;
+    bit_set(b_block->inode_bitmap, inode);
+    // new files are always extent inodes
+    in->length = 0;
+    in->magic = (type == FILE_TYPE_DIR) ? DIR_MAGIC : EXTENT_MAGIC;
+    in->num_extents = 0;
+    in->indirect = EXTENT_NONE;
+    if (type == FILE_TYPE_DIR) {
+        if (set_length(inode, DIR_BUCKETS * BLOCK_SIZE) != DIR_BUCKETS * BLOCK_SIZE) goto FAIL;
+        if (0 == (blk = dir_block(inode, 0))) goto FAIL;
+        blk->num_buckets = DIR_BUCKETS;
+        if (0 == (dot = dir_insert(inode, (uint8_t*)"."))) goto FAIL;
+        fill_entry(dot, (uint8_t*)".", FILE_TYPE_DIR, inode);
+        if (0 == (dot = dir_insert(inode, (uint8_t*)".."))) goto FAIL;
+        fill_entry(dot, (uint8_t*)"..", FILE_TYPE_DIR, parent);
+    }
+    if (0 == (d = dir_insert(parent, name))) goto FAIL;
+    fill_entry(d, name, type, inode);
+    return d;
+    FAIL:
+    free_inode(inode);
     return 0;
 }
 /*
 read_dentry_by_name
-Description: fills dentry block with dentry in fs with specified name
-Input: name buffer pointer, dentry block to fill out
+Description: fills dentry block with the dentry a path leads to
+Input: path buffer pointer, dentry block to fill out
 Output: 0 on success, -1 on fail (non-existent)
 Effect: dentry filled with corresponding directory entry in fs
 */
 int32_t read_dentry_by_name(const uint8_t * fname, dentry_t* dentry) {
-    uint32_t i, j;
-    for (i = 0; i < b_block->num_dentries; i++) {
-        for (j = 0; j < MAX_NAME_LENGTH; j++) {
-            // mismatch string, try next
-            if(fname[j] != (b_block->dentries[i]).f_name[j])
-                break;
-            // fname EOS, or all 32 characters match
-            if(fname[j] == 0 || j == MAX_NAME_LENGTH-1)
-                goto FOUND;
-        }
-    }
+    uint32_t parent;
+    uint8_t name[NAME_LENGTH + 1];
+    dentry_t* d = walk_path(fname, &parent, name);
     // file not found
-    return -1;
-    // file found, copy dentry data
-    FOUND:
-    return read_dentry_by_index(i, dentry);
+    if (!d) return -1;
+    *dentry = *d;
+    return 0;
 }
 /*
 read_dentry_by_index
-Description: fills dentry block with dentry in fs with specified index
+Description: fills dentry block with dentry in the root with specified index
 Input: index, dentry block to fill out
 Output: 0 on success, -1 on fail (index out of bound)
 Effect: dentry filled with corresponding directory entry in fs
@@ -77,43 +899,87 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry) {
 read_data
 Description: read data for file specified by inode
 Input: file specified by inode, starting offset, buffer data should be read into, length to be read
-Output: number of bytes read. if read till EOF, 0
+Output: number of bytes read. if read till EOF, 0, -1 if the inode is bad or couldn't be read
 Effects: reads data into buf
 */
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length) {
-    uint32_t i, b_read, j;
-    uint32_t file_size = inodes[inode].length;
+    uint32_t off, run, n, b_read = 0;
+    int32_t start;
+    uint8_t* data;
+
+    int32_t file_len;
 
     // filter inode input
-    if (inode > b_block->num_inodes) return -1;
-    //printf("inode: %d f_size: %d",inode, file_size);
+    if (inode >= b_block->num_inodes) return -1;
+    if (-1 == (file_len = inode_length(inode))) return -1;
+    if (offset >= (uint32_t)file_len) return 0;
+    if (length > file_len - offset) length = file_len - offset;
 
-    b_read = 0;
-    // start at block offset is in, end at block the file ends at
-    for (i = (offset/BLOCK_SIZE); i <= (file_size/BLOCK_SIZE); i++) {
-        // reading our first block, start j at offset in block
-        // if reading any other block, start j at 0
-        j = (!b_read) ? offset % BLOCK_SIZE : 0;
-        // read up to BLOCK_SIZE per block
-        for ( ; j < BLOCK_SIZE; j++) {
-            if (b_read >= length || b_read >= (file_size-offset)) goto DONE;
-            buf[b_read++] = d_blocks[inodes[inode].db_index[i]].data[j];
-        }
-    }
-    DONE:
+    while (b_read < length) {
+        // blocks that follow each other in the image are copied in one go
+        if (-1 == (start = block_run(inode, (offset + b_read) / BLOCK_SIZE, &run))) break;
+        off = (offset + b_read) % BLOCK_SIZE;
+        // cached blocks aren't next to each other in memory
+        if (fs_dev) run = 1;
+        n = (run * BLOCK_SIZE - off > length - b_read) ? length - b_read : run * BLOCK_SIZE - off;
+        if (0 == (data = data_get(start))) break;
+        memcpy(buf + b_read, &data[off], n);
+        data_put(start, 0);
+        b_read += n;
+    }
     // return bytes read
     return b_read;
 }
 /*
+file_length
+Description: gets the size of a file
+Input: inode
+Output: length in bytes, -1 on bad inode or if it couldn't be read
+*/
+int32_t file_length(uint32_t inode) {
+    if (inode >= b_block->num_inodes) return -1;
+    return inode_length(inode);
+}
+/*
+file_block_addr
+Description: finds where a block of a file sits in memory, the caller holds a
+frame reference on it until put_frame, so the buffer cache dropping it is fine
+Input: inode, index of block within the file
+Output: address of the data block, 0 if past the end of the file or bad inode
+*/
+uint32_t file_block_addr(uint32_t inode, uint32_t block) {
+    uint32_t run;
+    int32_t start, length;
+    uint8_t* data;
+    if (inode >= b_block->num_inodes || -1 == (length = inode_length(inode))) return 0;
+    if (block >= (length + BLOCK_SIZE - 1) / BLOCK_SIZE) return 0;
+    if (-1 == (start = block_run(inode, block, &run))) return 0;
+    if (0 == (data = data_get(start))) return 0;
+    get_frame((uint32_t)data);
+    data_put(start, 0);
+    return (uint32_t)data;
+}
+/*
+fs_is_dir
+Description: checks if an inode is a directory
+Input: inode
+Output: 1 for the root and subdirectories, 0 otherwise or if it couldn't be read
+*/
+int32_t fs_is_dir(uint32_t inode) {
+    extent_inode_t* in;
+    if (inode == 0) return 1;
+    return inode < b_block->num_inodes && (in = ext_inode(inode)) && in->magic == DIR_MAGIC;
+}
+/*
 read_directory
 Desc: Handle reading of directory type entry
-Input: Buf to write entry name to and nbytes to write
-Output: number of bytes read, or 0 if no more files in directory to read
+Input: entry to read, Buf to write entry name to and nbytes to write
+Output: number of bytes read
 */
-int32_t read_directory(uint32_t index, void* buf, int32_t nbytes) {
+int32_t read_directory(const dentry_t* dentry, void* buf, int32_t nbytes) {
     // wipe buf
     memset(buf,0,nbytes);
-    uint8_t* filename = b_block->dentries[index].f_name;
+    const uint8_t* filename = dentry->f_name;
     int i;
     // put name of enteries in buf
     for (i = 0; i < MAX_NAME_LENGTH && i < nbytes && filename[i] != 0; i++) {
@@ -125,62 +991,315 @@ int32_t read_directory(uint32_t index, void* buf, int32_t nbytes) {
 file_opens
 Description: opens file and puts on top of file stack
 Input: filename
-Output: 0 on success, -1 on non-existent file
+Output: 0 on success, -1 on non-existent file, or with FD_TRUNC on a file mapped with mmap
 Effects: pushes opened file on top of stack
 */
 int32_t file_open(int32_t fd, const uint8_t* filename) {
     // filter fd
     if (fd < 2) return -1;
-    // open dentry and put dentry in opened file
-    dentry_t open_dentry;
-    int32_t ret = read_dentry_by_name(filename, &open_dentry);
-    if (ret == 0) {
-        current_task_pcb->fd_arr[fd].inode = open_dentry.inode_index;
-        current_task_pcb->fd_arr[fd].file_position = 0;
+    // walk the path to the dentry and put it in opened file
+    dentry_t* open_dentry;
+    uint32_t flags, parent, inode, type;
+    uint8_t name[NAME_LENGTH + 1];
+    cli_and_save(flags);
+    meta_error = 0;
+    if (fd_file(fd)->flags & (FD_CREATE | FD_TRUNC)) change_begin();
+    open_dentry = walk_path(filename, &parent, name);
+    // make the file if asked to, its directory exists and the image can be written,
+    // a directory that couldn't be read might have it already
+    if (!open_dentry && !meta_error && parent != EXTENT_NONE && (fd_file(fd)->flags & FD_CREATE) && block_bitmap) {
+        open_dentry = create_entry(parent, name, FILE_TYPE_FILE);
     }
-    return ret;
+    // emptying a file would free blocks still mapped by mmap
+    if (open_dentry && open_dentry->f_type == FILE_TYPE_FILE && (fd_file(fd)->flags & FD_TRUNC) && task_maps_inode(open_dentry->inode_index)) {
+        open_dentry = 0;
+    }
+    if (!open_dentry) {
+        if (fs_changing) change_end(1);
+        restore_flags(flags);
+        return -1;
+    }
+    inode = open_dentry->inode_index;
+    type = open_dentry->f_type;
+    fd_file(fd)->inode = inode;
+    fd_file(fd)->file_position = 0;
+    if (type == FILE_TYPE_FILE && (fd_file(fd)->flags & FD_TRUNC) && block_bitmap) set_length(inode, 0);
+    if (type != FILE_TYPE_RTC && inode != 0 && inode < FS_MAX_INODES) inode_opens[inode]++;
+    if (fs_changing) change_end(1);
+    restore_flags(flags);
+    // device entries in the image open the device registered for them
+    if (type == FILE_TYPE_RTC) {
+        fd_file(fd)->file_op_table_ptr = vfs_find_device((uint8_t*)"rtc");
+        if (!fd_file(fd)->file_op_table_ptr) return -1;
+        return fd_file(fd)->file_op_table_ptr->open(fd, filename);
+    }
+    return 0;
 }
 /*
 file_read
 Description: read data for file currently open
 Input: buffer data should be read into, length to be read
-Output: number of bytes read. if read till EOF, 0
+Output: number of bytes read. if read till EOF, 0, -1 if it couldn't be read
 Effects: reads data into buf
 */
 int32_t file_read(int32_t fd, void* buf, int32_t nbytes) {
     // filter fd
     if (fd < 2) return -1;
     // get inode from fd
-    uint32_t inode = current_task_pcb->fd_arr[fd].inode;
-    uint32_t file_pos = current_task_pcb->fd_arr[fd].file_position;
+    uint32_t inode = fd_file(fd)->inode;
+    uint32_t file_pos = fd_file(fd)->file_position;
     int32_t ret;
-    // handle when reading directory
-    if (inode == 0) {
-        if (file_pos >= b_block->num_dentries) return 0;
-        ret = read_directory(file_pos, buf, nbytes);
-        current_task_pcb->fd_arr[fd].file_position++;
+    dentry_t* d;
+    // handle when reading directory, position is the next slot to look at
+    if (fs_is_dir(inode)) {
+        meta_error = 0;
+        while ((d = dir_entry(inode, file_pos)) && d->f_name[0] == '\0') file_pos++;
+        if (!d) return (meta_error) ? -1 : 0;
+        ret = read_directory(d, buf, nbytes);
+        fd_file(fd)->file_position = file_pos + 1;
         return ret;
     }
     // call read data with inode specified from fd
-    ret = read_data(inode, file_pos, (uint8_t*)buf, (uint32_t)nbytes);
+    if (-1 == (ret = read_data(inode, file_pos, (uint8_t*)buf, (uint32_t)nbytes))) return -1;
     // update file_pos
-    current_task_pcb->fd_arr[fd].file_position += ret;
+    fd_file(fd)->file_position += ret;
     return ret;
 }
 /*
 file_write
-Description: not allowed
-Output: always -1
+Description: writes at the file position, the file grows with blocks taken from the bitmap
+Input: buffer to write from, length to write
+Output: number of bytes written, -1 if nothing could be written
 */
 int32_t file_write(int32_t fd, const void* buf, int32_t nbytes) {
-    // read only fs, no writing allowed
-    return -1;
+    uint32_t inode = fd_file(fd)->inode;
+    uint32_t pos = fd_file(fd)->file_position;
+    uint32_t flags, end, off, run, n, length, limit, done = 0;
+    int32_t start;
+    uint8_t* data;
+    // directories and images without bitmaps can't be written
+    if (fd < 2 || fs_is_dir(inode) || !block_bitmap) return -1;
+    if (nbytes <= 0) return 0;
+    if (pos >= FS_MAX_LENGTH) return -1;
+    end = ((uint32_t)nbytes > FS_MAX_LENGTH - pos) ? FS_MAX_LENGTH : pos + nbytes;
+    cli_and_save(flags);
+    while (pos + done < end) {
+        if (-1 == (int32_t)(length = inode_length(inode))) break;
+        if (length <= pos + done) {
+            // grow a piece at a time, so through the cache the blocks it zeroes are
+            // still cached when they are written over, the data goes to the disk on close
+            limit = (end - pos - done > GROW_BLOCKS * BLOCK_SIZE) ? pos + done + GROW_BLOCKS * BLOCK_SIZE : end;
+            change_begin();
+            length = set_length(inode, limit);
+            change_end(0);
+            // the image is full
+            if (length <= pos + done) break;
+        }
+        limit = (length < end) ? length : end;
+        if (-1 == (start = block_run(inode, (pos + done) / BLOCK_SIZE, &run))) break;
+        off = (pos + done) % BLOCK_SIZE;
+        if (fs_dev) run = 1;
+        n = (run * BLOCK_SIZE - off > limit - pos - done) ? limit - pos - done : run * BLOCK_SIZE - off;
+        if (0 == (data = data_get(start))) break;
+        memcpy(&data[off], (const uint8_t*)buf + done, n);
+        data_put(start, 1);
+        done += n;
+    }
+    fd_file(fd)->file_position += done;
+    if (done) fd_file(fd)->flags |= FD_WRITTEN;
+    restore_flags(flags);
+    return (done) ? (int32_t)done : -1;
 }
 /*
 file_close
-Description: does nothing
+Description: drops the open of the file, a file unlinked while open is freed now,
+changes on a disk are written back if the file was written or freed
+Input: fd
 Output: always 0
 */
 int32_t file_close(int32_t fd) {
+    uint32_t flags, inode = fd_file(fd)->inode;
+    int32_t changed = fd_file(fd)->flags & FD_WRITTEN;
+    if (inode == 0 || inode >= FS_MAX_INODES) return 0;
+    cli_and_save(flags);
+    if (inode_opens[inode] > 0) inode_opens[inode]--;
+    if (inode_orphan[inode] && inode_opens[inode] == 0) {
+        change_begin();
+        free_inode(inode);
+        change_end(0);
+        changed = 1;
+    }
+    restore_flags(flags);
+    // what was written through the file goes to the disk now, closing a file only
+    // read doesn't wait on the disk
+    if (fs_dev && changed) bcache_sync();
+    return 0;
+}
+/*
+file_poll
+Description: files in memory never block
+Output: always POLLIN and POLLOUT
+*/
+int32_t file_poll(int32_t fd) {
+    return POLLIN | POLLOUT;
+}
+/*
+file_truncate
+Description: sets the length of a file, growing it adds zeroed blocks
+Input: fd, new length
+Output: 0 on success, -1 on fail, if the image is full or couldn't be read, or
+if it would shorten a file that is mapped with mmap
+*/
+int32_t file_truncate(int32_t fd, uint32_t length) {
+    uint32_t flags, inode = fd_file(fd)->inode;
+    int32_t ret;
+    if (fs_is_dir(inode) || !block_bitmap || length > FS_MAX_LENGTH) return -1;
+    cli_and_save(flags);
+    // blocks still mapped by mmap can't be freed
+    if (length < (uint32_t)inode_length(inode) && task_maps_inode(inode)) {
+        restore_flags(flags);
+        return -1;
+    }
+    meta_error = 0;
+    change_begin();
+    ret = (set_length(inode, length) == length && !meta_error) ? 0 : -1;
+    change_end(1);
+    restore_flags(flags);
+    return ret;
+}
+/*
+file_unlink
+Description: removes a file or an empty directory from its directory, the inode
+and blocks are freed once it isn't open anymore
+Input: path
+Output: 0 on success, -1 if there is no such file, the directory isn't empty,
+the file is mapped with mmap or the image can't be written or read
+*/
+int32_t file_unlink(const uint8_t* filename) {
+    dentry_t* d;
+    dentry_t* e;
+    uint32_t i, flags, parent, inode;
+    uint8_t name[NAME_LENGTH + 1];
+    if (!block_bitmap) return -1;
+    cli_and_save(flags);
+    meta_error = 0;
+    change_begin();
+    d = walk_path(filename, &parent, name);
+    if (!d || parent == EXTENT_NONE || d->inode_index == 0 || is_dot_name(name)) goto FAIL;
+    if (d->f_type != FILE_TYPE_FILE && d->f_type != FILE_TYPE_DIR) goto FAIL;
+    inode = d->inode_index;
+    // blocks still mapped by mmap can't be freed
+    if (task_maps_inode(inode)) goto FAIL;
+    if (d->f_type == FILE_TYPE_DIR) {
+        for (i = 0; (e = dir_entry(inode, i)); i++) {
+            if (e->f_name[0] && !is_dot_name(e->f_name)) goto FAIL;
+        }
+        // part of it couldn't be read, so it may not be empty
+        if (meta_error) goto FAIL;
+    }
+    dir_remove(parent, d);
+    if (inode_opens[inode] == 0) free_inode(inode);
+    else inode_orphan[inode] = 1;
+    change_end(1);
+    restore_flags(flags);
     return 0;
+    FAIL:
+    change_end(1);
+    restore_flags(flags);
+    return -1;
+}
+/*
+file_mkdir
+Description: makes an empty directory
+Input: path of the new directory
+Output: 0 on success, -1 if it exists, its parent doesn't, the image is full or
+couldn't be read
+*/
+int32_t file_mkdir(const uint8_t* path) {
+    dentry_t* d;
+    uint32_t flags, parent;
+    uint8_t name[NAME_LENGTH + 1];
+    if (!block_bitmap) return -1;
+    cli_and_save(flags);
+    meta_error = 0;
+    change_begin();
+    d = walk_path(path, &parent, name);
+    if (!d && !meta_error && parent != EXTENT_NONE) d = create_entry(parent, name, FILE_TYPE_DIR);
+    else d = 0;
+    change_end(1);
+    restore_flags(flags);
+    return (d) ? 0 : -1;
+}
+/*
+file_getdents
+Description: fills buf with as many entries of an open directory as fit, and
+moves the position past them
+Input: fd, buffer, size of buffer
+Output: bytes filled, 0 at the end of the directory, -1 if fd isn't a directory,
+not even one entry fits or the first one couldn't be read
+*/
+int32_t file_getdents(int32_t fd, void* buf, int32_t nbytes) {
+    uint32_t inode = fd_file(fd)->inode;
+    uint32_t pos = fd_file(fd)->file_position;
+    int32_t filled = 0, size;
+    dentry_t* d;
+    dirent_t* ent;
+    if (!fs_is_dir(inode)) return -1;
+    meta_error = 0;
+    for (; (d = dir_entry(inode, pos)); pos++) {
+        if (d->f_name[0] == '\0') continue;
+        if (nbytes - filled < (int32_t)sizeof(dirent_t)) break;
+        ent = (dirent_t*)((uint8_t*)buf + filled);
+        memcpy(ent->name, d->f_name, DIRENT_NAME_LENGTH);
+        ent->type = d->f_type;
+        ent->inode = d->inode_index;
+        // devices have no data, inode 0 is only theirs and the root's
+        size = (d->inode_index != 0 && d->inode_index < b_block->num_inodes) ? inode_length(d->inode_index) : 0;
+        if (size == -1) break;
+        ent->size = size;
+        filled += sizeof(dirent_t);
+    }
+    fd_file(fd)->file_position = pos;
+    if (filled == 0 && (d || meta_error)) return -1;
+    return filled;
+}
+/*
+inode_stat
+Description: fills in a stat from an inode
+Input: inode, f_type of its dentry, stat to fill in
+Output: 0 on success, -1 if the inode couldn't be read
+*/
+static int32_t inode_stat(uint32_t inode, uint32_t type, stat_t* st) {
+    int32_t size;
+    // devices and the root have no data of their own
+    size = (inode != 0 && inode < b_block->num_inodes) ? inode_length(inode) : 0;
+    if (size == -1) return -1;
+    st->type = type;
+    st->inode = inode;
+    st->size = size;
+    st->blocks = (st->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    return 0;
+}
+/*
+file_stat
+Description: looks up a path without opening it
+Input: path, stat to fill in
+Output: 0 on success, -1 if there is no such file or it couldn't be read
+*/
+int32_t file_stat(const uint8_t* path, stat_t* st) {
+    uint32_t parent;
+    uint8_t name[NAME_LENGTH + 1];
+    dentry_t* d = walk_path(path, &parent, name);
+    if (!d) return -1;
+    return inode_stat(d->inode_index, d->f_type, st);
+}
+/*
+file_fstat
+Description: fills in a stat for an open file or directory
+Input: fd, stat to fill in
+Output: 0 on success, -1 if the inode couldn't be read
+*/
+int32_t file_fstat(int32_t fd, stat_t* st) {
+    uint32_t inode = fd_file(fd)->inode;
+    return inode_stat(inode, fs_is_dir(inode) ? FILE_TYPE_DIR : FILE_TYPE_FILE, st);
 }
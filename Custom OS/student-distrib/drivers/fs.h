@@ -2,10 +2,31 @@
 #define FS_H
 
 #include "../types.h"
+#include "../vfs.h"
+#include "../bcache.h"
 
 #define BLOCK_SIZE 4096
 #define NAME_LENGTH 32
 #define MAX_OPENED_FILE 32
+#define FILE_TYPE_RTC 0
+#define FILE_TYPE_DIR 1
+#define FILE_TYPE_FILE 2
+#define MAX_DENTRIES 63
+#define FS_PATH_LENGTH 128 // longest path open and execute take
+#define FS_MAX_DEPTH 16    // deepest directory nesting followed when checking the image
+#define FS_MAGIC 0x53465752 // "RWFS", the allocation bitmaps in the boot block are set up
+#define FS_MAX_INODES 256   // inodes the inode bitmap has room for
+#define INODE_BLOCKS (BLOCK_SIZE/4-1) // blocks an inode_t can list
+#define FS_MAX_LENGTH 0xFFFFF000 // largest file, extent inodes only stop at the 32 bit length
+#define EXTENT_MAGIC 0x31545845 // "EXT1", marks an extent_inode_t
+#define EXTENT_NONE 0xFFFFFFFF
+#define INODE_EXTENTS ((BLOCK_SIZE-16)/8) // extents held in the inode itself
+#define BLOCK_EXTENTS ((BLOCK_SIZE-8)/8)  // extents held in each indirect extent block
+#define DIR_MAGIC 0x31524944 // "DIR1", marks an extent inode holding a directory
+#define DIR_ENTRIES 63 // dentries in each directory block
+#define DIR_BUCKETS 4  // hash buckets of a directory made by mkdir
+#define DIR_MAX_BUCKETS 64 // buckets are doubled up to this many, chains just grow after
+#define DIR_CHAIN_MAX 2    // full blocks in a chain before the buckets are doubled
 
 typedef struct dentry {
     uint8_t  f_name[NAME_LENGTH];
@@ -18,8 +39,11 @@ typedef struct boot_block {
     uint32_t num_dentries;
     uint32_t num_inodes;
     uint32_t num_datablocks;
-    uint8_t  reserved[52]; // 52B Padding
-    dentry_t dentries[63]; // 63 dentry (each 64B) + boot block info (64B) should be 4096
+    uint32_t fs_magic;     // FS_MAGIC once the bitmaps are set up, images from createfs have 0
+    uint32_t bitmap_block; // data block holding the block bitmap, bit set if the block is used
+    uint8_t  inode_bitmap[FS_MAX_INODES/8]; // bit set if the inode is used
+    uint8_t  reserved[12]; // 12B Padding
+    dentry_t dentries[MAX_DENTRIES]; // 63 dentry (each 64B) + boot block info (64B) should be 4096
 } __attribute__((packed)) boot_block_t;
 
 typedef struct inode {
@@ -27,20 +51,65 @@ typedef struct inode {
     uint32_t db_index[(BLOCK_SIZE/4)-1];
 } __attribute__((packed)) inode_t;
 
+/* blocks start to start+count-1 of the image hold consecutive blocks of a file */
+typedef struct extent {
+    uint32_t start;
+    uint32_t count;
+} __attribute__((packed)) extent_t;
+
+/* inode listing runs of blocks instead of every block, extents past the ones
+ * that fit here are in a chain of indirect extent blocks */
+typedef struct extent_inode {
+    uint32_t length;
+    uint32_t magic;       // EXTENT_MAGIC, where an inode_t has db_index[0], which is never this big
+    uint32_t num_extents; // extents in the inode and the indirect blocks together, in file order
+    uint32_t indirect;    // first indirect extent block, EXTENT_NONE if there is none
+    extent_t extents[INODE_EXTENTS];
+} __attribute__((packed)) extent_inode_t;
+
+typedef struct extent_block {
+    uint32_t next;     // next indirect extent block, EXTENT_NONE if this is the last
+    uint32_t reserved;
+    extent_t extents[BLOCK_EXTENTS];
+} __attribute__((packed)) extent_block_t;
+
+/* a block of a subdirectory, blocks 0 to num_buckets-1 start one hash chain
+ * each, a name is always in the chain of its bucket, full chains get a new
+ * block added to the end of the directory, or the buckets are doubled once a
+ * chain has DIR_CHAIN_MAX blocks, the root is still the boot block */
+typedef struct dir_block {
+    uint32_t num_buckets; // only block 0 has this set
+    uint32_t next;        // next block of this chain in the directory, 0 if last
+    uint32_t count;       // dentries in use in this block
+    uint8_t  reserved[52];
+    dentry_t entries[DIR_ENTRIES]; // f_name[0] is 0 if unused
+} __attribute__((packed)) dir_block_t;
+
 typedef struct d_block {
     uint8_t data[BLOCK_SIZE];
 } __attribute__((packed)) d_block_t;
 
 extern int32_t filesystem_init(uint32_t module_start, uint32_t module_end);
+extern int32_t filesystem_init_disk(block_device_t* dev);
 extern int32_t read_dentry_by_name(const uint8_t * fname, dentry_t* dentry);
 extern int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 extern int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+extern int32_t file_length(uint32_t inode);
+extern uint32_t file_block_addr(uint32_t inode, uint32_t block);
+extern int32_t fs_is_dir(uint32_t inode);
 
-extern int32_t* fs_op_table[4];
+extern file_operations_t fs_op_table;
 
 extern int32_t file_open(int32_t fd, const uint8_t* filename);
 extern int32_t file_read(int32_t fd, void* buf, int32_t nbytes);
 extern int32_t file_write(int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t file_close(int32_t fd);
+extern int32_t file_poll(int32_t fd);
+extern int32_t file_truncate(int32_t fd, uint32_t length);
+extern int32_t file_unlink(const uint8_t* filename);
+extern int32_t file_mkdir(const uint8_t* path);
+extern int32_t file_getdents(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t file_stat(const uint8_t* path, stat_t* st);
+extern int32_t file_fstat(int32_t fd, stat_t* st);
 
 #endif
@@ -3,6 +3,8 @@
 #include "../lib.h"
 #include "term.h"
 #include "../tasks.h"
+#include "../scheduler.h"
+#include "../signal.h"
 
 #define KB_PORT 0x60
 #define ENTER 0x1C
@@ -16,6 +18,8 @@
 #define CAPS_LOCK 0x3A
 #define ALT_1 0x38
 #define ALT_0 0xB8
+#define PAGE_UP 0x49
+#define PAGE_DOWN 0x51
 
 #define ASCII_TABLE_SIZE 0x3A
 
@@ -49,12 +53,41 @@ uint8_t ctrl = 0;
 uint8_t alt = 0;
 uint8_t capslock = 0;
 
+/*
+* kb_line_done
+* DESCRIPTION: puts the line typed on the active terminal and its line feed into
+*              the terminal's ring and wakes a reader, a line that doesn't fit
+*              is dropped whole and counted so a reader never sees part of one
+* INPUT: None
+* OUTPUT: None
+*/
+static void kb_line_done(void) {
+    term_t* t = &terms[active_terminal_id];
+    kb_ring_t* r = &t->_kb_ring;
+    uint32_t i, tail = r->tail;
+    if (KB_RING_SIZE - (tail - r->head) < (uint32_t)t->_kb_buf_index + 1) {
+        r->overruns++;
+    }
+    else {
+        for (i = 0; i < t->_kb_buf_index; i++) {
+            r->buf[tail++ & (KB_RING_SIZE - 1)] = t->_kb_buf[i];
+        }
+        r->buf[tail++ & (KB_RING_SIZE - 1)] = '\n';
+        // the line is in before term_read can see it
+        asm volatile ("" : : : "memory");
+        r->tail = tail;
+        scheduler_wake(r);
+        scheduler_poll_notify();
+    }
+    t->_kb_buf_index = 0;
+}
+
 /*
 * keyboard_isr_handler
 * DESCRIPTION: Gets scancode of the key pressed and adds appropriate keys ot the buffer
 * INPUT: None
 * OUTPUT: None
-* SIDE EFFECT: adds to buffer, clears buffer when enter is pressed
+* SIDE EFFECT: adds to buffer, moves the line to the terminal's ring when enter is pressed
 * Source: osdev.org/PS2
 */
 void keyboard_isr_handler(void) {
@@ -86,37 +119,46 @@ void keyboard_isr_handler(void) {
         }
         return;
     }
+    // handle shift page up, page down, half a screen through the scrollback
+    if (shift && (scancode == PAGE_UP || scancode == PAGE_DOWN)) {
+        term_scrollback((scancode == PAGE_UP) ? TERM_ROWS / 2 : -(TERM_ROWS / 2));
+        return;
+    }
     // handle if scancode is available
     if (scancode < ASCII_TABLE_SIZE) {
+        // typing goes back to the live screen
+        if (terms[active_terminal_id]._view) term_scrollback(-SCROLLBACK_ROWS);
         // will need to write to active terminal, not the terminal for the task that running at this quantum
         rw_active_terminal = 1;
         // handle ctrl l
         if (ctrl && scan_to_ascii[scancode] == 'l') {
             // clear active terminal
             clear();
-            puts((int8_t*)kb_buf);
+            putbuf(kb_buf, kb_buf_index);
+        }
+        // handle ctrl c
+        else if (ctrl && scan_to_ascii[scancode] == 'c') {
+            signal_interrupt(active_terminal_id);
         }
-        // any other character
+        // any other character, typed ahead if nobody is reading yet
         else {
-            if (kb_enabled){
-                // handle enter
-                if (scancode == ENTER) {
-                    putc('\n');
-                    kb_buf_ready = 1;
-                }
-                // handle backspace
-                else if (scancode == BACKSPACE) {
-                    if (kb_buf_index > 0) {
-                        kb_buf_index--;
-                        delc();
-                    }
-                }
-                // any other character
-                else if(kb_buf_index < KB_BUF_SIZE) {
-                    kb_buf[kb_buf_index++] = (shift || capslock) ? s_scan_to_ascii[scancode] : scan_to_ascii[scancode];
-                    putc(kb_buf[kb_buf_index-1]);
+            // handle enter
+            if (scancode == ENTER) {
+                putc('\n');
+                kb_line_done();
+            }
+            // handle backspace
+            else if (scancode == BACKSPACE) {
+                if (kb_buf_index > 0) {
+                    kb_buf_index--;
+                    delc();
                 }
             }
+            // any other character
+            else if(kb_buf_index < KB_BUF_SIZE) {
+                kb_buf[kb_buf_index++] = (shift || capslock) ? s_scan_to_ascii[scancode] : scan_to_ascii[scancode];
+                putc(kb_buf[kb_buf_index-1]);
+            }
         }
         rw_active_terminal = 0;
     }
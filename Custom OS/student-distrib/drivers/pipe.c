@@ -0,0 +1,162 @@
+#include "pipe.h"
+
+#include "../lib.h"
+#include "../tasks.h"
+#include "../scheduler.h"
+
+int32_t pipe_unavail();
+
+file_operations_t pipe_read_op_table = {pipe_open, pipe_read, pipe_unavail, pipe_close, pipe_poll};
+file_operations_t pipe_write_op_table = {pipe_open, pipe_unavail, pipe_write, pipe_close, pipe_poll};
+
+static pipe_t pipes[MAX_PIPE];
+
+#define fd_pipe(fd) (&pipes[fd_file(fd)->inode])
+
+/*
+* pipe_alloc
+* DESCRIPTION: finds an unused pipe and gives it one reader and one writer
+* INPUT: none
+* OUTPUT: pipe id, -1 if all pipes are in use
+*/
+int32_t pipe_alloc() {
+    int32_t i;
+    uint32_t flags;
+    cli_and_save(flags);
+    for (i = 0; i < MAX_PIPE; i++) {
+        // pipe is free once both ends are closed
+        if (pipes[i].readers == 0 && pipes[i].writers == 0) {
+            pipes[i].head = 0;
+            pipes[i].count = 0;
+            pipes[i].readers = 1;
+            pipes[i].writers = 1;
+            restore_flags(flags);
+            return i;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+* pipe_open
+* DESCRIPTION: pipes can't be opened by name
+* OUTPUT: always -1
+*/
+int32_t pipe_open(int32_t fd, const uint8_t* filename) {
+    return -1;
+}
+
+/*
+* pipe_read
+* DESCRIPTION: sleeps until the pipe has data or no writers are left, then copies out what is there
+* INPUT: buf to copy to, nbytes to copy
+* OUTPUT: number of bytes read, 0 if no writers are left and pipe is empty
+*/
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes) {
+    pipe_t* p = fd_pipe(fd);
+    uint32_t flags, n, first;
+    if (nbytes <= 0) return 0;
+    // check and sleep with interrupts off so a wake up from the writer can't be missed
+    cli_and_save(flags);
+    if (p->count == 0 && p->writers > 0 && (fd_file(fd)->flags & FD_NONBLOCK)) {
+        restore_flags(flags);
+        return -1;
+    }
+    while (p->count == 0 && p->writers > 0) {
+        scheduler_sleep(p);
+    }
+    n = (p->count < (uint32_t)nbytes) ? p->count : (uint32_t)nbytes;
+    // copy up to the end of the ring, then the wrapped around part
+    first = (n < PIPE_BUF_SIZE - p->head) ? n : PIPE_BUF_SIZE - p->head;
+    memcpy(buf, &p->buf[p->head], first);
+    memcpy((uint8_t*)buf + first, p->buf, n - first);
+    p->head = (p->head + n) % PIPE_BUF_SIZE;
+    p->count -= n;
+    // space was freed, let writers continue
+    if (n) {
+        scheduler_wake(p);
+        scheduler_poll_notify();
+    }
+    restore_flags(flags);
+    return n;
+}
+
+/*
+* pipe_write
+* DESCRIPTION: copies buf into the pipe, sleeping whenever the pipe is full
+* INPUT: buf to copy from, nbytes to copy
+* OUTPUT: number of bytes written, -1 if there are no readers left
+*/
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes) {
+    pipe_t* p = fd_pipe(fd);
+    uint32_t flags, n, first, tail;
+    int32_t written = 0;
+    cli_and_save(flags);
+    while (written < nbytes) {
+        // non blocking, hand back what fit
+        if (p->count == PIPE_BUF_SIZE && (fd_file(fd)->flags & FD_NONBLOCK)) break;
+        while (p->count == PIPE_BUF_SIZE && p->readers > 0) {
+            scheduler_sleep(p);
+        }
+        // nobody will ever read this
+        if (p->readers == 0) break;
+        n = PIPE_BUF_SIZE - p->count;
+        if (n > (uint32_t)(nbytes - written)) n = nbytes - written;
+        tail = (p->head + p->count) % PIPE_BUF_SIZE;
+        first = (n < PIPE_BUF_SIZE - tail) ? n : PIPE_BUF_SIZE - tail;
+        memcpy(&p->buf[tail], (uint8_t*)buf + written, first);
+        memcpy(p->buf, (uint8_t*)buf + written + first, n - first);
+        p->count += n;
+        written += n;
+        // data is ready, let readers continue
+        scheduler_wake(p);
+        scheduler_poll_notify();
+    }
+    restore_flags(flags);
+    if (written == 0 && nbytes > 0) return -1;
+    return written;
+}
+
+/*
+* pipe_close
+* DESCRIPTION: drops the reference held by this end, wakes the other end so it can see EOF
+* INPUT: fd
+* OUTPUT: 0 on success
+*/
+int32_t pipe_close(int32_t fd) {
+    pipe_t* p = fd_pipe(fd);
+    uint32_t flags;
+    cli_and_save(flags);
+    if (fd_file(fd)->file_op_table_ptr == &pipe_write_op_table) {
+        if (p->writers > 0) p->writers--;
+    }
+    else {
+        if (p->readers > 0) p->readers--;
+    }
+    scheduler_wake(p);
+    scheduler_poll_notify();
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* pipe_poll
+* DESCRIPTION: reports if a read or write on this end would go through without sleeping
+* INPUT: fd
+* OUTPUT: POLLIN for a read end with data, POLLOUT for a write end with room,
+*         POLLHUP once the other end is closed
+*/
+int32_t pipe_poll(int32_t fd) {
+    pipe_t* p = fd_pipe(fd);
+    if (fd_file(fd)->file_op_table_ptr == &pipe_write_op_table) {
+        if (p->readers == 0) return POLLHUP;
+        return (p->count < PIPE_BUF_SIZE) ? POLLOUT : 0;
+    }
+    if (p->writers == 0) return POLLIN | POLLHUP;
+    return (p->count > 0) ? POLLIN : 0;
+}
+
+int32_t pipe_unavail() {
+    return -1;
+}
@@ -0,0 +1,69 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "../types.h"
+#include "../vfs.h"
+
+#define PIPE_BUF_SIZE 4096
+#define MAX_PIPE 8
+
+typedef struct pipe {
+    uint8_t  buf[PIPE_BUF_SIZE]; // ring buffer
+    uint32_t head;    // index of the next byte to read
+    uint32_t count;   // number of bytes in the buffer
+    uint32_t readers; // number of open read ends
+    uint32_t writers; // number of open write ends
+} pipe_t;
+
+extern file_operations_t pipe_read_op_table;
+extern file_operations_t pipe_write_op_table;
+
+/*
+* pipe_alloc
+* DESCRIPTION: finds an unused pipe and gives it one reader and one writer
+* INPUT: none
+* OUTPUT: pipe id, -1 if all pipes are in use
+*/
+extern int32_t pipe_alloc();
+
+/*
+* pipe_open
+* DESCRIPTION: pipes can't be opened by name
+* OUTPUT: always -1
+*/
+extern int32_t pipe_open(int32_t fd, const uint8_t* filename);
+
+/*
+* pipe_read
+* DESCRIPTION: sleeps until the pipe has data or no writers are left, then copies out what is there
+* INPUT: buf to copy to, nbytes to copy
+* OUTPUT: number of bytes read, 0 if no writers are left and pipe is empty
+*/
+extern int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+
+/*
+* pipe_write
+* DESCRIPTION: copies buf into the pipe, sleeping whenever the pipe is full
+* INPUT: buf to copy from, nbytes to copy
+* OUTPUT: number of bytes written, -1 if there are no readers left
+*/
+extern int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+
+/*
+* pipe_close
+* DESCRIPTION: drops the reference held by this end, wakes the other end so it can see EOF
+* INPUT: fd
+* OUTPUT: 0 on success
+*/
+extern int32_t pipe_close(int32_t fd);
+
+/*
+* pipe_poll
+* DESCRIPTION: reports if a read or write on this end would go through without sleeping
+* INPUT: fd
+* OUTPUT: POLLIN for a read end with data, POLLOUT for a write end with room,
+*         POLLHUP once the other end is closed
+*/
+extern int32_t pipe_poll(int32_t fd);
+
+#endif
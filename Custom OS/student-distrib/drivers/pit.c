@@ -1,12 +1,16 @@
 #include "pit.h"
 #include "../lib.h"
 #include "../i8259.h"
+#include "../scheduler.h"
+#include "../signal.h"
 
 #define PIT_IRQ 0x00
 #define PIT_INIT_PORT 0x43
 #define PIT_DATA 0x40
 #define RELOAD_VALUE 11931
 #define PIT_INIT_WORD 0x34
+
+volatile uint32_t pit_ticks = 0;
 /*
 * enable_pit
 * DESCRIPTION: Programs the pit to get interrupts at approximately 10 ms
@@ -33,3 +37,16 @@ void enable_pit() {
                   :"r" (PIT_INIT_WORD), "r" (RELOAD_VALUE)
                   );
 }
+
+/*
+* pit_isr_handler
+* DESCRIPTION: counts the tick, then lets the scheduler run
+* INPUTS: none
+* OUTPUTS: none
+* SIDE EFFECTS: pit_ticks incremented, alarms counted down, may switch tasks
+*/
+void pit_isr_handler() {
+    pit_ticks++;
+    signal_tick(PIT_MS_PER_TICK);
+    scheduler_isr_handler();
+}
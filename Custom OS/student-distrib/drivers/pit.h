@@ -2,6 +2,11 @@
 #define PIT_H
 
 #include "../types.h"
+
+#define PIT_MS_PER_TICK 10
+
+// number of pit interrupts since boot
+extern volatile uint32_t pit_ticks;
 /*
 * enable_pit
 * DESCRIPTION: Programs the pit to get interrupts at approximately 10 ms
@@ -11,4 +16,13 @@
 */
 extern void enable_pit();
 
+/*
+* pit_isr_handler
+* DESCRIPTION: counts the tick, then lets the scheduler run
+* INPUTS: none
+* OUTPUTS: none
+* SIDE EFFECTS: pit_ticks incremented, may switch tasks
+*/
+extern void pit_isr_handler();
+
 #endif
@@ -2,6 +2,7 @@
 #include "../lib.h"
 #include "../i8259.h"
 #include "../tasks.h"
+#include "../scheduler.h"
 
 #define RTC_IRQ 0x08
 #define RTC_PORT 0x70
@@ -30,7 +31,7 @@
 static int8_t rtc_opened_virtual[7];
 static int8_t rtc_called_virtual[7];
 
-int32_t* rtc_op_table[4] = {(int32_t*)rtc_open, (int32_t*)rtc_read, (int32_t*)rtc_write, (int32_t*)rtc_close};
+file_operations_t rtc_op_table = {rtc_open, rtc_read, rtc_write, rtc_close, rtc_poll};
 
 /*
 enable_rtc
@@ -110,6 +111,7 @@ Source: osdev.org/RTC
 */
 void rtc_isr_handler() {
 	rtc_called = 1;
+	scheduler_poll_notify();
 	/* clear Reg C by reading*/
 	outb(0x0C, RTC_PORT);
 	inb(RTC_DATA);
@@ -185,6 +187,8 @@ int32_t rtc_close(int32_t fd){
 * SIDE EFFECTS: none
 */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
+	// don't wait for the interrupt if fd is non blocking
+	if (!rtc_called_virtual[current_task_id] && (fd_file(fd)->flags & FD_NONBLOCK)) return -1;
 	while(!rtc_called_virtual[current_task_id]);
 	rtc_called_virtual[current_task_id] = 0;
 	return 0;
@@ -202,3 +206,14 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
 	int32_t change_result = change_frequency(freqs[0]);
 	return change_result;
 }
+
+/*
+* rtc_poll
+* DESCRIPTION: Check if an RTC interrupt happened since the last read
+* INPUTS: fd
+* OUTPUTS: int32_t - POLLIN if a read would not block, always POLLOUT
+* SIDE EFFECTS: none
+*/
+int32_t rtc_poll(int32_t fd){
+	return ((rtc_called_virtual[current_task_id]) ? POLLIN : 0) | POLLOUT;
+}
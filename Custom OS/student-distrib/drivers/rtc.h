@@ -2,8 +2,9 @@
 #define RTC_H
 
 #include "../types.h"
+#include "../vfs.h"
 
-extern int32_t* rtc_op_table[4];
+extern file_operations_t rtc_op_table;
 
 void enable_rtc(uint32_t frequency);
 /*
@@ -52,4 +53,13 @@ extern int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 */
 extern int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes);
 
+/*
+* rtc_poll
+* DESCRIPTION: Check if an RTC interrupt happened since the last read
+* INPUTS: fd
+* OUTPUTS: int32_t - POLLIN if a read would not block, always POLLOUT
+* SIDE EFFECTS: none
+*/
+extern int32_t rtc_poll(int32_t fd);
+
 #endif
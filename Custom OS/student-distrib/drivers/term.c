@@ -8,17 +8,29 @@
 
 #define LINE_FEED 0xA
 #define SCREEN_PAGE_SIZE 4096
+#define SCREEN_SIZE (TERM_ROWS * TERM_ROW_SIZE)
+#define BLANK 0x0720    // space, grey on black
+// rows in the VGA text window, the live screen moves down the first LIVE_ROWS
+// and the scrollback being looked at is put together in the rows after
+#define VGA_ROWS ((V_MEM_END - V_MEM_BASE) / TERM_ROW_SIZE)
+#define LIVE_ROWS (VGA_ROWS - TERM_ROWS)
 
 int32_t term_unavail();
 
-int32_t* stdin_op_table[4] = {(int32_t*)term_open, (int32_t*)term_read, (int32_t*)term_unavail, (int32_t*)term_close};
-int32_t* stdout_op_table[4] = {(int32_t*)term_open, (int32_t*)term_unavail, (int32_t*)term_write, (int32_t*)term_close};
+file_operations_t stdin_op_table = {term_open, term_read, term_unavail, term_close, term_poll_in};
+file_operations_t stdout_op_table = {term_open, term_unavail, term_write, term_close, term_poll_out};
+// the terminal opened by name as /dev/tty, read and written through one fd
+file_operations_t tty_op_table = {term_open, term_read, term_write, term_close, term_poll};
 
-// backbuffer for each terminal
-const uint32_t term_buf_addr[3] = {V_MEM_TERM_1,V_MEM_TERM_2,V_MEM_TERM_3};
+// backbuffer for each terminal, page aligned so vidmap can map it
+static uint8_t term_buf[3][SCREEN_PAGE_SIZE] __attribute__((aligned (SCREEN_PAGE_SIZE)));
+// scrollback for each terminal, line n is in row n & (SCROLLBACK_ROWS - 1)
+static uint8_t term_hist[3][SCROLLBACK_ROWS * TERM_ROW_SIZE];
+// row of VGA memory the active terminal's screen starts at
+static uint32_t vga_start = 0;
 
 // 3 terminals initialize statically
-term_t  terms[3] = {{(char*)V_MEM_BASE, 0, 0, 0, {0}, 0, 0, 1},{(char*)V_MEM_TERM_2, 0, 0, 0, {0}, 0, 0, 0},{(char*)V_MEM_TERM_3, 0, 0, 0, {0}, 0, 0, 0}};
+term_t  terms[3] = {{(char*)V_MEM_BASE, 0, 0, {0}, 0, {{0}, 0, 0, 0}, 1},{(char*)term_buf[1], 0, 0, {0}, 0, {{0}, 0, 0, 0}, 0},{(char*)term_buf[2], 0, 0, {0}, 0, {{0}, 0, 0, 0}, 0}};
 // keep track of active terminal
 int32_t active_terminal_id = 0;
 // flag to force reading and writing of terminal variables to 1) active terminal 0) terminal for currently running task
@@ -26,14 +38,47 @@ int32_t rw_active_terminal = 0;
 // let tasking know to set correct terminal if a new terminal needs to be started, -1 means no, 0,1,2 means new terms on 0,1,2
 int32_t new_term_flag = -1;
 
+/*
+set_vga_start
+Description: sets the CRTC start address, the VGA row shown at the top of the display
+Input: row of VGA memory
+Output: none
+*/
+static void set_vga_start(uint32_t row) {
+    uint16_t start = row * TERM_COLS;
+    outb(0x0C, 0x3D4);          // start address high byte
+    outb(start >> 8, 0x3D5);
+    outb(0x0D, 0x3D4);          // start address low byte
+    outb(start & 0xFF, 0x3D5);
+}
+
+/*
+rows_differ
+Description: compares two rows in memory, a dword at a time
+Input: rows
+Output: 1 if they differ, 0 if the same
+*/
+static int32_t rows_differ(const uint8_t* a, const uint8_t* b) {
+    uint32_t i;
+    for (i = 0; i < TERM_ROW_SIZE / 4; i++) {
+        if (((const uint32_t*)a)[i] != ((const uint32_t*)b)[i]) return 1;
+    }
+    return 0;
+}
+
 /*
 change_term
-Description: changes terminal, remaps physical address for any vidmap
+Description: changes terminal, only rows that were written or differ are copied,
+remaps physical address for a terminal with a vidmap
 if shell is not running on that terminal, will start it up automatically
 Input: terminal to change to
 Output: none
 */
 void change_term(int next_term_id) {
+    term_t* prev;
+    term_t* next;
+    uint8_t* screen;
+    uint32_t r;
     if (next_term_id < 0 || next_term_id > 2) return;
     // do nothing if this is active terminal
     if (active_terminal_id == next_term_id) return;
@@ -43,19 +88,43 @@ void change_term(int next_term_id) {
         return;
     }
 
-    // set address of terminal leaving to backbuffer
-    terms[active_terminal_id]._mem_addr = (char*) term_buf_addr[active_terminal_id];
-    // set address for terminal changing into as V_MEM
-    terms[next_term_id]._mem_addr = (char*)V_MEM_BASE;
+    prev = &terms[active_terminal_id];
+    next = &terms[next_term_id];
+    screen = (uint8_t*)prev->_mem_addr;
+    // writes through a vidmap don't mark rows
+    if (prev->_vidmap_task) prev->_dirty = TERM_ALL_ROWS;
+    // copy rows written since the leaving terminal came in to its backbuffer
+    for (r = 0; r < TERM_ROWS; r++) {
+        if (prev->_dirty & (1 << r)) memcpy(term_buf[active_terminal_id] + r * TERM_ROW_SIZE, screen + r * TERM_ROW_SIZE, TERM_ROW_SIZE);
+    }
+    // a vidmap of the next terminal needs its screen at the top of vmem
+    if (next->_vidmap_task && vga_start) {
+        vga_start = 0;
+        screen = (uint8_t*)V_MEM_BASE;
+        memcpy(screen, term_buf[next_term_id], SCREEN_SIZE);
+    }
+    // vmem matches the leaving backbuffer, only write the rows the next one has different
+    else {
+        for (r = 0; r < TERM_ROWS; r++) {
+            if (rows_differ(term_buf[next_term_id] + r * TERM_ROW_SIZE, term_buf[active_terminal_id] + r * TERM_ROW_SIZE)) {
+                memcpy(screen + r * TERM_ROW_SIZE, term_buf[next_term_id] + r * TERM_ROW_SIZE, TERM_ROW_SIZE);
+            }
+        }
+    }
+    // a scrollback being looked at is left
+    set_vga_start(vga_start);
 
-    // copy V_MEM to backbuffer
-    memcpy((char*)term_buf_addr[active_terminal_id], (char*)V_MEM_BASE, SCREEN_PAGE_SIZE);
-    // copy next backbuffer to vmem
-    memcpy((char*)V_MEM_BASE, (char*)term_buf_addr[next_term_id], SCREEN_PAGE_SIZE);
+    // set address of terminal leaving to backbuffer
+    prev->_mem_addr = (char*)term_buf[active_terminal_id];
+    prev->_view = 0;
+    // set address for terminal changing into as V_MEM, where the leaving screen was
+    next->_mem_addr = (char*)screen;
+    next->_view = 0;
+    next->_dirty = 0;
 
-    // remap vidmap, 0x0840000+V_MEM_BASE is the virtual address for vidmap pages
-    remap_terminal_vidmap(active_terminal_id, term_buf_addr[active_terminal_id], 0x08400000+V_MEM_BASE);
-    remap_terminal_vidmap(next_term_id, V_MEM_BASE, 0x08400000+V_MEM_BASE);
+    // remap vidmap for terminals that have one, 0x0840000+V_MEM_BASE is the virtual address for vidmap pages
+    if (prev->_vidmap_task) remap_terminal_vidmap(active_terminal_id, (uint32_t)term_buf[active_terminal_id], 0x08400000+V_MEM_BASE);
+    if (next->_vidmap_task) remap_terminal_vidmap(next_term_id, V_MEM_BASE, 0x08400000+V_MEM_BASE);
 
     // set next as active terminal
     active_terminal_id = next_term_id;
@@ -75,75 +144,219 @@ void change_term(int next_term_id) {
         scheduler_add_shell();
     }
 }
+
+/*
+term_scroll
+Description: scrolls a terminal's screen up, the rows going off the top are kept
+in its scrollback, the active terminal moves the VGA start address instead of
+copying rows, except when it reaches the end of VGA memory or a vidmap needs
+its screen to stay at the top
+Input: terminal, number of lines
+Output: none
+*/
+void term_scroll(term_t* t, uint32_t n) {
+    uint8_t* hist = term_hist[t - terms];
+    uint8_t* screen = (uint8_t*)t->_mem_addr;
+    uint32_t i, kept;
+    if (n == 0) return;
+    // past a whole screen the lines start out blank, the caller writes them into the scrollback
+    for (i = (n > SCROLLBACK_ROWS) ? n - SCROLLBACK_ROWS : 0; i < n; i++) {
+        if (i < TERM_ROWS) memcpy(hist + ((t->_hist_top + i) & (SCROLLBACK_ROWS - 1)) * TERM_ROW_SIZE, screen + i * TERM_ROW_SIZE, TERM_ROW_SIZE);
+        else memset_word(hist + ((t->_hist_top + i) & (SCROLLBACK_ROWS - 1)) * TERM_ROW_SIZE, BLANK, TERM_COLS);
+    }
+    t->_hist_top += n;
+    t->_dirty = TERM_ALL_ROWS;
+    kept = (n < TERM_ROWS) ? TERM_ROWS - n : 0;
+    if (t == &terms[active_terminal_id]) {
+        // the rows scrolled off stay where they are, the display starts further down
+        if (!t->_vidmap_task && vga_start + n + TERM_ROWS <= LIVE_ROWS) vga_start += n;
+        // out of VGA memory or mapped by vidmap, copy what is left on screen back to the top
+        else {
+            memmove((uint8_t*)V_MEM_BASE, screen + (TERM_ROWS - kept) * TERM_ROW_SIZE, kept * TERM_ROW_SIZE);
+            vga_start = 0;
+        }
+        t->_mem_addr = (char*)(V_MEM_BASE + vga_start * TERM_ROW_SIZE);
+        if (t->_view == 0) set_vga_start(vga_start);
+    }
+    else {
+        memmove(screen, screen + (TERM_ROWS - kept) * TERM_ROW_SIZE, kept * TERM_ROW_SIZE);
+    }
+    memset_word(t->_mem_addr + kept * TERM_ROW_SIZE, BLANK, (TERM_ROWS - kept) * TERM_COLS);
+}
+
+/*
+term_row
+Description: finds a row of a terminal, rows above the screen are in the scrollback
+Input: terminal, row, -1 is the last line to go off the top
+Output: the row, 0 if it is older than the scrollback
+*/
+uint8_t* term_row(term_t* t, int32_t y) {
+    if (y >= 0) return (uint8_t*)t->_mem_addr + y * TERM_ROW_SIZE;
+    if (y < -SCROLLBACK_ROWS) return 0;
+    return term_hist[t - terms] + ((t->_hist_top + y) & (SCROLLBACK_ROWS - 1)) * TERM_ROW_SIZE;
+}
+
+/*
+term_scrollback
+Description: moves the active terminal's view through its scrollback, output
+keeps going to the live screen while it is scrolled back
+Input: lines to go back, negative to go forward
+Output: none
+*/
+void term_scrollback(int32_t rows) {
+    term_t* t = &terms[active_terminal_id];
+    int32_t lines = (t->_hist_top < SCROLLBACK_ROWS) ? t->_hist_top : SCROLLBACK_ROWS;
+    int32_t view = t->_view + rows;
+    int32_t i;
+    if (view < 0) view = 0;
+    if (view > lines) view = lines;
+    if (view == 0 && t->_view == 0) return;
+    t->_view = view;
+    if (view == 0) {
+        set_vga_start(vga_start);
+        return;
+    }
+    // put the lines together below the live screen, the cursor is left up there out of sight
+    for (i = 0; i < TERM_ROWS; i++) {
+        memcpy((uint8_t*)V_MEM_BASE + (LIVE_ROWS + i) * TERM_ROW_SIZE, term_row(t, i - view), TERM_ROW_SIZE);
+    }
+    set_vga_start(LIVE_ROWS);
+}
+
+/*
+term_vidmap_page
+Description: finds the page a terminal's screen is in for vidmap, the active
+terminal's screen is moved back to the top of VGA memory to start on the page,
+the current task is kept as the one with the terminal mapped
+Input: terminal
+Output: physical address of the page
+*/
+uint32_t term_vidmap_page(int32_t terminal_id) {
+    uint32_t flags;
+    cli_and_save(flags);
+    terms[terminal_id]._vidmap_task = current_task_id;
+    if (terminal_id != active_terminal_id) {
+        restore_flags(flags);
+        return (uint32_t)term_buf[terminal_id];
+    }
+    if (vga_start) {
+        memmove((char*)V_MEM_BASE, terms[terminal_id]._mem_addr, SCREEN_SIZE);
+        vga_start = 0;
+        terms[terminal_id]._mem_addr = (char*)V_MEM_BASE;
+        if (terms[terminal_id]._view == 0) set_vga_start(0);
+        rw_active_terminal = 1;
+        move_cursor();
+        rw_active_terminal = 0;
+    }
+    restore_flags(flags);
+    return V_MEM_BASE;
+}
+
 /*
 * term_open
-* DESCRIPTION: clears kb buffer and enables kb
+* DESCRIPTION: nothing to set up, lines typed ahead are kept for the program
 * INPUT: None
 * OUTPUT: 0 on success
 */
-int32_t term_open(int32_t fd, uint8_t* filename) {
-    // clear buffer on open
-    memset(kb_buf, 0 ,KB_BUF_SIZE);
-    kb_buf_index = 0;
-    kb_buf_ready = 0;
-    kb_enabled = 0;
+int32_t term_open(int32_t fd, const uint8_t* filename) {
     return 0;
 }
 
 /*
 * term_read
-* DESCRIPTION: once enter is pressed, copy nbytes of kb_buf into buf
+* DESCRIPTION: sleeps until a line has been typed, then copies it into buf, up to
+*              nbytes, what doesn't fit is left for the next read
 * INPUT: buf to copy to , nbytes to copy
-* OUTPUT: 0 on success
+* OUTPUT: number of bytes read, -1 if non blocking and no line is ready
 */
 int32_t term_read(int32_t fd, void* buf, int32_t nbytes) {
-    int i;
-    // wipe buf
-    memset(buf, 0, nbytes);
-    kb_enabled = 1;
-    // spin while waiting for buffer to be ready
-    while(!kb_buf_ready);
-    // buffer ready, disable writing to buffer
-    kb_enabled = 0;
-    for (i = 0; i < nbytes && i < kb_buf_index; i++) {
-        ((uint8_t*)buf)[i] = kb_buf[i];
-    }
-    // append line feed character
-    if (i < nbytes) {
-        ((uint8_t*)buf)[i] = LINE_FEED;
-    }
-    // clear buffer
-    memset(kb_buf,0,KB_BUF_SIZE);
-    kb_buf_index = 0;
-    kb_buf_ready = 0;
-    return i+1;
+    kb_ring_t* r = &kb_ring;
+    uint32_t flags, head;
+    int32_t i = 0;
+    if (nbytes <= 0) return 0;
+    // check and sleep with interrupts off so a wake up from the keyboard can't be missed
+    cli_and_save(flags);
+    if (r->head == r->tail && (fd_file(fd)->flags & FD_NONBLOCK)) {
+        restore_flags(flags);
+        return -1;
+    }
+    while (r->head == r->tail) {
+        scheduler_sleep(r);
+    }
+    restore_flags(flags);
+    // only whole lines go in, so there is a line feed before tail
+    head = r->head;
+    while (i < nbytes && head != r->tail) {
+        ((uint8_t*)buf)[i] = r->buf[head++ & (KB_RING_SIZE - 1)];
+        if (((uint8_t*)buf)[i++] == LINE_FEED) break;
+    }
+    // the bytes are copied out before the keyboard is let reuse them
+    asm volatile ("" : : : "memory");
+    r->head = head;
+    return i;
 }
 
 /*
 * term_write
-* DESCRIPTION: print nbytes from buf to display
+* DESCRIPTION: print nbytes from buf to display, all in one go
 * INPUT: buf to print, nbytes to print
 * OUTPUT: 0 on success
 */
 int32_t term_write(int32_t fd, const void* buf, int32_t nbytes) {
-    int i;
-    for(i = 0; i < nbytes; i++) {
-        putc(((int8_t*)buf)[i]);
-    }
+    if (nbytes > 0) putbuf((const uint8_t*)buf, nbytes);
     return 0;
 }
 
 /*
 * term_close
-* DESCRIPTION: disables kb
-* INPUT: none
+* DESCRIPTION: nothing to undo, typing is kept for the next reader
+* INPUT: fd
 * OUTPUT: 0 on success
 */
-int32_t term_close() {
-    kb_enabled = 0;
+int32_t term_close(int32_t fd) {
     return 0;
 }
 
+/*
+* term_poll_in
+* DESCRIPTION: reports if a line is ready
+* INPUT: fd
+* OUTPUT: POLLIN if enter has been pressed
+*/
+int32_t term_poll_in(int32_t fd) {
+    return (kb_ring.head != kb_ring.tail) ? POLLIN : 0;
+}
+
+/*
+* term_poll_out
+* DESCRIPTION: display is always writable
+* INPUT: fd
+* OUTPUT: always POLLOUT
+*/
+int32_t term_poll_out(int32_t fd) {
+    return POLLOUT;
+}
+
+/*
+* term_poll
+* DESCRIPTION: readiness of /dev/tty, which is read and written
+* INPUT: fd
+* OUTPUT: POLLIN if a line is ready, always POLLOUT
+*/
+int32_t term_poll(int32_t fd) {
+    return term_poll_in(fd) | POLLOUT;
+}
+
+/*
+* term_is_tty
+* DESCRIPTION: checks if operations are one of the terminal's
+* INPUT: operations of an open file
+* OUTPUT: 1 if terminal, 0 if not
+*/
+int32_t term_is_tty(file_operations_t* fops) {
+    return fops == &stdin_op_table || fops == &stdout_op_table || fops == &tty_op_table;
+}
+
 int32_t term_unavail() {
     return -1;
 }
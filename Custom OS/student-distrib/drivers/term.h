@@ -2,25 +2,51 @@
 #define TERM_H
 
 #include "../types.h"
+#include "../vfs.h"
 
-extern int32_t* stdin_op_table[4];
-extern int32_t* stdout_op_table[4];
+extern file_operations_t stdin_op_table;
+extern file_operations_t stdout_op_table;
+extern file_operations_t tty_op_table;
 
 extern int32_t new_term_flag;
 
+#define TERM_COLS 80
+#define TERM_ROWS 25
+#define TERM_ROW_SIZE (TERM_COLS * 2)   // bytes in a row, character and attribute
+#define SCROLLBACK_ROWS 256             // lines of history kept per terminal, power of 2
+#define TERM_ALL_ROWS ((1 << TERM_ROWS) - 1)
+#define KB_RING_SIZE 1024               // bytes of typed lines waiting to be read, power of 2
+
+/* lines typed on a terminal, the keyboard handler is the only one that moves
+ * tail and term_read the only one that moves head, so neither locks, index
+ * with & (KB_RING_SIZE - 1) */
+typedef struct kb_ring {
+    uint8_t buf[KB_RING_SIZE];
+    volatile uint32_t head; // next byte to read
+    volatile uint32_t tail; // next byte to put in
+    uint32_t overruns;      // lines dropped because the ring was full
+} __attribute__((packed)) kb_ring_t;
+
 typedef struct term {
     // display info
     char* _mem_addr;
     int32_t _screen_x;
     int32_t _screen_y;
     // keyboard info
-    uint8_t _kb_enabled;
-    uint8_t _kb_buf[128];
+    uint8_t _kb_buf[128];   // line being typed
     uint8_t _kb_buf_index;
-    uint8_t _kb_buf_ready;
+    kb_ring_t _kb_ring;     // lines typed, waiting to be read
 
     // keep track of if terminal is started
     int32_t _started;
+
+    // scrollback info
+    uint32_t _hist_top; // lines that have gone off the top of the screen
+    uint32_t _view;     // lines scrolled back, 0 when the live screen is shown
+
+    // switching info
+    uint32_t _dirty;        // bit for each row written since the screen matched the backbuffer
+    int32_t _vidmap_task;   // task that has the screen mapped with vidmap, 0 if none
 } __attribute__((packed)) term_t;
 
 extern term_t terms[3];
@@ -33,38 +59,77 @@ int32_t rw_active_terminal;
 #define video_mem       (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._mem_addr)
 #define screen_x        (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._screen_x)
 #define screen_y        (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._screen_y)
-#define kb_enabled      (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._kb_enabled)
+#define screen_dirty    (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._dirty)
 #define kb_buf          (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._kb_buf)
 #define kb_buf_index    (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._kb_buf_index)
-#define kb_buf_ready    (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._kb_buf_ready)
+#define kb_ring         (terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id]._kb_ring)
 
 /*
 change_term
-Description: changes terminal, remaps physical address for any vidmap
+Description: changes terminal, only rows that were written or differ are copied,
+remaps physical address for a terminal with a vidmap
 if shell is not running on that terminal, will start it up automatically
 Input: terminal to change to
 Output: none
 */
 extern void change_term(int n);
+/*
+term_scroll
+Description: scrolls a terminal's screen up, the rows going off the top are kept
+in its scrollback, the active terminal moves the VGA start address instead of
+copying rows, except when it reaches the end of VGA memory
+Input: terminal, number of lines
+Output: none
+*/
+extern void term_scroll(term_t* t, uint32_t n);
+
+/*
+term_row
+Description: finds a row of a terminal, rows above the screen are in the scrollback
+Input: terminal, row, -1 is the last line to go off the top
+Output: the row, 0 if it is older than the scrollback
+*/
+extern uint8_t* term_row(term_t* t, int32_t y);
+
+/*
+term_scrollback
+Description: moves the active terminal's view through its scrollback, output
+keeps going to the live screen while it is scrolled back
+Input: lines to go back, negative to go forward
+Output: none
+*/
+extern void term_scrollback(int32_t rows);
+
+/*
+term_vidmap_page
+Description: finds the page a terminal's screen is in for vidmap, the active
+terminal's screen is moved back to the top of VGA memory to start on the page,
+the current task is kept as the one with the terminal mapped
+Input: terminal
+Output: physical address of the page
+*/
+extern uint32_t term_vidmap_page(int32_t terminal_id);
+
 /*
 * term_open
-* DESCRIPTION: clears kb buffer and enables kb
+* DESCRIPTION: nothing to set up, lines typed ahead are kept for the program
 * INPUT: None
 * OUTPUT: 0 on success
 */
-extern int32_t term_open(int32_t fd, uint8_t* filename);
+extern int32_t term_open(int32_t fd, const uint8_t* filename);
 
 /*
 * term_read
-* DESCRIPTION: once enter is pressed, copy nbytes of kb_buf into buf
+* DESCRIPTION: sleeps until a line has been typed, then copies it into buf, up to
+*              nbytes, what doesn't fit is left for the next read
 * INPUT: buf to copy to , nbytes to copy
-* OUTPUT: 0 on success
+* OUTPUT: number of bytes read, -1 if non blocking and no line is ready
 */
 extern int32_t term_read(int32_t fd, void* buf, int32_t nbytes);
 
 /*
 * term_write
-* DESCRIPTION: print nbytes from buf to display
+* DESCRIPTION: print nbytes from buf to display, all in one go
 * INPUT: buf to print, nbytes to print
 * OUTPUT: 0 on success
 */
@@ -72,10 +137,42 @@ extern int32_t term_write(int32_t fd, const void* buf, int32_t nbytes);
 
 /*
 * term_close
-* DESCRIPTION: disables kb
-* INPUT: none
+* DESCRIPTION: nothing to undo, typing is kept for the next reader
+* INPUT: fd
 * OUTPUT: 0 on success
 */
-extern int32_t term_close();
+extern int32_t term_close(int32_t fd);
+
+/*
+* term_poll_in
+* DESCRIPTION: reports if a line is ready
+* INPUT: fd
+* OUTPUT: POLLIN if enter has been pressed
+*/
+extern int32_t term_poll_in(int32_t fd);
+
+/*
+* term_poll_out
+* DESCRIPTION: display is always writable
+* INPUT: fd
+* OUTPUT: always POLLOUT
+*/
+extern int32_t term_poll_out(int32_t fd);
+
+/*
+* term_poll
+* DESCRIPTION: readiness of /dev/tty, which is read and written
+* INPUT: fd
+* OUTPUT: POLLIN if a line is ready, always POLLOUT
+*/
+extern int32_t term_poll(int32_t fd);
+
+/*
+* term_is_tty
+* DESCRIPTION: checks if operations are one of the terminal's
+* INPUT: operations of an open file
+* OUTPUT: 1 if terminal, 0 if not
+*/
+extern int32_t term_is_tty(file_operations_t* fops);
 
 #endif
@@ -0,0 +1,362 @@
+#include "tmpfs.h"
+
+#include "../lib.h"
+#include "../tasks.h"
+#include "../paging.h"
+
+file_operations_t tmpfs_op_table = {tmpfs_open, tmpfs_read, tmpfs_write, tmpfs_close, tmpfs_poll, tmpfs_truncate, tmpfs_unlink, 0, tmpfs_getdents, tmpfs_stat, tmpfs_fstat};
+
+static tmpfs_file_t files[TMPFS_MAX_FILES];
+
+// inode 0 is the directory, files are numbered from 1
+#define fd_tmpfs(fd) (&files[fd_file(fd)->inode - 1])
+
+/*
+* find_file
+* DESCRIPTION: looks up a file by name
+* INPUT: name
+* OUTPUT: index of the file, -1 if there is none
+*/
+static int32_t find_file(const uint8_t* name) {
+    int32_t i;
+    for (i = 0; i < TMPFS_MAX_FILES; i++) {
+        if (files[i].linked && strncmp((int8_t*)files[i].name, (int8_t*)name, TMPFS_NAME_LENGTH) == 0) return i;
+    }
+    return -1;
+}
+
+/*
+* file_page
+* DESCRIPTION: finds the frame holding a page of a file
+* INPUT: file, page number in the file, 1 to allocate the page and the maps leading to it
+* OUTPUT: physical address of the frame, 0 if the page has none or memory ran out
+*/
+static uint32_t file_page(tmpfs_file_t* f, uint32_t page, int32_t alloc) {
+    uint32_t* dir;
+    uint32_t* table;
+    if (!f->map && (!alloc || 0 == (f->map = alloc_frame()))) return 0;
+    dir = (uint32_t*)f->map;
+    if (!dir[page / TMPFS_MAP_ENTRIES] && (!alloc || 0 == (dir[page / TMPFS_MAP_ENTRIES] = alloc_frame()))) return 0;
+    table = (uint32_t*)dir[page / TMPFS_MAP_ENTRIES];
+    if (!table[page % TMPFS_MAP_ENTRIES] && alloc) table[page % TMPFS_MAP_ENTRIES] = alloc_frame();
+    return table[page % TMPFS_MAP_ENTRIES];
+}
+
+/*
+* free_pages
+* DESCRIPTION: gives back the frames of every page from first on, and the maps left empty
+* INPUT: file, first page to free
+* OUTPUT: none
+*/
+static void free_pages(tmpfs_file_t* f, uint32_t first) {
+    uint32_t i, j, start;
+    uint32_t* dir = (uint32_t*)f->map;
+    uint32_t* table;
+    if (!dir) return;
+    for (i = first / TMPFS_MAP_ENTRIES; i < TMPFS_MAP_ENTRIES; i++) {
+        if (!dir[i]) continue;
+        table = (uint32_t*)dir[i];
+        start = (i == first / TMPFS_MAP_ENTRIES) ? first % TMPFS_MAP_ENTRIES : 0;
+        for (j = start; j < TMPFS_MAP_ENTRIES; j++) {
+            if (table[j]) put_frame(table[j]);
+            table[j] = 0;
+        }
+        if (start == 0) {
+            put_frame(dir[i]);
+            dir[i] = 0;
+        }
+    }
+    if (first == 0) {
+        put_frame(f->map);
+        f->map = 0;
+    }
+}
+
+/*
+* set_length
+* DESCRIPTION: shrinks or grows a file, bytes past the end are kept zero so growing reads as 0
+* INPUT: file, new length
+* OUTPUT: none
+*/
+static void set_length(tmpfs_file_t* f, uint32_t length) {
+    uint32_t page;
+    // also when equal, a write that ran out of frames can leave maps with no data
+    if (length <= f->length) {
+        // clear the rest of the page the file now ends in
+        if ((length % PAGE_SIZE_4K) && (page = file_page(f, length / PAGE_SIZE_4K, 0))) {
+            memset((void*)(page + length % PAGE_SIZE_4K), 0, PAGE_SIZE_4K - length % PAGE_SIZE_4K);
+        }
+        free_pages(f, (length + PAGE_SIZE_4K - 1) / PAGE_SIZE_4K);
+    }
+    f->length = length;
+}
+
+/*
+* tmpfs_open
+* DESCRIPTION: opens a file by name, "" opens the directory, with FD_CREATE a missing
+*              file is made, FD_TRUNC empties the file
+* INPUT: fd, name inside the mount
+* OUTPUT: 0 on success, -1 on fail
+*/
+int32_t tmpfs_open(int32_t fd, const uint8_t* filename) {
+    file_desc_t* file = fd_file(fd);
+    int32_t i;
+    uint32_t flags;
+    file->file_position = 0;
+    file->inode = 0;
+    if (filename[0] == '\0') return 0;
+    // flat directory, names can't have a / in them
+    for (i = 0; filename[i]; i++) {
+        if (filename[i] == '/' || i == TMPFS_NAME_LENGTH) return -1;
+    }
+    cli_and_save(flags);
+    i = find_file(filename);
+    if (i == -1) {
+        if (!(file->flags & FD_CREATE)) goto FAIL;
+        // a slot is free once its file has no name and nothing has it open
+        for (i = 0; i < TMPFS_MAX_FILES && (files[i].linked || files[i].opens); i++);
+        if (i == TMPFS_MAX_FILES) goto FAIL;
+        memset(files[i].name, 0, TMPFS_NAME_LENGTH);
+        strncpy((int8_t*)files[i].name, (int8_t*)filename, TMPFS_NAME_LENGTH);
+        files[i].length = 0;
+        files[i].linked = 1;
+    }
+    if (file->flags & FD_TRUNC) set_length(&files[i], 0);
+    files[i].opens++;
+    file->inode = i + 1;
+    restore_flags(flags);
+    return 0;
+    FAIL:
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+* tmpfs_read
+* DESCRIPTION: copies out file data from the position, or the next name for the directory
+* INPUT: fd, buf to copy to, nbytes to copy
+* OUTPUT: number of bytes read, 0 at the end of the file
+*/
+int32_t tmpfs_read(int32_t fd, void* buf, int32_t nbytes) {
+    file_desc_t* file = fd_file(fd);
+    tmpfs_file_t* f;
+    uint32_t flags, pos, off, n, page, done = 0;
+    int32_t i;
+    if (nbytes <= 0) return 0;
+    cli_and_save(flags);
+    // directory gives one name per read, the position is the next slot to look at
+    if (file->inode == 0) {
+        for (i = file->file_position; i < TMPFS_MAX_FILES && !files[i].linked; i++);
+        if (i < TMPFS_MAX_FILES) {
+            memset(buf, 0, nbytes);
+            for (done = 0; done < TMPFS_NAME_LENGTH && done < (uint32_t)nbytes && files[i].name[done]; done++) {
+                ((uint8_t*)buf)[done] = files[i].name[done];
+            }
+            file->file_position = i + 1;
+        }
+        restore_flags(flags);
+        return done;
+    }
+    f = fd_tmpfs(fd);
+    pos = file->file_position;
+    while (done < (uint32_t)nbytes && pos < f->length) {
+        // up to the end of this page at a time
+        off = pos % PAGE_SIZE_4K;
+        n = PAGE_SIZE_4K - off;
+        if (n > f->length - pos) n = f->length - pos;
+        if (n > (uint32_t)nbytes - done) n = nbytes - done;
+        if ((page = file_page(f, pos / PAGE_SIZE_4K, 0))) {
+            memcpy((uint8_t*)buf + done, (void*)(page + off), n);
+        } else {
+            memset((uint8_t*)buf + done, 0, n);
+        }
+        done += n;
+        pos += n;
+    }
+    file->file_position = pos;
+    restore_flags(flags);
+    return done;
+}
+
+/*
+* tmpfs_write
+* DESCRIPTION: copies buf into the file at the position, pages are allocated as they are written
+* INPUT: fd, buf to copy from, nbytes to copy
+* OUTPUT: number of bytes written, -1 if nothing could be written
+*/
+int32_t tmpfs_write(int32_t fd, const void* buf, int32_t nbytes) {
+    file_desc_t* file = fd_file(fd);
+    tmpfs_file_t* f;
+    uint32_t flags, pos, off, n, page, done = 0;
+    if (file->inode == 0) return -1;
+    if (nbytes <= 0) return 0;
+    cli_and_save(flags);
+    f = fd_tmpfs(fd);
+    pos = file->file_position;
+    while (done < (uint32_t)nbytes && pos < TMPFS_MAX_LENGTH) {
+        off = pos % PAGE_SIZE_4K;
+        n = PAGE_SIZE_4K - off;
+        if (n > (uint32_t)nbytes - done) n = nbytes - done;
+        // out of frames, keep what was written so far
+        if (0 == (page = file_page(f, pos / PAGE_SIZE_4K, 1))) break;
+        memcpy((void*)(page + off), (const uint8_t*)buf + done, n);
+        done += n;
+        pos += n;
+    }
+    file->file_position = pos;
+    if (pos > f->length) f->length = pos;
+    restore_flags(flags);
+    return (done) ? (int32_t)done : -1;
+}
+
+/*
+* tmpfs_close
+* DESCRIPTION: drops the open of the file, an unlinked file is freed once nothing has it open
+* INPUT: fd
+* OUTPUT: 0
+*/
+int32_t tmpfs_close(int32_t fd) {
+    tmpfs_file_t* f;
+    uint32_t flags;
+    if (fd_file(fd)->inode == 0) return 0;
+    cli_and_save(flags);
+    f = fd_tmpfs(fd);
+    f->opens--;
+    if (!f->linked && f->opens == 0) set_length(f, 0);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* tmpfs_poll
+* DESCRIPTION: files in memory never block
+* OUTPUT: always POLLIN and POLLOUT
+*/
+int32_t tmpfs_poll(int32_t fd) {
+    return POLLIN | POLLOUT;
+}
+
+/*
+* tmpfs_truncate
+* DESCRIPTION: sets the length of a file, frames past the new end are freed
+* INPUT: fd, new length
+* OUTPUT: 0 on success, -1 on fail
+*/
+int32_t tmpfs_truncate(int32_t fd, uint32_t length) {
+    uint32_t flags;
+    if (fd_file(fd)->inode == 0 || length > TMPFS_MAX_LENGTH) return -1;
+    cli_and_save(flags);
+    set_length(fd_tmpfs(fd), length);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* tmpfs_unlink
+* DESCRIPTION: removes the name of a file, its data stays until nothing has it open
+* INPUT: name inside the mount
+* OUTPUT: 0 on success, -1 if there is no such file
+*/
+int32_t tmpfs_unlink(const uint8_t* filename) {
+    int32_t i;
+    uint32_t flags;
+    cli_and_save(flags);
+    if (-1 == (i = find_file(filename))) {
+        restore_flags(flags);
+        return -1;
+    }
+    files[i].linked = 0;
+    if (files[i].opens == 0) set_length(&files[i], 0);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* tmpfs_getdents
+* DESCRIPTION: fills buf with as many files of the directory as fit
+* INPUT: fd of the directory, buffer, size of buffer
+* OUTPUT: bytes filled, 0 at the end, -1 if fd isn't the directory or no entry fits
+*/
+int32_t tmpfs_getdents(int32_t fd, void* buf, int32_t nbytes) {
+    file_desc_t* file = fd_file(fd);
+    dirent_t* ent;
+    uint32_t i, flags;
+    int32_t filled = 0;
+    if (file->inode != 0) return -1;
+    cli_and_save(flags);
+    for (i = file->file_position; i < TMPFS_MAX_FILES; i++) {
+        if (!files[i].linked) continue;
+        if (nbytes - filled < (int32_t)sizeof(dirent_t)) break;
+        ent = (dirent_t*)((uint8_t*)buf + filled);
+        memcpy(ent->name, files[i].name, DIRENT_NAME_LENGTH);
+        ent->type = DIRENT_FILE;
+        ent->inode = i + 1;
+        ent->size = files[i].length;
+        filled += sizeof(dirent_t);
+    }
+    file->file_position = i;
+    restore_flags(flags);
+    if (filled == 0 && i < TMPFS_MAX_FILES) return -1;
+    return filled;
+}
+
+/*
+* tmpfs_fill_stat
+* DESCRIPTION: fills in a stat for a file, or the directory
+* INPUT: index of file, -1 for the directory, stat to fill in
+* OUTPUT: none
+*/
+static void tmpfs_fill_stat(int32_t i, stat_t* st) {
+    uint32_t j, k;
+    uint32_t* dir;
+    memset(st, 0, sizeof(stat_t));
+    if (i == -1) {
+        st->type = DIRENT_DIR;
+        return;
+    }
+    st->type = DIRENT_FILE;
+    st->inode = i + 1;
+    st->size = files[i].length;
+    // holes have no frame, so count the pages that do
+    if (0 == (dir = (uint32_t*)files[i].map)) return;
+    for (j = 0; j < TMPFS_MAP_ENTRIES; j++) {
+        if (!dir[j]) continue;
+        for (k = 0; k < TMPFS_MAP_ENTRIES; k++) {
+            if (((uint32_t*)dir[j])[k]) st->blocks++;
+        }
+    }
+}
+
+/*
+* tmpfs_stat
+* DESCRIPTION: looks up a file without opening it, "" is the directory
+* INPUT: name inside the mount, stat to fill in
+* OUTPUT: 0 on success, -1 if there is no such file
+*/
+int32_t tmpfs_stat(const uint8_t* filename, stat_t* st) {
+    int32_t i = -1;
+    uint32_t flags;
+    cli_and_save(flags);
+    if (filename[0] != '\0' && -1 == (i = find_file(filename))) {
+        restore_flags(flags);
+        return -1;
+    }
+    tmpfs_fill_stat(i, st);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* tmpfs_fstat
+* DESCRIPTION: fills in a stat for an open file or the directory, blocks counts
+*              only pages that have a frame
+* INPUT: fd, stat to fill in
+* OUTPUT: always 0
+*/
+int32_t tmpfs_fstat(int32_t fd, stat_t* st) {
+    uint32_t flags;
+    cli_and_save(flags);
+    tmpfs_fill_stat((int32_t)fd_file(fd)->inode - 1, st);
+    restore_flags(flags);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "../types.h"
+#include "../vfs.h"
+
+#define TMPFS_MAX_FILES 32
+#define TMPFS_NAME_LENGTH 32
+#define TMPFS_MAP_ENTRIES 1024 // frame addresses held by one map frame
+// two map levels of 1024 pages each, the last page is left out so lengths fit in 32 bits
+#define TMPFS_MAX_LENGTH 0xFFFFF000
+
+/* a file in memory, its data is in pool frames found through a two level map
+ * like a page directory, pages that were never written have no frame and read as 0 */
+typedef struct tmpfs_file {
+    uint8_t  name[TMPFS_NAME_LENGTH];
+    uint32_t length;
+    uint32_t map;    // frame of map frames, 0 if the file has no data
+    uint32_t opens;  // open files pointing at this
+    uint32_t linked; // 1 while the file has a name
+} tmpfs_file_t;
+
+extern file_operations_t tmpfs_op_table;
+
+/*
+* tmpfs_open
+* DESCRIPTION: opens a file by name, "" opens the directory, with FD_CREATE a missing
+*              file is made, FD_TRUNC empties the file
+* INPUT: fd, name inside the mount
+* OUTPUT: 0 on success, -1 on fail
+*/
+extern int32_t tmpfs_open(int32_t fd, const uint8_t* filename);
+
+/*
+* tmpfs_read
+* DESCRIPTION: copies out file data from the position, or the next name for the directory
+* INPUT: fd, buf to copy to, nbytes to copy
+* OUTPUT: number of bytes read, 0 at the end of the file
+*/
+extern int32_t tmpfs_read(int32_t fd, void* buf, int32_t nbytes);
+
+/*
+* tmpfs_write
+* DESCRIPTION: copies buf into the file at the position, pages are allocated as they are written
+* INPUT: fd, buf to copy from, nbytes to copy
+* OUTPUT: number of bytes written, -1 if nothing could be written
+*/
+extern int32_t tmpfs_write(int32_t fd, const void* buf, int32_t nbytes);
+
+/*
+* tmpfs_close
+* DESCRIPTION: drops the open of the file, an unlinked file is freed once nothing has it open
+* INPUT: fd
+* OUTPUT: 0
+*/
+extern int32_t tmpfs_close(int32_t fd);
+
+/*
+* tmpfs_poll
+* DESCRIPTION: files in memory never block
+* OUTPUT: always POLLIN and POLLOUT
+*/
+extern int32_t tmpfs_poll(int32_t fd);
+
+/*
+* tmpfs_truncate
+* DESCRIPTION: sets the length of a file, frames past the new end are freed
+* INPUT: fd, new length
+* OUTPUT: 0 on success, -1 on fail
+*/
+extern int32_t tmpfs_truncate(int32_t fd, uint32_t length);
+
+/*
+* tmpfs_unlink
+* DESCRIPTION: removes the name of a file, its data stays until nothing has it open
+* INPUT: name inside the mount
+* OUTPUT: 0 on success, -1 if there is no such file
+*/
+extern int32_t tmpfs_unlink(const uint8_t* filename);
+
+/*
+* tmpfs_getdents
+* DESCRIPTION: fills buf with as many files of the directory as fit
+* INPUT: fd of the directory, buffer, size of buffer
+* OUTPUT: bytes filled, 0 at the end, -1 if fd isn't the directory or no entry fits
+*/
+extern int32_t tmpfs_getdents(int32_t fd, void* buf, int32_t nbytes);
+
+/*
+* tmpfs_stat
+* DESCRIPTION: looks up a file without opening it, "" is the directory
+* INPUT: name inside the mount, stat to fill in
+* OUTPUT: 0 on success, -1 if there is no such file
+*/
+extern int32_t tmpfs_stat(const uint8_t* filename, stat_t* st);
+
+/*
+* tmpfs_fstat
+* DESCRIPTION: fills in a stat for an open file or the directory, blocks counts
+*              only pages that have a frame
+* INPUT: fd, stat to fill in
+* OUTPUT: always 0
+*/
+extern int32_t tmpfs_fstat(int32_t fd, stat_t* st);
+
+#endif
@@ -0,0 +1,306 @@
+#include "uart.h"
+#include "../lib.h"
+#include "../tasks.h"
+#include "../scheduler.h"
+
+// registers as offsets from the port base
+#define UART_DATA 0    // THR when written, RBR when read, divisor low with DLAB set
+#define UART_IER 1     // divisor high with DLAB set
+#define UART_IIR 2     // FCR when written
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_MSR 6
+#define UART_IER_RX 0x01
+#define UART_IER_THRE 0x02
+#define UART_IIR_NONE 0x01 // no interrupt pending
+#define UART_IIR_ID 0x0E
+#define UART_IIR_THRE 0x02
+#define UART_IIR_RX 0x04
+#define UART_IIR_LINE 0x06
+#define UART_IIR_TIMEOUT 0x0C
+#define UART_IIR_FIFO 0xC0     // both bits set when the FIFOs work, a 16550A
+#define UART_FCR_ENABLE 0xC7   // FIFOs on and cleared, receive interrupt at 14 bytes
+#define UART_LCR_8N1 0x03
+#define UART_LCR_DLAB 0x80
+#define UART_MCR_LOOP 0x1E     // loopback, with RTS, OUT1 and OUT2
+#define UART_MCR_NORMAL 0x0B   // DTR and RTS, OUT2 lets the interrupt out to the PIC
+#define UART_LSR_DR 0x01
+#define UART_LSR_THRE 0x20
+#define UART_CLOCK 115200      // divisor 1 is this baud rate
+#define UART_TEST_BYTE 0xAE
+#define UART_TIMEOUT 100000    // status reads before giving up on the line
+
+static int32_t uart_open(int32_t fd, const uint8_t* filename);
+static int32_t uart_read(int32_t fd, void* buf, int32_t nbytes);
+static int32_t uart_write(int32_t fd, const void* buf, int32_t nbytes);
+static int32_t uart_close(int32_t fd);
+static int32_t uart_poll(int32_t fd);
+
+file_operations_t uart_op_table = {uart_open, uart_read, uart_write, uart_close, uart_poll};
+
+static uint8_t tx_buf[UART_TX_SIZE];
+static uint8_t rx_buf[UART_RX_SIZE];
+static uart_ring_t tx = {tx_buf, UART_TX_SIZE, 0, 0};
+static uart_ring_t rx = {rx_buf, UART_RX_SIZE, 0, 0};
+static uint32_t present = 0;
+static uint32_t fifo_size = 1; // bytes the transmitter takes at once, 1 without a FIFO
+static uint32_t tx_busy = 0;   // the THR empty interrupt is on, it will send what is queued
+
+#define ring_count(r) ((r)->tail - (r)->head)
+#define ring_room(r) ((r)->size - ring_count(r))
+
+/*
+* ring_put
+* DESCRIPTION: copies bytes into a ring, up to the end of the buffer and then
+*              the wrapped around part, the caller checks there is room
+* INPUTS: ring, bytes, how many
+* OUTPUTS: none
+*/
+static void ring_put(uart_ring_t* r, const uint8_t* src, uint32_t n) {
+    uint32_t at = r->tail & (r->size - 1);
+    uint32_t first = (n < r->size - at) ? n : r->size - at;
+    memcpy(r->buf + at, src, first);
+    memcpy(r->buf, src + first, n - first);
+    r->tail += n;
+}
+
+/*
+* ring_get
+* DESCRIPTION: copies bytes out of a ring, the caller checks they are there
+* INPUTS: ring, where to copy, how many
+* OUTPUTS: none
+*/
+static void ring_get(uart_ring_t* r, uint8_t* dst, uint32_t n) {
+    uint32_t at = r->head & (r->size - 1);
+    uint32_t first = (n < r->size - at) ? n : r->size - at;
+    memcpy(dst, r->buf + at, first);
+    memcpy(dst + first, r->buf, n - first);
+    r->head += n;
+}
+
+/*
+* tx_fill
+* DESCRIPTION: moves queued bytes into the transmit FIFO, as many as it holds,
+*              without checking the line status between them since it is empty
+* INPUTS: none
+* OUTPUTS: none
+*/
+static void tx_fill() {
+    uint32_t i;
+    for (i = 0; i < fifo_size && tx.head != tx.tail; i++) {
+        outb(tx_buf[tx.head++ & (UART_TX_SIZE - 1)], UART_COM1 + UART_DATA);
+    }
+}
+
+/*
+* tx_start
+* DESCRIPTION: gets an idle transmitter going on what is queued, the first FIFO
+*              is filled here and the THR empty interrupt sends the rest
+* INPUTS: none
+* OUTPUTS: none
+*/
+static void tx_start() {
+    if (tx_busy || tx.head == tx.tail) return;
+    if (inb(UART_COM1 + UART_LSR) & UART_LSR_THRE) tx_fill();
+    tx_busy = 1;
+    outb(UART_IER_RX | UART_IER_THRE, UART_COM1 + UART_IER);
+}
+
+/*
+* tx_poll
+* DESCRIPTION: waits for the transmit FIFO to empty and refills it, for when
+*              the ring is full and the caller can't sleep or interrupts are off
+* INPUTS: none
+* OUTPUTS: none
+*/
+static void tx_poll() {
+    uint32_t i;
+    for (i = 0; i < UART_TIMEOUT && !(inb(UART_COM1 + UART_LSR) & UART_LSR_THRE); i++);
+    tx_fill();
+}
+
+/*
+* uart_init
+* DESCRIPTION: checks COM1 is there with the loopback test, sets it to 115200 8N1
+*              with its FIFOs on and enables the receive interrupt, kernel printf
+*              output is copied to it from then on
+* INPUTS: none
+* OUTPUTS: 0 on success, -1 if there is no serial port
+*/
+int32_t uart_init() {
+    outb(0, UART_COM1 + UART_IER);
+    outb(UART_LCR_DLAB, UART_COM1 + UART_LCR);
+    outb((UART_CLOCK / UART_BAUD) & 0xFF, UART_COM1 + UART_DATA);
+    outb((UART_CLOCK / UART_BAUD) >> 8, UART_COM1 + UART_IER);
+    outb(UART_LCR_8N1, UART_COM1 + UART_LCR);
+    outb(UART_FCR_ENABLE, UART_COM1 + UART_IIR);
+    // a byte sent in loopback comes straight back if there is a port at all
+    outb(UART_MCR_LOOP, UART_COM1 + UART_MCR);
+    outb(UART_TEST_BYTE, UART_COM1 + UART_DATA);
+    if (inb(UART_COM1 + UART_DATA) != UART_TEST_BYTE) return -1;
+    fifo_size = ((inb(UART_COM1 + UART_IIR) & UART_IIR_FIFO) == UART_IIR_FIFO) ? UART_FIFO_SIZE : 1;
+    outb(UART_MCR_NORMAL, UART_COM1 + UART_MCR);
+    // drop anything left over from before
+    while (inb(UART_COM1 + UART_LSR) & UART_LSR_DR) inb(UART_COM1 + UART_DATA);
+    inb(UART_COM1 + UART_MSR);
+    outb(UART_IER_RX, UART_COM1 + UART_IER);
+    present = 1;
+    set_log_sink(uart_log_putc);
+    return 0;
+}
+
+/*
+* uart_isr_handler
+* DESCRIPTION: takes every byte received into the receive ring and refills the
+*              transmit FIFO from the transmit ring, a whole FIFO per interrupt
+* INPUTS: none
+* OUTPUTS: none
+*/
+void uart_isr_handler() {
+    uint32_t iir, got = 0, sent = 0;
+    uint8_t c;
+    // the port can have more than one reason pending, each read of IIR gives the next
+    while (!((iir = inb(UART_COM1 + UART_IIR)) & UART_IIR_NONE)) {
+        switch (iir & UART_IIR_ID) {
+            case UART_IIR_RX:
+            case UART_IIR_TIMEOUT:
+                while (inb(UART_COM1 + UART_LSR) & UART_LSR_DR) {
+                    c = inb(UART_COM1 + UART_DATA);
+                    // nobody is reading fast enough, the newest bytes are lost
+                    if (ring_room(&rx)) rx_buf[rx.tail++ & (UART_RX_SIZE - 1)] = c;
+                    got = 1;
+                }
+                break;
+            case UART_IIR_THRE:
+                if (tx.head == tx.tail) {
+                    tx_busy = 0;
+                    outb(UART_IER_RX, UART_COM1 + UART_IER);
+                }
+                else tx_fill();
+                sent = 1;
+                break;
+            case UART_IIR_LINE:
+                inb(UART_COM1 + UART_LSR);
+                break;
+            default:
+                inb(UART_COM1 + UART_MSR);
+                break;
+        }
+    }
+    if (got) scheduler_wake(&rx);
+    if (sent) scheduler_wake(&tx);
+    if (got || sent) scheduler_poll_notify();
+}
+
+/*
+* log_byte
+* DESCRIPTION: queues one byte of kernel output, polling the line while the ring is full
+* INPUTS: byte
+* OUTPUTS: none
+*/
+static void log_byte(uint8_t c) {
+    uint32_t flags;
+    cli_and_save(flags);
+    while (ring_room(&tx) == 0) tx_poll();
+    tx_buf[tx.tail++ & (UART_TX_SIZE - 1)] = c;
+    tx_start();
+    restore_flags(flags);
+}
+
+/*
+* uart_log_putc
+* DESCRIPTION: queues a byte of kernel output, a newline goes out as CR LF, it never
+*              sleeps, so when the ring is full the line is polled until there is room
+* INPUTS: byte
+* OUTPUTS: none
+*/
+void uart_log_putc(uint8_t c) {
+    if (!present) return;
+    if (c == '\n') log_byte('\r');
+    log_byte(c);
+}
+
+/*
+* uart_open
+* DESCRIPTION: the port is set up at boot, /dev/ttyS0 only exists if it was found
+* INPUTS: fd, name
+* OUTPUTS: 0
+*/
+static int32_t uart_open(int32_t fd, const uint8_t* filename) {
+    return 0;
+}
+
+/*
+* uart_read
+* DESCRIPTION: sleeps until bytes have been received, then copies out what is there,
+*              bytes are raw, there is no line editing
+* INPUTS: fd, buf to copy to, nbytes to copy
+* OUTPUTS: number of bytes read, -1 if non blocking and nothing was received
+*/
+static int32_t uart_read(int32_t fd, void* buf, int32_t nbytes) {
+    uint32_t flags, n;
+    if (nbytes <= 0) return 0;
+    cli_and_save(flags);
+    if (rx.head == rx.tail && (fd_file(fd)->flags & FD_NONBLOCK)) {
+        restore_flags(flags);
+        return -1;
+    }
+    while (rx.head == rx.tail) {
+        scheduler_sleep(&rx);
+    }
+    n = (ring_count(&rx) < (uint32_t)nbytes) ? ring_count(&rx) : (uint32_t)nbytes;
+    ring_get(&rx, buf, n);
+    restore_flags(flags);
+    return n;
+}
+
+/*
+* uart_write
+* DESCRIPTION: queues buf to be sent, sleeping whenever the ring is full, the
+*              interrupt handler sends it a FIFO at a time
+* INPUTS: fd, buf to send, nbytes to send
+* OUTPUTS: number of bytes queued, -1 if non blocking and the ring was full
+*/
+static int32_t uart_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags, n;
+    int32_t written = 0;
+    if (nbytes < 0) return -1;
+    cli_and_save(flags);
+    while (written < nbytes) {
+        if (ring_room(&tx) == 0) {
+            tx_start();
+            if (fd_file(fd)->flags & FD_NONBLOCK) break;
+            scheduler_sleep(&tx);
+            continue;
+        }
+        n = ring_room(&tx);
+        if (n > (uint32_t)(nbytes - written)) n = nbytes - written;
+        ring_put(&tx, (const uint8_t*)buf + written, n);
+        written += n;
+    }
+    tx_start();
+    restore_flags(flags);
+    if (written == 0 && nbytes > 0) return -1;
+    return written;
+}
+
+/*
+* uart_close
+* DESCRIPTION: queued bytes are still sent after the close
+* INPUTS: fd
+* OUTPUTS: 0
+*/
+static int32_t uart_close(int32_t fd) {
+    return 0;
+}
+
+/*
+* uart_poll
+* DESCRIPTION: readiness of /dev/ttyS0
+* INPUTS: fd
+* OUTPUTS: POLLIN if bytes were received, POLLOUT if the ring has room
+*/
+static int32_t uart_poll(int32_t fd) {
+    return ((rx.head != rx.tail) ? POLLIN : 0) | (ring_room(&tx) ? POLLOUT : 0);
+}
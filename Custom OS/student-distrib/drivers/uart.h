@@ -0,0 +1,52 @@
+#ifndef UART_H
+#define UART_H
+
+#include "../types.h"
+#include "../vfs.h"
+
+#define UART_COM1 0x3F8
+#define UART_IRQ 4         // COM1 on the master PIC
+#define UART_BAUD 115200
+#define UART_TX_SIZE 4096  // power of 2
+#define UART_RX_SIZE 1024  // power of 2
+#define UART_FIFO_SIZE 16  // bytes a 16550A takes per THR empty interrupt
+
+/* ring of bytes, head and tail only grow, index with & (size - 1) */
+typedef struct uart_ring {
+    uint8_t* buf;
+    uint32_t size;
+    volatile uint32_t head; // next byte to take out
+    volatile uint32_t tail; // next byte to put in
+} uart_ring_t;
+
+extern file_operations_t uart_op_table;
+
+/*
+* uart_init
+* DESCRIPTION: checks COM1 is there with the loopback test, sets it to 115200 8N1
+*              with its FIFOs on and enables the receive interrupt, kernel printf
+*              output is copied to it from then on
+* INPUTS: none
+* OUTPUTS: 0 on success, -1 if there is no serial port
+*/
+extern int32_t uart_init();
+
+/*
+* uart_isr_handler
+* DESCRIPTION: takes every byte received into the receive ring and refills the
+*              transmit FIFO from the transmit ring, a whole FIFO per interrupt
+* INPUTS: none
+* OUTPUTS: none
+*/
+extern void uart_isr_handler();
+
+/*
+* uart_log_putc
+* DESCRIPTION: queues a byte of kernel output, a newline goes out as CR LF, it never
+*              sleeps, so when the ring is full the line is polled until there is room
+* INPUTS: byte
+* OUTPUTS: none
+*/
+extern void uart_log_putc(uint8_t c);
+
+#endif
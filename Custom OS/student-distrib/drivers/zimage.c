@@ -0,0 +1,155 @@
+#include "zimage.h"
+#include "../lib.h"
+#include "../paging.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_RUN_MASK 15 // a length nibble of 15 goes on in the bytes after it
+
+static block_device_t zimage_dev;
+static zimage_header_t* image;
+static uint32_t overlay; // frame of map frames for blocks written, 0 if none were
+
+static int32_t zimage_read(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs);
+static int32_t zimage_write(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs);
+
+/*
+* zimage_open
+* DESCRIPTION: checks if a module is a compressed image, blocks are decompressed
+*              as the buffer cache reads them, blocks written are kept in frames
+*              over the image, like writes to an uncompressed module stay in memory
+* INPUTS: start and end of module
+* OUTPUTS: block device of the image, 0 if the module isn't a good compressed image
+*/
+block_device_t* zimage_open(uint32_t module_start, uint32_t module_end) {
+    zimage_header_t* h = (zimage_header_t*)module_start;
+    uint32_t i, size = module_end - module_start;
+    if (size < sizeof(zimage_header_t) || h->magic != ZIMAGE_MAGIC || h->num_blocks == 0) return 0;
+    if (h->num_blocks >= (size - sizeof(zimage_header_t)) / 4) return 0;
+    if (h->num_blocks > ZIMAGE_MAP_ENTRIES * ZIMAGE_MAP_ENTRIES) return 0;
+    // every block has to lie inside the module and be no bigger than the block
+    for (i = 0; i < h->num_blocks; i++) {
+        if (h->offsets[i] > h->offsets[i + 1] || h->offsets[i + 1] - h->offsets[i] > BCACHE_BLOCK_SIZE) return 0;
+    }
+    if (h->offsets[h->num_blocks] > size) return 0;
+    image = h;
+    overlay = 0;
+    zimage_dev.num_blocks = h->num_blocks;
+    zimage_dev.read = zimage_read;
+    zimage_dev.write = zimage_write;
+    zimage_dev.flush = 0;
+    return &zimage_dev;
+}
+
+/*
+* lz4_length
+* DESCRIPTION: reads the bytes a length nibble of 15 goes on in, each adds to it
+*              and a byte below 255 is the last
+* INPUTS: where the bytes are, end of input, length so far
+* OUTPUTS: full length, -1 if the input ends first
+*/
+static int32_t lz4_length(const uint8_t** src, const uint8_t* end, uint32_t len) {
+    uint8_t b;
+    do {
+        if (*src >= end) return -1;
+        b = *(*src)++;
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+/*
+* lz4_decompress
+* DESCRIPTION: decodes an LZ4 block, sequences of a token, literals, a 2 byte
+*              offset back into the output and a match length, the last
+*              sequence is only literals
+* INPUTS: compressed bytes, how many, output, room in output
+* OUTPUTS: bytes produced, -1 if the input is bad or doesn't fit
+*/
+static int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) {
+    const uint8_t* end = src + src_len;
+    uint32_t i, offset, out = 0;
+    int32_t len;
+    uint8_t token;
+    while (src < end) {
+        token = *src++;
+        len = token >> 4;
+        if (len == LZ4_RUN_MASK && -1 == (len = lz4_length(&src, end, len))) return -1;
+        if ((uint32_t)len > (uint32_t)(end - src) || (uint32_t)len > dst_len - out) return -1;
+        memcpy(dst + out, src, len);
+        src += len;
+        out += len;
+        if (src == end) break;
+        if (end - src < 2) return -1;
+        offset = src[0] | (src[1] << 8);
+        src += 2;
+        if (offset == 0 || offset > out) return -1;
+        len = token & LZ4_RUN_MASK;
+        if (len == LZ4_RUN_MASK && -1 == (len = lz4_length(&src, end, len))) return -1;
+        len += LZ4_MIN_MATCH;
+        if ((uint32_t)len > dst_len - out) return -1;
+        // a byte at a time, the match can overlap what it is copying to repeat a pattern
+        for (i = 0; i < (uint32_t)len; i++, out++) dst[out] = dst[out - offset];
+    }
+    return out;
+}
+
+/*
+* overlay_entry
+* DESCRIPTION: finds the frame holding a written block, like a page table walk
+* INPUTS: block, 1 to make the map frames on the way if missing
+* OUTPUTS: address of the map entry, 0 if there is none or no frame was left
+*/
+static uint32_t* overlay_entry(uint32_t block, int32_t create) {
+    uint32_t* dir;
+    uint32_t* table;
+    if (!overlay && (!create || 0 == (overlay = alloc_frame()))) return 0;
+    dir = (uint32_t*)overlay;
+    table = (uint32_t*)dir[block / ZIMAGE_MAP_ENTRIES];
+    if (!table && (!create || 0 == (table = (uint32_t*)alloc_frame()))) return 0;
+    dir[block / ZIMAGE_MAP_ENTRIES] = (uint32_t)table;
+    return &table[block % ZIMAGE_MAP_ENTRIES];
+}
+
+/*
+* zimage_read
+* DESCRIPTION: decompresses blocks, blocks that were written come from their frame
+* INPUTS: device, first block, number of blocks, one buffer per block
+* OUTPUTS: 0 on success, -1 if a block is bad
+*/
+static int32_t zimage_read(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs) {
+    uint32_t i, b, len;
+    uint32_t* entry;
+    const uint8_t* src;
+    if (block >= dev->num_blocks || count > dev->num_blocks - block) return -1;
+    for (i = 0; i < count; i++) {
+        b = block + i;
+        if ((entry = overlay_entry(b, 0)) && *entry) {
+            memcpy(bufs[i], (void*)*entry, BCACHE_BLOCK_SIZE);
+            continue;
+        }
+        src = (const uint8_t*)image + image->offsets[b];
+        len = image->offsets[b + 1] - image->offsets[b];
+        if (len == 0) memset(bufs[i], 0, BCACHE_BLOCK_SIZE);
+        else if (len == BCACHE_BLOCK_SIZE) memcpy(bufs[i], src, BCACHE_BLOCK_SIZE);
+        else if (BCACHE_BLOCK_SIZE != lz4_decompress(src, len, bufs[i], BCACHE_BLOCK_SIZE)) return -1;
+    }
+    return 0;
+}
+
+/*
+* zimage_write
+* DESCRIPTION: keeps written blocks in frames, the image itself is never changed
+* INPUTS: device, first block, number of blocks, one buffer per block
+* OUTPUTS: 0 on success, -1 if no frame was left
+*/
+static int32_t zimage_write(block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs) {
+    uint32_t i;
+    uint32_t* entry;
+    if (block >= dev->num_blocks || count > dev->num_blocks - block) return -1;
+    for (i = 0; i < count; i++) {
+        if (0 == (entry = overlay_entry(block + i, 1))) return -1;
+        if (!*entry && 0 == (*entry = alloc_frame())) return -1;
+        memcpy((void*)*entry, bufs[i], BCACHE_BLOCK_SIZE);
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef ZIMAGE_H
+#define ZIMAGE_H
+
+#include "../types.h"
+#include "../bcache.h"
+
+#define ZIMAGE_MAGIC 0x3153465A // "ZFS1"
+#define ZIMAGE_MAP_ENTRIES 1024 // frame addresses held by one overlay map frame
+
+/* a filesystem image with each 4KB block compressed on its own, block i is
+ * the offsets[i+1]-offsets[i] bytes at offsets[i] from the start of the image,
+ * 0 bytes is a block of zeros, BCACHE_BLOCK_SIZE bytes is stored as is, and
+ * anything else is an LZ4 block that decompresses to BCACHE_BLOCK_SIZE bytes */
+typedef struct zimage_header {
+    uint32_t magic;
+    uint32_t num_blocks;
+    uint32_t offsets[]; // num_blocks + 1 of them
+} __attribute__((packed)) zimage_header_t;
+
+/*
+* zimage_open
+* DESCRIPTION: checks if a module is a compressed image, blocks are decompressed
+*              as the buffer cache reads them, blocks written are kept in frames
+*              over the image, like writes to an uncompressed module stay in memory
+* INPUTS: start and end of module
+* OUTPUTS: block device of the image, 0 if the module isn't a good compressed image
+*/
+extern block_device_t* zimage_open(uint32_t module_start, uint32_t module_end);
+
+#endif
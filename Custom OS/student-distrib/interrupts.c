@@ -8,15 +8,29 @@
 #include "i8259.h"
 #include "drivers/rtc.h"
 #include "drivers/kb.h"
+#include "drivers/pit.h"
+#include "drivers/uart.h"
 #include "scheduler.h"
+#include "signal.h"
+#include "paging.h"
+
+#define PAGE_FAULT_IRQ 14
 
 /* exception_common
-Description: Reports exception number
-Input: irq number
+Description: Reports exception number, user programs with a handler get a signal instead
+Input: irq number, iret frame of the exception
 Output: none
 Effect: spin when exception occurs
 */
-void exception_common(uint32_t irq) {
+void exception_common(uint32_t irq, iret_frame_t* frame) {
+	uint32_t fault_addr;
+	// first touch of a demand zero page, from the program or from a syscall on its behalf
+	if (irq == PAGE_FAULT_IRQ && current_task_id > 0) {
+		asm volatile ("movl %%cr2, %0" : "=r" (fault_addr));
+		if (demand_zero_fault(fault_addr) == 0) return;
+	}
+	// handler is called on the way out, the faulting instruction runs again after
+	if (current_task_id > 0 && (frame->cs & 0x3) == 0x3 && signal_exception(irq)) return;
 	printf("Exception %d: ", irq);
 	switch (irq) {
 		case 0: printf("DIV_BY_ZERO\n"); break;
@@ -45,7 +59,7 @@ void exception_common(uint32_t irq) {
 	// exit to shell using status 256 to represent exception, as specified in shell
 	// if shell somehow fails, it should just restart
 	if (current_task_id > 0) {
-		end_program(256, get_pcb(current_task_pcb->parent_task_id)->exec_ebp);
+		end_program(256, get_exit_ebp(current_task_pcb));
 	}
 	// if in kernel mode still, drop into infinite loop
 	else {
@@ -62,8 +76,9 @@ Effect: sends eoi after handler completes
 void interrupt_common(uint32_t irq) {
 	send_eoi(irq);
 	switch (irq) {
-		case 0: scheduler_isr_handler(); break;
+		case 0: pit_isr_handler(); break;
 		case 1: keyboard_isr_handler(); break;
+		case 4: uart_isr_handler(); break;
 		case 8: rtc_isr_handler(); break;
         default: printf("Interrupt %d cannot be handled!\n", irq); break;
 	}
@@ -2,6 +2,7 @@
 #define INTERRUPTS_H
 
 #include "types.h"
+#include "signal.h"
 
 /* exception handler address pointers */
 extern void* exception[32];
@@ -9,12 +10,12 @@ extern void* exception[32];
 extern void* interrupt[16];
 
 /* exception_common
-Description: Reports exception number
-Input: irq number
+Description: Reports exception number, user programs with a handler get a signal instead
+Input: irq number, iret frame of the exception
 Output: none
 Effect: spin when exception occurs
 */
-extern void exception_common(uint32_t irq);
+extern void exception_common(uint32_t irq, iret_frame_t* frame);
 
 /* interrupt_common
 Description: Calls IRQ handlers
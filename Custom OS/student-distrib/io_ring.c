@@ -0,0 +1,65 @@
+#include "io_ring.h"
+
+#include "lib.h"
+#include "paging.h"
+#include "tasks.h"
+#include "syscall.h"
+
+/* io_setup
+Description: maps a submission/completion ring page into the current task
+Input: none
+Output: address of the io_ring_t, -1 on fail
+*/
+int32_t io_setup() {
+    uint32_t phys_base, virt_base;
+    io_ring_t* ring;
+    // one ring per task
+    if (current_task_pcb->io_ring_addr) return -1;
+    if (0 == (virt_base = find_user_range(1))) return -1;
+    if (0 == (phys_base = alloc_frame())) return -1;
+    if (-1 == map_user_4k_page(phys_base, virt_base, 1)) {
+        put_frame(phys_base);
+        return -1;
+    }
+    // page table holds the reference now
+    put_frame(phys_base);
+    ring = (io_ring_t*) virt_base;
+    ring->sq_entries = IO_SQ_ENTRIES;
+    ring->cq_entries = IO_CQ_ENTRIES;
+    current_task_pcb->io_ring_addr = virt_base;
+    return virt_base;
+}
+
+/* io_enter
+Description: runs up to to_submit queued requests in order and posts a
+completion for each, stops early if the completion ring is full
+Input: number of requests to take from the submission ring
+Output: number of requests consumed, -1 on fail
+*/
+int32_t io_enter(int32_t to_submit) {
+    int32_t done, res;
+    io_sqe_t sqe;
+    io_ring_t* ring = (io_ring_t*) current_task_pcb->io_ring_addr;
+    if (!ring || to_submit < 0) return -1;
+    for (done = 0; done < to_submit; done++) {
+        // nothing queued
+        if (ring->sq_head == ring->sq_tail) break;
+        // no room to post the completion, let the task drain it first
+        if (ring->cq_tail - ring->cq_head >= IO_CQ_ENTRIES) break;
+        // copy the entry so the task can't change it while it runs
+        sqe = ring->sqes[ring->sq_head % IO_SQ_ENTRIES];
+        ring->sq_head++;
+        switch (sqe.opcode) {
+            case IO_OP_NOP: res = 0; break;
+            case IO_OP_READ: res = read(sqe.fd, (void*)sqe.addr, sqe.len); break;
+            case IO_OP_WRITE: res = write(sqe.fd, (const void*)sqe.addr, sqe.len); break;
+            case IO_OP_OPEN: res = open((const uint8_t*)sqe.addr); break;
+            case IO_OP_CLOSE: res = close(sqe.fd); break;
+            default: res = -1; break;
+        }
+        ring->cqes[ring->cq_tail % IO_CQ_ENTRIES].user_data = sqe.user_data;
+        ring->cqes[ring->cq_tail % IO_CQ_ENTRIES].res = res;
+        ring->cq_tail++;
+    }
+    return done;
+}
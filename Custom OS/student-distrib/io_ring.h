@@ -0,0 +1,60 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include "types.h"
+
+#define IO_SQ_ENTRIES 64
+#define IO_CQ_ENTRIES 128
+
+/* submission opcodes */
+#define IO_OP_NOP   0
+#define IO_OP_READ  1
+#define IO_OP_WRITE 2
+#define IO_OP_OPEN  3
+#define IO_OP_CLOSE 4
+
+/* one request, addr is the buffer for read/write or the filename for open */
+typedef struct io_sqe {
+    uint32_t opcode;
+    int32_t  fd;
+    uint32_t addr;
+    int32_t  len;
+    uint32_t user_data; // copied to the completion untouched
+} __attribute__((packed)) io_sqe_t;
+
+/* one completion, res is what the matching system call would have returned */
+typedef struct io_cqe {
+    uint32_t user_data;
+    int32_t  res;
+} __attribute__((packed)) io_cqe_t;
+
+/* page shared between the task and the kernel, the task fills sqes and moves
+ * sq_tail, the kernel moves sq_head and cq_tail, the task moves cq_head,
+ * heads and tails count up forever and are masked to index */
+typedef struct io_ring {
+    uint32_t sq_head;
+    uint32_t sq_tail;
+    uint32_t cq_head;
+    uint32_t cq_tail;
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    io_sqe_t sqes[IO_SQ_ENTRIES];
+    io_cqe_t cqes[IO_CQ_ENTRIES];
+} __attribute__((packed)) io_ring_t;
+
+/* io_setup
+Description: maps a submission/completion ring page into the current task
+Input: none
+Output: address of the io_ring_t, -1 on fail
+*/
+extern int32_t io_setup();
+
+/* io_enter
+Description: runs up to to_submit queued requests in order and posts a
+completion for each, stops early if the completion ring is full
+Input: number of requests to take from the submission ring
+Output: number of requests consumed, -1 on fail
+*/
+extern int32_t io_enter(int32_t to_submit);
+
+#endif
@@ -12,8 +12,12 @@
 #include "paging.h"
 #include "syscall.h"
 #include "drivers/fs.h"
+#include "drivers/ata.h"
+#include "drivers/zimage.h"
+#include "vfs.h"
 #include "drivers/pit.h"
 #include "drivers/rtc.h"
+#include "drivers/uart.h"
 #include "tasks.h"
 
 #define RUN_TESTS
@@ -27,12 +31,17 @@
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    block_device_t* fs_zimage;
+    int32_t serial;
 
     current_task_pcb->terminal_id = 0;
 
     /* Clear the screen. */
     clear();
 
+    /* Serial console first so the boot messages go out on it too */
+    serial = uart_init();
+
     /* Am I booted by a Multiboot-compliant boot loader? */
     if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
         printf("Invalid magic number: 0x%#x\n", (unsigned)magic);
@@ -152,7 +161,7 @@ void entry(unsigned long magic, unsigned long addr) {
      * PIC, any other initialization stuff... */
 
     /* Install exception handlers, 32 exceptions*/
-    int i;
+    int i, n_disks, fs_ok = 1;
     for (i = 0; i < 32; i++) {
       install_idt(i, exception[i]);
     }
@@ -161,17 +170,45 @@ void entry(unsigned long magic, unsigned long addr) {
 	install_idt(0x20, interrupt[0]);
     /* install interrupt handler for kb (idt entry x21, irq1) */
     install_idt(0x21, interrupt[1]);
+    /* install interrupt handler for serial port (idt entry x24, irq4) */
+    install_idt(0x24, interrupt[UART_IRQ]);
     /* install interrupt handler for rtc (idt entry x28, irq8) */
     install_idt(0x28, interrupt[8]);
     /* install interrupt handler for system call (idt entry x80) */
     install_idt(0x80, system_call_entry);
-    /* Init Filesystem with module info*/
-    filesystem_init(((module_t*)mbi->mods_addr)->mod_start,((module_t*)mbi->mods_addr)->mod_end);
+    /* Init Filesystem with module info, a compressed image is read through the
+     * buffer cache, which needs the frame pool paged in first */
+    fs_zimage = zimage_open(((module_t*)mbi->mods_addr)->mod_start,((module_t*)mbi->mods_addr)->mod_end);
+    if (!fs_zimage) filesystem_init(((module_t*)mbi->mods_addr)->mod_start,((module_t*)mbi->mods_addr)->mod_end);
+    /* Register devices and mount filesystems */
+    vfs_init();
+    if (serial == 0) vfs_register_device((uint8_t*)"ttyS0", &uart_op_table);
     /* Init Paging */
     disable_all_pages();
     init_kernel_page();
     init_vidmem_pages();
+    init_frame_pool_pages();
     load_page_directory();
+    /* The raw module is compressed, so it can't be read without the cache either */
+    if (fs_zimage && 0 != filesystem_init_disk(fs_zimage)) {
+        printf("Compressed filesystem module doesn't hold a filesystem image\n");
+        fs_ok = 0;
+    }
+    /* A disk holding a filesystem image takes over from the module, its
+     * blocks come through the buffer cache so it can be bigger than memory,
+     * a compressed module that mounted is already the image meant to be used */
+    n_disks = ata_init();
+    for (i = 0; i < n_disks && !(fs_zimage && fs_ok); i++) {
+        if (0 == filesystem_init_disk(ata_drive(i))) {
+            fs_ok = 1;
+            break;
+        }
+    }
+    /* No shell to run without a filesystem */
+    if (!fs_ok) {
+        printf("No filesystem to boot from, halting\n");
+        while (1) asm volatile ("hlt");
+    }
 
     // enable irqs
     enable_pit();
@@ -179,6 +216,7 @@ void entry(unsigned long magic, unsigned long addr) {
     enable_irq(0); // pit on line 0
     enable_irq(1); // kb on line 1
     enable_irq(8); // rtc on line 8
+    if (serial == 0) enable_irq(UART_IRQ); // COM1 on line 4
     // clear screen to get rid of diagnostic crap and run shell
     clear();
     // always keep shell running
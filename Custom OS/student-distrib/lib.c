@@ -9,6 +9,9 @@
 #define NUM_COLS    80
 #define NUM_ROWS    25
 #define ATTRIB      0x7
+#define PUTBUF_CHUNK 1024   // bytes putbuf prints with interrupts off
+
+static void (*log_sink)(uint8_t c) = 0;
 
 /*
 move_cursor
@@ -20,7 +23,8 @@ Source: https://web.archive.org/web/20160326064341/http://jamesmolloy.co.uk/tuto
 void move_cursor() {
     // cursor should follow the active terminal's
     if (rw_active_terminal || active_terminal_id == current_task_pcb->terminal_id) {
-        uint16_t cursorLocation = screen_y * NUM_COLS + screen_x;
+        // the location counts from the start of VGA memory, not from where the screen starts
+        uint16_t cursorLocation = (((uint32_t)video_mem - VIDEO) >> 1) + screen_y * NUM_COLS + screen_x;
         outb(0x0E, 0x3D4);                  // Tell the VGA board we are setting the high cursor byte.
         outb(cursorLocation >> 8, 0x3D5);   // Send the high cursor byte.
         outb(0x0F, 0x3D4);                  // Tell the VGA board we are setting the low cursor byte.
@@ -38,6 +42,7 @@ void clear(void) {
         *(uint8_t *)(video_mem + (i << 1)) = ' ';
         *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
     }
+    screen_dirty = TERM_ALL_ROWS;
     screen_x = 0;
     screen_y = 0;
     move_cursor();
@@ -57,6 +62,7 @@ void delc(void) {
       screen_x--;
   }
 
+  screen_dirty |= 1 << screen_y;
   *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';
   *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
   screen_x %= NUM_COLS;
@@ -67,18 +73,35 @@ void delc(void) {
 /* void scrollup(void);
  * Inputs: void
  * Return value: none
- * Function: Scroll the screen up by one line, when the last line is reached */
+ * Function: Scroll the screen up by one line, when the last line is reached,
+ *  the line going off the top is kept in the terminal's scrollback */
 void scrollup(void) {
-  int x,y;
-  for(y = 1; y < NUM_ROWS; y++){
-    memcpy( (uint8_t *)(video_mem + ((NUM_COLS * (y-1)) << 1)),
-            (uint8_t *)(video_mem + ((NUM_COLS * y) << 1)),
-                        NUM_COLS*2);
-  }
-  for(x = 0; x < NUM_COLS; x++){
-    *(uint8_t *)(video_mem + ((NUM_COLS * (NUM_ROWS-1) + x) << 1)) = ' ';
-    *(uint8_t *)(video_mem + ((NUM_COLS * (NUM_ROWS-1) + x) << 1) + 1) = ATTRIB;
-  }
+    term_scroll(&terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id], 1);
+}
+
+/* void set_log_sink(void (*sink)(uint8_t c));
+ *   Inputs: sink = function given every character printf prints, 0 for none
+ *   Return Value: none
+ *   Function: Copies kernel printf output somewhere besides the screen */
+void set_log_sink(void (*sink)(uint8_t c)) {
+    log_sink = sink;
+}
+
+/* static void log_putc(uint8_t c);
+ *   Inputs: c = character printf prints
+ *   Return Value: none
+ *   Function: Prints to the console and the log sink */
+static void log_putc(uint8_t c) {
+    putc(c);
+    if (log_sink) log_sink(c);
+}
+
+/* static void log_puts(int8_t* s);
+ *   Inputs: s = string printf prints
+ *   Return Value: none
+ *   Function: Prints to the console and the log sink */
+static void log_puts(int8_t* s) {
+    while (*s != '\0') log_putc(*s++);
 }
 
 /* Standard printf().
@@ -119,7 +142,7 @@ format_char_switch:
                     switch (*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%');
+                            log_putc('%');
                             break;
 
                         /* Use alternate formatting */
@@ -137,7 +160,7 @@ format_char_switch:
                                 int8_t conv_buf[64];
                                 if (alternate == 0) {
                                     itoa(*((uint32_t *)esp), conv_buf, 16);
-                                    puts(conv_buf);
+                                    log_puts(conv_buf);
                                 } else {
                                     int32_t starting_index;
                                     int32_t i;
@@ -147,7 +170,7 @@ format_char_switch:
                                         conv_buf[i] = '0';
                                         i++;
                                     }
-                                    puts(&conv_buf[starting_index]);
+                                    log_puts(&conv_buf[starting_index]);
                                 }
                                 esp++;
                             }
@@ -158,7 +181,7 @@ format_char_switch:
                             {
                                 int8_t conv_buf[36];
                                 itoa(*((uint32_t *)esp), conv_buf, 10);
-                                puts(conv_buf);
+                                log_puts(conv_buf);
                                 esp++;
                             }
                             break;
@@ -174,20 +197,20 @@ format_char_switch:
                                 } else {
                                     itoa(value, conv_buf, 10);
                                 }
-                                puts(conv_buf);
+                                log_puts(conv_buf);
                                 esp++;
                             }
                             break;
 
                         /* Print a single character */
                         case 'c':
-                            putc((uint8_t) *((int32_t *)esp));
+                            log_putc((uint8_t) *((int32_t *)esp));
                             esp++;
                             break;
 
                         /* Print a NULL-terminated string */
                         case 's':
-                            puts(*((int8_t **)esp));
+                            log_puts(*((int8_t **)esp));
                             esp++;
                             break;
 
@@ -199,7 +222,7 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf);
+                log_putc(*buf);
                 break;
         }
         buf++;
@@ -233,6 +256,7 @@ void putc(uint8_t c) {
           screen_y--;
         }
     } else {
+      screen_dirty |= 1 << screen_y;
       *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
       *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
       screen_x++;
@@ -249,6 +273,76 @@ void putc(uint8_t c) {
     move_cursor();
 }
 
+/* static void putbuf_chunk(const uint8_t* buf, uint32_t n);
+ * Inputs: buf = characters to print, n = how many
+ * Return Value: void
+ *  Function: Output part of a buffer to the console, the same as putc on each
+ *  character but with the terminal looked up once, the screen scrolled once by
+ *  the net number of lines and the cursor moved once, lines that go past the
+ *  top within the call are written straight into the scrollback, the caller
+ *  has interrupts off so the terminal can't be switched or scrolled meanwhile */
+static void putbuf_chunk(const uint8_t* buf, uint32_t n) {
+    term_t* t = &terms[(rw_active_terminal) ? active_terminal_id : current_task_pcb->terminal_id];
+    uint8_t* row;
+    int32_t x = t->_screen_x, y, lines = 0, scroll;
+    uint32_t i;
+
+    // count the lines the output moves down, newlines and wraps past the last column
+    for (i = 0; i < n; i++) {
+        if (buf[i] == '\n' || buf[i] == '\r' || ++x == NUM_COLS) {
+            x = 0;
+            lines++;
+        }
+    }
+    // putc scrolls a line each time the cursor would go past the bottom row
+    scroll = t->_screen_y + lines - (NUM_ROWS - 1);
+    if (scroll > 0) term_scroll(t, scroll);
+    else {
+        // rows from the cursor to where the output ends change, a scroll changed every one
+        t->_dirty |= ((2 << (t->_screen_y + lines)) - 1) & ~((1 << t->_screen_y) - 1);
+        scroll = 0;
+    }
+    // rows above 0 are in the scrollback now
+    x = t->_screen_x;
+    y = t->_screen_y - scroll;
+    row = term_row(t, y);
+    for (i = 0; i < n; i++) {
+        if (buf[i] == '\n' || buf[i] == '\r') {
+            x = 0;
+            row = term_row(t, ++y);
+            continue;
+        }
+        if (row) {
+            row[x << 1] = buf[i];
+            row[(x << 1) + 1] = ATTRIB;
+        }
+        if (++x == NUM_COLS) {
+            x = 0;
+            row = term_row(t, ++y);
+        }
+    }
+    t->_screen_x = x;
+    t->_screen_y = y;
+    move_cursor();
+}
+
+/* void putbuf(const uint8_t* buf, uint32_t n);
+ * Inputs: buf = characters to print, n = how many
+ * Return Value: void
+ *  Function: Output a buffer to the console, a chunk at a time with interrupts
+ *  off, so a terminal switch or keyboard echo only lands between chunks */
+void putbuf(const uint8_t* buf, uint32_t n) {
+    uint32_t flags, len;
+    while (n > 0) {
+        len = (n < PUTBUF_CHUNK) ? n : PUTBUF_CHUNK;
+        cli_and_save(flags);
+        putbuf_chunk(buf, len);
+        restore_flags(flags);
+        buf += len;
+        n -= len;
+    }
+}
+
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
  * Inputs: uint32_t value = number to convert
  *            int8_t* buf = allocated buffer to place string in
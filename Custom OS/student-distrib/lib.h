@@ -13,7 +13,9 @@ void move_cursor();
 void delc();
 void scrollup();
 int32_t printf(int8_t *format, ...);
+void set_log_sink(void (*sink)(uint8_t c));
 void putc(uint8_t c);
+void putbuf(const uint8_t* buf, uint32_t n);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 int8_t *strrev(int8_t* s);
@@ -9,6 +9,10 @@
 #define M_OFFSET 22
 #define K_OFFSET 12
 #define TEN_BIT_MASK 0x03FF
+#define FOUR_MB 0x00400000
+#define FRAME_COUNT (FRAME_POOL_SIZE / PAGE_SIZE_4K)
+/* avail bit of a not present pte, a zeroed frame is mapped on first touch */
+#define PTE_DEMAND_ZERO 0x1
 
 /* Page directory entries (Goes in Page Directory)*/
 typedef union pde_4k_desc_t {
@@ -80,6 +84,16 @@ pte_desc_t pt_vidmap[3][PAGE_TABLE_SIZE] __attribute__((aligned (4096)));
 #define pd (pd_arr[current_task_id])
 #define pt (pt_arr[current_task_id])
 
+/* references held on each frame of the frame pool, 0 means free */
+static uint16_t frame_ref[FRAME_COUNT];
+/* where alloc_frame starts looking for a free frame */
+static uint32_t frame_hint = 0;
+
+#define in_frame_pool(phys) ((phys) >= FRAME_POOL_BASE && (phys) < FRAME_POOL_BASE + FRAME_POOL_SIZE)
+#define frame_index(phys)   (((phys) - FRAME_POOL_BASE) >> K_OFFSET)
+/* page table behind a 4k page directory entry, tables live in identity mapped memory */
+#define user_page_table(virt) ((pte_desc_t*) (pd[(virt) >> M_OFFSET].k_type.page_table_base_address << K_OFFSET))
+
 
 /*	init_kernel_page
  *	DESCRIPTION: Initialize the 4MB kernel page by setting all the proper bits
@@ -108,9 +122,10 @@ void init_kernel_page(){
  *	Inputs:	none
  *	Outputs: none
  *	Return value: none
- *	Side Effects:	Initializes video memory, set all other pages to not present
+ *	Side Effects:	Maps the whole VGA text window, set all other pages to not present
  */
 void init_vidmem_pages(){
+  uint32_t addr;
   pd[V_MEM_BASE >> M_OFFSET].k_type.p = 1;
   pd[V_MEM_BASE >> M_OFFSET].k_type.rw = 1;
   pd[V_MEM_BASE >> M_OFFSET].k_type.us = 0;
@@ -136,15 +151,11 @@ void init_vidmem_pages(){
   pt[V_MEM_BASE >> K_OFFSET].avail = 0;
   pt[V_MEM_BASE >> K_OFFSET].page_base_address = V_MEM_BASE >> K_OFFSET;
 
-  // Initialize 3 more 4k pages to store each of the terminals
-  pt[V_MEM_TERM_1 >> K_OFFSET].val = pt[V_MEM_BASE >> K_OFFSET].val;
-  pt[V_MEM_TERM_1 >> K_OFFSET].page_base_address = V_MEM_TERM_1 >> K_OFFSET;
-
-  pt[V_MEM_TERM_2 >> K_OFFSET].val = pt[V_MEM_BASE >> K_OFFSET].val;
-  pt[V_MEM_TERM_2 >> K_OFFSET].page_base_address = V_MEM_TERM_2 >> K_OFFSET;
-
-  pt[V_MEM_TERM_3 >> K_OFFSET].val = pt[V_MEM_BASE >> K_OFFSET].val;
-  pt[V_MEM_TERM_3 >> K_OFFSET].page_base_address = V_MEM_TERM_3 >> K_OFFSET;
+  // map the rest of the VGA text window, the active terminal scrolls down through it
+  for (addr = V_MEM_BASE + PAGE_SIZE_4K; addr < V_MEM_END; addr += PAGE_SIZE_4K) {
+    pt[addr >> K_OFFSET].val = pt[V_MEM_BASE >> K_OFFSET].val;
+    pt[addr >> K_OFFSET].page_base_address = addr >> K_OFFSET;
+  }
 }
 
 /*	map_4m_page
@@ -253,6 +264,8 @@ int32_t check_permission(uint32_t virt_addr) {
 		if (pd[virt_addr >> M_OFFSET].m_type.ps) return (int32_t) pd[virt_addr >> M_OFFSET].m_type.us;
 		pte_desc_t* pt_temp = (pte_desc_t*) ((pd[virt_addr >> M_OFFSET].k_type.page_table_base_address) << K_OFFSET);
 		if (pt_temp[(virt_addr >> K_OFFSET) & TEN_BIT_MASK].p) return (int32_t) pt_temp[(virt_addr >> K_OFFSET) & TEN_BIT_MASK].us;
+		// demand zero pages are filled in when the kernel touches them
+		if (pt_temp[(virt_addr >> K_OFFSET) & TEN_BIT_MASK].avail & PTE_DEMAND_ZERO) return (int32_t) pt_temp[(virt_addr >> K_OFFSET) & TEN_BIT_MASK].us;
 		return -1;
 	}
 	else return -1;
@@ -303,3 +316,250 @@ void reload_page_directory() {
 	: "r" ((uint32_t)pd)
 	);
 }
+
+/*	init_frame_pool_pages
+ *	DESCRIPTION: identity maps the frame pool as supervisor 4MB pages
+ *	Inputs:	none
+ *	Outputs: none
+ *	Return value: none
+ *	Side Effects: kernel can read and write any frame from alloc_frame
+ */
+void init_frame_pool_pages() {
+	uint32_t addr;
+	for (addr = FRAME_POOL_BASE; addr < FRAME_POOL_BASE + FRAME_POOL_SIZE; addr += FOUR_MB) {
+		pd[addr >> M_OFFSET].m_type.val = 0;
+		pd[addr >> M_OFFSET].m_type.p = 1;
+		pd[addr >> M_OFFSET].m_type.rw = 1;
+		pd[addr >> M_OFFSET].m_type.us = 0;
+		pd[addr >> M_OFFSET].m_type.ps = 1;
+		pd[addr >> M_OFFSET].m_type.g = 1;
+		pd[addr >> M_OFFSET].m_type.page_base_address = addr >> M_OFFSET;
+	}
+}
+
+/*	alloc_frame
+ *	DESCRIPTION: takes a free 4k frame from the frame pool and zeroes it
+ *	Inputs:	none
+ *	Outputs: none
+ *	Return value: physical address of frame with one reference, 0 if pool is empty
+ */
+uint32_t alloc_frame() {
+	uint32_t i, idx, flags, phys_base;
+	cli_and_save(flags);
+	for (i = 0; i < FRAME_COUNT; i++) {
+		idx = (frame_hint + i) % FRAME_COUNT;
+		if (frame_ref[idx]) continue;
+		frame_ref[idx] = 1;
+		frame_hint = idx + 1;
+		restore_flags(flags);
+		phys_base = FRAME_POOL_BASE + (idx << K_OFFSET);
+		memset((void*)phys_base, 0, PAGE_SIZE_4K);
+		return phys_base;
+	}
+	restore_flags(flags);
+	return 0;
+}
+
+/*	get_frame
+ *	DESCRIPTION: adds a reference to a frame, frames outside the pool are ignored
+ *	Inputs:	physical address of frame
+ *	Outputs: none
+ *	Return value: none
+ */
+void get_frame(uint32_t phys_base) {
+	uint32_t flags;
+	if (!in_frame_pool(phys_base)) return;
+	cli_and_save(flags);
+	frame_ref[frame_index(phys_base)]++;
+	restore_flags(flags);
+}
+
+/*	put_frame
+ *	DESCRIPTION: drops a reference to a frame, frees it when none are left
+ *	Inputs:	physical address of frame
+ *	Outputs: none
+ *	Return value: none
+ */
+void put_frame(uint32_t phys_base) {
+	uint32_t flags;
+	if (!in_frame_pool(phys_base)) return;
+	cli_and_save(flags);
+	if (frame_ref[frame_index(phys_base)] > 0) frame_ref[frame_index(phys_base)]--;
+	restore_flags(flags);
+}
+
+/*	free_user_pte
+ *	DESCRIPTION: gets the pte of an unused page in the user map range,
+ *	allocating its page table on demand
+ *	Inputs:	page aligned virt_base
+ *	Outputs: none
+ *	Return value: pointer to the pte, 0 if out of range, in use or out of frames
+ */
+static pte_desc_t* free_user_pte(uint32_t virt_base) {
+	uint32_t table_phys;
+	pte_desc_t* entry;
+	if (virt_base < USER_MAP_BASE || virt_base >= USER_MAP_END) return 0;
+	if (virt_base & (PAGE_SIZE_4K-1)) return 0;
+	/* first page in this 4MB region, give it a page table */
+	if (!pd[virt_base >> M_OFFSET].k_type.p) {
+		if (0 == (table_phys = alloc_frame())) return 0;
+		pd[virt_base >> M_OFFSET].k_type.val = 0;
+		pd[virt_base >> M_OFFSET].k_type.p = 1;
+		pd[virt_base >> M_OFFSET].k_type.rw = 1;
+		pd[virt_base >> M_OFFSET].k_type.us = 1;
+		pd[virt_base >> M_OFFSET].k_type.page_table_base_address = table_phys >> K_OFFSET;
+	}
+	entry = &user_page_table(virt_base)[(virt_base >> K_OFFSET) & TEN_BIT_MASK];
+	if (entry->p || (entry->avail & PTE_DEMAND_ZERO)) return 0;
+	return entry;
+}
+
+/*	map_user_4k_page
+ *	DESCRIPTION: maps a 4k page for the current task inside the user map range,
+ *	allocating its page table on demand, takes a reference on the frame
+ *	Inputs:	phys_base that virt_base is mapped to, 1 if writable
+ *	Outputs: none
+ *	Return value: 0 if success, -1 if fail
+ */
+int32_t map_user_4k_page(uint32_t phys_base, uint32_t virt_base, uint32_t rw) {
+	pte_desc_t* entry = free_user_pte(virt_base);
+	if (!entry) return -1;
+	entry->val = 0;
+	entry->p = 1;
+	entry->rw = (rw) ? 1 : 0;
+	entry->us = 1;
+	entry->page_base_address = phys_base >> K_OFFSET;
+	get_frame(phys_base);
+	return 0;
+}
+
+/*	reserve_user_4k_page
+ *	DESCRIPTION: marks a page in the user map range as demand zero, no frame is
+ *	used until the page is first touched
+ *	Inputs:	virt_base of page, 1 if writable
+ *	Outputs: none
+ *	Return value: 0 if success, -1 if fail
+ */
+int32_t reserve_user_4k_page(uint32_t virt_base, uint32_t rw) {
+	pte_desc_t* entry = free_user_pte(virt_base);
+	if (!entry) return -1;
+	entry->val = 0;
+	entry->rw = (rw) ? 1 : 0;
+	entry->us = 1;
+	entry->avail = PTE_DEMAND_ZERO;
+	return 0;
+}
+
+/*	demand_zero_fault
+ *	DESCRIPTION: handles a page fault on a demand zero page by mapping a zeroed frame
+ *	Inputs:	faulting address
+ *	Outputs: none
+ *	Return value: 0 if the page is now mapped and the access can be retried, -1 if
+ *	the fault is a real one
+ */
+int32_t demand_zero_fault(uint32_t virt_addr) {
+	uint32_t phys_base;
+	pte_desc_t* entry;
+	if (virt_addr < USER_MAP_BASE || virt_addr >= USER_MAP_END) return -1;
+	if (!pd[virt_addr >> M_OFFSET].k_type.p) return -1;
+	entry = &user_page_table(virt_addr)[(virt_addr >> K_OFFSET) & TEN_BIT_MASK];
+	if (entry->p || !(entry->avail & PTE_DEMAND_ZERO)) return -1;
+	if (0 == (phys_base = alloc_frame())) return -1;
+	// alloc_frame already gave it the one reference the page table holds
+	entry->avail = 0;
+	entry->page_base_address = phys_base >> K_OFFSET;
+	entry->p = 1;
+	return 0;
+}
+
+/*	unmap_user_4k_page
+ *	DESCRIPTION: removes a 4k page mapped by map_user_4k_page, drops its frame reference
+ *	Inputs:	virt_base of page
+ *	Outputs: none
+ *	Return value: physical address that was mapped, 0 if nothing was mapped
+ */
+uint32_t unmap_user_4k_page(uint32_t virt_base) {
+	uint32_t phys_base = user_4k_page_phys(virt_base);
+	// never touched demand zero pages have nothing to give back
+	if (!phys_base) {
+		if (user_4k_page_used(virt_base)) user_page_table(virt_base)[(virt_base >> K_OFFSET) & TEN_BIT_MASK].val = 0;
+		return 0;
+	}
+	user_page_table(virt_base)[(virt_base >> K_OFFSET) & TEN_BIT_MASK].val = 0;
+	asm volatile ("invlpg (%0)" : : "r" (virt_base) : "memory");
+	put_frame(phys_base);
+	return phys_base;
+}
+
+/*	user_4k_page_phys
+ *	DESCRIPTION: looks up the frame behind a page in the user map range
+ *	Inputs:	virt_base of page
+ *	Outputs: none
+ *	Return value: physical address that is mapped, 0 if nothing is mapped
+ */
+uint32_t user_4k_page_phys(uint32_t virt_base) {
+	pte_desc_t* table;
+	if (virt_base < USER_MAP_BASE || virt_base >= USER_MAP_END) return 0;
+	if (!pd[virt_base >> M_OFFSET].k_type.p) return 0;
+	table = user_page_table(virt_base);
+	if (!table[(virt_base >> K_OFFSET) & TEN_BIT_MASK].p) return 0;
+	return table[(virt_base >> K_OFFSET) & TEN_BIT_MASK].page_base_address << K_OFFSET;
+}
+
+/*	user_4k_page_used
+ *	DESCRIPTION: checks if a page in the user map range is mapped or reserved
+ *	Inputs:	virt_base of page
+ *	Outputs: none
+ *	Return value: 1 if used, 0 if free
+ */
+int32_t user_4k_page_used(uint32_t virt_base) {
+	pte_desc_t* entry;
+	if (virt_base < USER_MAP_BASE || virt_base >= USER_MAP_END) return 0;
+	if (!pd[virt_base >> M_OFFSET].k_type.p) return 0;
+	entry = &user_page_table(virt_base)[(virt_base >> K_OFFSET) & TEN_BIT_MASK];
+	return (entry->p || (entry->avail & PTE_DEMAND_ZERO)) ? 1 : 0;
+}
+
+/*	find_user_range
+ *	DESCRIPTION: finds n unused pages in a row in the user map range, searching
+ *	down from the top so the heap can grow up from the bottom
+ *	Inputs:	number of pages
+ *	Outputs: none
+ *	Return value: virtual address of first page, 0 if there is no room
+ */
+uint32_t find_user_range(uint32_t n_pages) {
+	uint32_t virt, found;
+	if (n_pages == 0) return 0;
+	found = 0;
+	for (virt = USER_MAP_END - PAGE_SIZE_4K; virt >= USER_MAP_BASE; virt -= PAGE_SIZE_4K) {
+		if (user_4k_page_used(virt)) {
+			found = 0;
+			continue;
+		}
+		if (++found == n_pages) return virt;
+	}
+	return 0;
+}
+
+/*	release_user_pages
+ *	DESCRIPTION: unmaps everything in the user map range of the current task
+ *	and frees its page tables
+ *	Inputs:	none
+ *	Outputs: none
+ *	Return value: none
+ */
+void release_user_pages() {
+	uint32_t i, j;
+	pte_desc_t* table;
+	for (i = USER_MAP_BASE >> M_OFFSET; i < USER_MAP_END >> M_OFFSET; i++) {
+		if (!pd[i].k_type.p) continue;
+		table = (pte_desc_t*) (pd[i].k_type.page_table_base_address << K_OFFSET);
+		for (j = 0; j < PAGE_TABLE_SIZE; j++) {
+			if (table[j].p) put_frame(table[j].page_base_address << K_OFFSET);
+			table[j].val = 0;
+		}
+		put_frame((uint32_t)table);
+		pd[i].k_type.val = 0;
+	}
+	reload_page_directory();
+}
@@ -4,9 +4,16 @@
 #include "types.h"
 
 #define V_MEM_BASE   0x000B8000
-#define V_MEM_TERM_1 0x000B9000
-#define V_MEM_TERM_2 0x000BA000
-#define V_MEM_TERM_3 0x000BB000
+/* end of the VGA text window, the active terminal scrolls through all of it */
+#define V_MEM_END    0x000C0000
+
+#define PAGE_SIZE_4K     0x00001000
+/* physical 4k frames handed out by alloc_frame, identity mapped for the kernel only */
+#define FRAME_POOL_BASE  0x02000000
+#define FRAME_POOL_SIZE  0x01000000
+/* user virtual range where 4k pages can be mapped on demand */
+#define USER_MAP_BASE    0x08800000
+#define USER_MAP_END     0x10000000
 
 /*	init_kernel_page
  *	DESCRIPTION: Initialize the 4MB kernel page by setting all the proper bits
@@ -22,7 +29,7 @@ extern void init_kernel_page();
  *	Inputs:	none
  *	Outputs: none
  *	Return value: none
- *	Side Effects:	Initializes video memory, set all other pages to not present
+ *	Side Effects:	Maps the whole VGA text window, set all other pages to not present
  */
 extern void init_vidmem_pages();
 
@@ -75,4 +82,105 @@ extern void reload_page_directory();
 
 extern int32_t check_permission(uint32_t virt_addr);
 
+/*	init_frame_pool_pages
+ *	DESCRIPTION: identity maps the frame pool as supervisor 4MB pages
+ *	Inputs:	none
+ *	Outputs: none
+ *	Return value: none
+ *	Side Effects: kernel can read and write any frame from alloc_frame
+ */
+extern void init_frame_pool_pages();
+
+/*	alloc_frame
+ *	DESCRIPTION: takes a free 4k frame from the frame pool and zeroes it
+ *	Inputs:	none
+ *	Outputs: none
+ *	Return value: physical address of frame with one reference, 0 if pool is empty
+ */
+extern uint32_t alloc_frame();
+
+/*	get_frame
+ *	DESCRIPTION: adds a reference to a frame, frames outside the pool are ignored
+ *	Inputs:	physical address of frame
+ *	Outputs: none
+ *	Return value: none
+ */
+extern void get_frame(uint32_t phys_base);
+
+/*	put_frame
+ *	DESCRIPTION: drops a reference to a frame, frees it when none are left
+ *	Inputs:	physical address of frame
+ *	Outputs: none
+ *	Return value: none
+ */
+extern void put_frame(uint32_t phys_base);
+
+/*	map_user_4k_page
+ *	DESCRIPTION: maps a 4k page for the current task inside the user map range,
+ *	allocating its page table on demand, takes a reference on the frame
+ *	Inputs:	phys_base that virt_base is mapped to, 1 if writable
+ *	Outputs: none
+ *	Return value: 0 if success, -1 if fail
+ */
+extern int32_t map_user_4k_page(uint32_t phys_base, uint32_t virt_base, uint32_t rw);
+
+/*	unmap_user_4k_page
+ *	DESCRIPTION: removes a 4k page mapped by map_user_4k_page, drops its frame reference
+ *	Inputs:	virt_base of page
+ *	Outputs: none
+ *	Return value: physical address that was mapped, 0 if nothing was mapped
+ */
+extern uint32_t unmap_user_4k_page(uint32_t virt_base);
+
+/*	user_4k_page_phys
+ *	DESCRIPTION: looks up the frame behind a page in the user map range
+ *	Inputs:	virt_base of page
+ *	Outputs: none
+ *	Return value: physical address that is mapped, 0 if nothing is mapped
+ */
+extern uint32_t user_4k_page_phys(uint32_t virt_base);
+
+/*	reserve_user_4k_page
+ *	DESCRIPTION: marks a page in the user map range as demand zero, no frame is
+ *	used until the page is first touched
+ *	Inputs:	virt_base of page, 1 if writable
+ *	Outputs: none
+ *	Return value: 0 if success, -1 if fail
+ */
+extern int32_t reserve_user_4k_page(uint32_t virt_base, uint32_t rw);
+
+/*	demand_zero_fault
+ *	DESCRIPTION: handles a page fault on a demand zero page by mapping a zeroed frame
+ *	Inputs:	faulting address
+ *	Outputs: none
+ *	Return value: 0 if the access can be retried, -1 if the fault is a real one
+ */
+extern int32_t demand_zero_fault(uint32_t virt_addr);
+
+/*	user_4k_page_used
+ *	DESCRIPTION: checks if a page in the user map range is mapped or reserved
+ *	Inputs:	virt_base of page
+ *	Outputs: none
+ *	Return value: 1 if used, 0 if free
+ */
+extern int32_t user_4k_page_used(uint32_t virt_base);
+
+/*	find_user_range
+ *	DESCRIPTION: finds n unused pages in a row in the user map range, searching
+ *	down from the top so the heap can grow up from the bottom
+ *	Inputs:	number of pages
+ *	Outputs: none
+ *	Return value: virtual address of first page, 0 if there is no room
+ */
+extern uint32_t find_user_range(uint32_t n_pages);
+
+/*	release_user_pages
+ *	DESCRIPTION: unmaps everything in the user map range of the current task
+ *	and frees its page tables
+ *	Inputs:	none
+ *	Outputs: none
+ *	Return value: none
+ */
+extern void release_user_pages();
+
 #endif
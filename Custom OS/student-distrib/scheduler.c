@@ -5,11 +5,42 @@
 #include "paging.h"
 
 #define TASK_QUEUE_LENGTH 15
+#define SPAWN_CMD_LENGTH (ARG_MAX_LENGTH + 33)
 
 int32_t task_queue[TASK_QUEUE_LENGTH];
 int32_t head = 0;
 int32_t tail = 0;
 
+// channel each task is sleeping on, 0 if the task is not sleeping
+static void* sleep_chan[MAX_TASK];
+// set while the cpu has nothing to run, the pit should not switch tasks then
+static int32_t idling = 0;
+// ebp of a task that has ended, it will never be switched back to
+static uint32_t dead_ebp;
+// channel for tasks in poll, woken on any event a poll might be waiting for
+static int32_t poll_chan;
+// command for the task being spawned, copied so it survives the page directory change
+static uint8_t spawn_command[SPAWN_CMD_LENGTH];
+
+/*
+next_runnable
+Description: takes the next task off the front of the queue, if the queue is
+empty halts with interrupts on until an interrupt wakes something up
+Input: none
+Output: task id of next task
+*/
+static int32_t next_runnable() {
+    int32_t next_task;
+    idling = 1;
+    while (head == tail) {
+        asm volatile ("sti; hlt; cli");
+    }
+    idling = 0;
+    next_task = task_queue[head];
+    head = (head + 1) % TASK_QUEUE_LENGTH;
+    return next_task;
+}
+
 /*
 scheduler_isr_handler
 Description: moves on to next task in scheudler queue on PIT interrupt,
@@ -18,8 +49,12 @@ Input: none
 Output: none
 */
 void scheduler_isr_handler() {
+    // let tasks in poll check their timeouts
+    scheduler_poll_notify();
     // don't bother if there is only 1 task running.
     if (head == tail) return;
+    // current task is waiting for the queue in next_runnable, let it pick
+    if (idling) return;
     // critical section since we'll be changing task_queue
     cli();
     // get next task from front of queue
@@ -64,15 +99,126 @@ Input: none
 Output: none
 */
 void scheduler_remove_shell() {
-    int32_t next_task = task_queue[head];
-    head = (head + 1) % TASK_QUEUE_LENGTH;
+    int32_t next_task = next_runnable();
     // move on to next task without adding current task
     scheduler_next_ASM(&(current_task_pcb->sched_ebp), get_pcb(next_task)->sched_ebp);
 }
 
+/*
+scheduler_sleep
+Description: takes the current task off the cpu until scheduler_wake is called
+on the same channel, caller should have interrupts off while checking the
+condition it sleeps on so the wake up can't be missed
+Input: channel to sleep on, any address that identifies what is being waited for
+Output: none
+*/
+void scheduler_sleep(void* chan) {
+    int32_t this_task = current_task_id;
+    cli();
+    sleep_chan[this_task] = chan;
+    int32_t next_task = next_runnable();
+    // woken up while idling, this task is still on the cpu
+    if (next_task == this_task) return;
+    scheduler_next_ASM(&(current_task_pcb->sched_ebp), get_pcb(next_task)->sched_ebp);
+    // woken up and scheduled again, switch back to this task
+    change_task(this_task);
+    reload_page_directory();
+}
+
+/*
+scheduler_wake
+Description: puts every task sleeping on a channel at the back of the queue
+Input: channel to wake up
+Output: none
+*/
+void scheduler_wake(void* chan) {
+    int32_t i;
+    uint32_t flags;
+    cli_and_save(flags);
+    for (i = 0; i < MAX_TASK; i++) {
+        if (sleep_chan[i] != chan) continue;
+        sleep_chan[i] = 0;
+        task_queue[tail] = i;
+        tail = (tail + 1) % TASK_QUEUE_LENGTH;
+    }
+    restore_flags(flags);
+}
+
+/*
+scheduler_poll_wait
+Description: sleeps until the next event that could make a fd ready, or the next
+pit tick, callers re-check readiness and decide whether to sleep again
+Input: none
+Output: none
+*/
+void scheduler_poll_wait() {
+    scheduler_sleep(&poll_chan);
+}
+
+/*
+scheduler_poll_notify
+Description: wakes up every task in poll, drivers call this when a fd might
+have become ready
+Input: none
+Output: none
+*/
+void scheduler_poll_notify() {
+    scheduler_wake(&poll_chan);
+}
+
+/*
+scheduler_spawn
+Description: starts a program as a new background task on its own kernel stack,
+the current task goes to the back of the queue and keeps running later
+Input: command to execute
+Output: task id of the new task, -1 if there are no free tasks
+*/
+int32_t scheduler_spawn(const uint8_t* command) {
+    int32_t this_task = current_task_id;
+    uint32_t flags;
+    cli_and_save(flags);
+    int32_t task_num = peek_free_task();
+    if (task_num == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    strncpy((int8_t*)spawn_command, (int8_t*)command, SPAWN_CMD_LENGTH-1);
+    spawn_command[SPAWN_CMD_LENGTH-1] = '\0';
+    spawn_flag = 1;
+    // add currently operating task to the end of task queue
+    task_queue[tail] = current_task_id;
+    tail = (tail + 1) % TASK_QUEUE_LENGTH;
+    scheduler_spawn_ASM(&(current_task_pcb->sched_ebp), get_kernel_stack(task_num));
+    // returns here once the scheduler switches back to this task
+    change_task(this_task);
+    reload_page_directory();
+    restore_flags(flags);
+    return task_num;
+}
+
+/*
+scheduler_exit
+Description: leaves the current task forever, task should already be freed by exit_task
+Input: none
+Output: never returns
+*/
+void scheduler_exit() {
+    cli();
+    int32_t next_task = next_runnable();
+    scheduler_next_ASM(&dead_ebp, get_pcb(next_task)->sched_ebp);
+}
+
 /* shell_caller
 Description: Helper to call execute shell. 
 */
 void shell_caller() {
     execute((uint8_t*)"shell");
 }
+
+/* spawn_caller
+Description: Helper to call execute on the spawned command, execute never
+returns for background tasks
+*/
+void spawn_caller() {
+    execute(spawn_command);
+}
@@ -9,8 +9,22 @@ extern void scheduler_add_shell();
 
 extern void scheduler_remove_shell();
 
+extern void scheduler_sleep(void* chan);
+
+extern void scheduler_wake(void* chan);
+
+extern void scheduler_poll_wait();
+
+extern void scheduler_poll_notify();
+
+extern int32_t scheduler_spawn(const uint8_t* command);
+
+extern void scheduler_exit();
+
 void scheduler_next_ASM(uint32_t* this_ebp, uint32_t next_ebp);
 
 void scheduler_execute_ASM(uint32_t* this_ebp);
 
+void scheduler_spawn_ASM(uint32_t* this_ebp, uint32_t new_esp);
+
 #endif
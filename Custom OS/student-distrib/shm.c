@@ -0,0 +1,155 @@
+#include "shm.h"
+
+#include "lib.h"
+#include "paging.h"
+#include "tasks.h"
+
+typedef struct shm_mapping {
+    uint32_t used;
+    int32_t  id;
+    uint32_t addr;
+} shm_mapping_t;
+
+static shm_seg_t segs[MAX_SHM];
+// segments mapped by each task
+static shm_mapping_t task_maps[MAX_TASK][MAX_SHM_MAPS];
+
+/* shm_destroy
+Description: gives the frames of a segment back to the frame pool
+Input: segment id
+Output: none
+*/
+static void shm_destroy(int32_t id) {
+    uint32_t i;
+    for (i = 0; i < segs[id].n_pages; i++) {
+        put_frame(segs[id].frames[i]);
+    }
+    segs[id].used = 0;
+}
+
+/* shm_create
+Description: finds the segment with this key, creating it if it doesn't exist
+Input: key, size in bytes
+Output: segment id, -1 on fail
+*/
+int32_t shm_create(uint32_t key, uint32_t size) {
+    int32_t id, free_id;
+    uint32_t i, n_pages, flags;
+    n_pages = (size + PAGE_SIZE_4K - 1) / PAGE_SIZE_4K;
+    if (n_pages == 0 || n_pages > SHM_MAX_PAGES) return -1;
+    cli_and_save(flags);
+    free_id = -1;
+    for (id = 0; id < MAX_SHM; id++) {
+        if (!segs[id].used) {
+            if (free_id == -1) free_id = id;
+            continue;
+        }
+        // segment already exists, hand it out if it's big enough
+        if (segs[id].key == key) {
+            restore_flags(flags);
+            return (n_pages <= segs[id].n_pages) ? id : -1;
+        }
+    }
+    if (free_id == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    segs[free_id].used = 1;
+    segs[free_id].key = key;
+    segs[free_id].map_count = 0;
+    segs[free_id].creator = current_task_id;
+    segs[free_id].n_pages = 0;
+    for (i = 0; i < n_pages; i++) {
+        if (0 == (segs[free_id].frames[i] = alloc_frame())) {
+            shm_destroy(free_id);
+            restore_flags(flags);
+            return -1;
+        }
+        segs[free_id].n_pages++;
+    }
+    restore_flags(flags);
+    return free_id;
+}
+
+/* shm_map
+Description: maps a segment into the current task
+Input: segment id, page aligned address to map at, or 0 to let the kernel pick
+Output: address the segment is mapped at, -1 on fail
+*/
+int32_t shm_map(int32_t id, uint32_t addr) {
+    int32_t slot;
+    uint32_t i, flags;
+    if (id < 0 || id >= MAX_SHM || !segs[id].used) return -1;
+    cli_and_save(flags);
+    for (slot = 0; slot < MAX_SHM_MAPS; slot++) {
+        if (!task_maps[current_task_id][slot].used) break;
+    }
+    if (slot == MAX_SHM_MAPS) goto FAIL;
+    if (addr == 0) addr = find_user_range(segs[id].n_pages);
+    if (addr == 0) goto FAIL;
+    for (i = 0; i < segs[id].n_pages; i++) {
+        if (-1 == map_user_4k_page(segs[id].frames[i], addr + i*PAGE_SIZE_4K, 1)) {
+            // undo the pages already mapped
+            while (i-- > 0) unmap_user_4k_page(addr + i*PAGE_SIZE_4K);
+            goto FAIL;
+        }
+    }
+    task_maps[current_task_id][slot].used = 1;
+    task_maps[current_task_id][slot].id = id;
+    task_maps[current_task_id][slot].addr = addr;
+    segs[id].map_count++;
+    restore_flags(flags);
+    return addr;
+    FAIL:
+    restore_flags(flags);
+    return -1;
+}
+
+/* shm_unmap
+Description: removes a mapping made by shm_map, the segment is freed once no
+task has it mapped
+Input: address returned by shm_map
+Output: 0 on success, -1 on fail
+*/
+int32_t shm_unmap(uint32_t addr) {
+    int32_t slot, id;
+    uint32_t i, flags;
+    cli_and_save(flags);
+    for (slot = 0; slot < MAX_SHM_MAPS; slot++) {
+        if (task_maps[current_task_id][slot].used && task_maps[current_task_id][slot].addr == addr) break;
+    }
+    if (slot == MAX_SHM_MAPS) {
+        restore_flags(flags);
+        return -1;
+    }
+    id = task_maps[current_task_id][slot].id;
+    for (i = 0; i < segs[id].n_pages; i++) {
+        unmap_user_4k_page(addr + i*PAGE_SIZE_4K);
+    }
+    task_maps[current_task_id][slot].used = 0;
+    if (--segs[id].map_count == 0) shm_destroy(id);
+    restore_flags(flags);
+    return 0;
+}
+
+/* shm_release_task
+Description: removes every shm mapping of the current task, called when it ends,
+segments it made that nobody has mapped are freed
+Input: none
+Output: none
+*/
+void shm_release_task() {
+    int32_t slot, id;
+    uint32_t flags;
+    for (slot = 0; slot < MAX_SHM_MAPS; slot++) {
+        if (task_maps[current_task_id][slot].used) shm_unmap(task_maps[current_task_id][slot].addr);
+    }
+    // a segment never mapped would otherwise keep its frames forever
+    cli_and_save(flags);
+    for (id = 0; id < MAX_SHM; id++) {
+        if (!segs[id].used || segs[id].creator != current_task_id) continue;
+        segs[id].creator = -1;
+        if (segs[id].map_count == 0) shm_destroy(id);
+    }
+    restore_flags(flags);
+}
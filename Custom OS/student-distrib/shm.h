@@ -0,0 +1,51 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "types.h"
+
+#define MAX_SHM 8
+#define SHM_MAX_PAGES 64
+#define MAX_SHM_MAPS 4
+
+/* a shared memory segment, its frames stay allocated until the last
+ * mapping of it is removed, or its creator ends if it was never mapped */
+typedef struct shm_seg {
+    uint32_t used;
+    uint32_t key;       // user chosen name of the segment
+    uint32_t n_pages;
+    uint32_t map_count; // number of mappings in all tasks
+    int32_t  creator;   // task that made it, -1 once that task has ended
+    uint32_t frames[SHM_MAX_PAGES];
+} shm_seg_t;
+
+/* shm_create
+Description: finds the segment with this key, creating it if it doesn't exist
+Input: key, size in bytes
+Output: segment id, -1 on fail
+*/
+extern int32_t shm_create(uint32_t key, uint32_t size);
+
+/* shm_map
+Description: maps a segment into the current task
+Input: segment id, page aligned address to map at, or 0 to let the kernel pick
+Output: address the segment is mapped at, -1 on fail
+*/
+extern int32_t shm_map(int32_t id, uint32_t addr);
+
+/* shm_unmap
+Description: removes a mapping made by shm_map, the segment is freed once no
+task has it mapped
+Input: address returned by shm_map
+Output: 0 on success, -1 on fail
+*/
+extern int32_t shm_unmap(uint32_t addr);
+
+/* shm_release_task
+Description: removes every shm mapping of the current task, called when it ends,
+segments it made that nobody has mapped are freed
+Input: none
+Output: none
+*/
+extern void shm_release_task();
+
+#endif
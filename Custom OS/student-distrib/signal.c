@@ -0,0 +1,224 @@
+#include "signal.h"
+
+#include "lib.h"
+#include "x86_desc.h"
+#include "tasks.h"
+#include "syscall.h"
+
+// user programs run out of the 4MB program page
+#define USER_STACK_BASE 0x08000000
+#define USER_STACK_END  0x08400000
+#define USER_SPACE_END  0x10000000
+// flags a handler is allowed to hand back through sigreturn, CF PF AF ZF SF TF DF OF
+#define USER_EFLAGS 0x00000DD5
+#define EFLAGS_IF   0x00000200
+// status a task ends with when a signal kills it, same as an exception
+#define KILLED_STATUS 256
+
+// mov $10, %eax ; int $0x80 ; nop, copied onto the user stack to call sigreturn
+static const uint8_t sigreturn_code[8] = {0xB8, 0x0A, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90};
+
+/* user_signal_frame
+Description: what do_signal pushes on the user stack, the handler returns into code
+*/
+typedef struct user_signal_frame {
+    uint32_t ret_addr;  // points at code
+    uint32_t signum;
+    sig_context_t ctx;
+    uint8_t code[8];
+} __attribute__((packed)) user_signal_frame_t;
+
+/* default_kills
+Description: gets the default action of a signal
+Input: signal number
+Output: 1 if the task is ended, 0 if the signal is ignored
+*/
+static int32_t default_kills(int32_t signum) {
+    return signum == SIG_DIV_ZERO || signum == SIG_SEGFAULT || signum == SIG_INTERRUPT;
+}
+
+/* set_handler
+Description: sets the user function called for a signal
+Input: signal number, handler address, 0 for the default action
+Output: 0 on success, -1 on fail
+*/
+int32_t set_handler(int32_t signum, void* handler_address) {
+    uint32_t addr = (uint32_t)handler_address;
+    if (signum < 0 || signum >= NUM_SIGNALS) return -1;
+    if (addr != 0 && (addr < USER_STACK_BASE || addr >= USER_SPACE_END)) return -1;
+    current_task_pcb->sig_handler[signum] = addr;
+    return 0;
+}
+
+/* sigreturn
+Description: puts back the registers saved when the handler was called
+Input: none
+Output: eax of the interrupted program
+*/
+int32_t sigreturn(void) {
+    // the syscall that got us here saved the handler's registers at the top of the kernel stack
+    iret_frame_t* frame = (iret_frame_t*)(tss.esp0 - sizeof(iret_frame_t));
+    pushal_regs_t* regs = (pushal_regs_t*)frame - 1;
+    // handler already returned past ret_addr, so esp is at signum
+    sig_context_t* ctx = (sig_context_t*)(frame->esp + sizeof(uint32_t));
+    if (!current_task_pcb->sig_masked) return -1;
+    if ((uint32_t)ctx < USER_STACK_BASE || (uint32_t)ctx > USER_STACK_END - sizeof(sig_context_t)) return -1;
+    regs->ebx = ctx->ebx;
+    regs->ecx = ctx->ecx;
+    regs->edx = ctx->edx;
+    regs->esi = ctx->esi;
+    regs->edi = ctx->edi;
+    regs->ebp = ctx->ebp;
+    // never let a handler pick its own segments or privileged flags
+    frame->eip = ctx->eip;
+    frame->esp = ctx->esp;
+    frame->eflags = (frame->eflags & ~USER_EFLAGS) | (ctx->eflags & USER_EFLAGS) | EFLAGS_IF;
+    current_task_pcb->sig_masked = 0;
+    return ctx->eax;
+}
+
+/* alarm
+Description: sends ALARM to the current task every ms milliseconds
+Input: period in ms, 0 turns it off
+Output: previous period
+*/
+int32_t alarm(uint32_t ms) {
+    uint32_t flags;
+    int32_t old;
+    cli_and_save(flags);
+    old = current_task_pcb->alarm_period;
+    current_task_pcb->alarm_period = ms;
+    current_task_pcb->alarm_left = ms;
+    restore_flags(flags);
+    return old;
+}
+
+/* send_signal
+Description: marks a signal pending, it is acted on when the task next returns to user mode
+Input: task number, signal number
+Output: 0 on success, -1 on fail
+*/
+int32_t send_signal(int32_t task_num, int32_t signum) {
+    uint32_t flags;
+    if (signum < 0 || signum >= NUM_SIGNALS) return -1;
+    if (task_state(task_num) != TASK_RUNNING) return -1;
+    cli_and_save(flags);
+    get_pcb(task_num)->sig_pending |= (1 << signum);
+    restore_flags(flags);
+    return 0;
+}
+
+/* signal_exception
+Description: turns an exception in a user program into a signal if it has a handler
+Input: exception number
+Output: 1 if a signal will be delivered, 0 if the program should be ended
+*/
+int32_t signal_exception(uint32_t irq) {
+    int32_t signum = (irq == 0) ? SIG_DIV_ZERO : SIG_SEGFAULT;
+    // returning would just fault again, so a fault inside a handler ends the task
+    if (current_task_pcb->sig_masked || current_task_pcb->sig_handler[signum] == 0) return 0;
+    current_task_pcb->sig_pending |= (1 << signum);
+    return 1;
+}
+
+/* signal_interrupt
+Description: sends INTERRUPT to what is running in the foreground of a terminal,
+background children of the foreground task get it instead if there are any,
+the shell at the root of the terminal never gets it
+Input: terminal id
+Output: none
+*/
+void signal_interrupt(int32_t terminal_id) {
+    int32_t i, j, fg = -1, sent = 0;
+    pcb_t* pcb;
+    // foreground task is the one no other foreground task is waiting on
+    for (i = 1; i < MAX_TASK && fg == -1; i++) {
+        pcb = get_pcb(i);
+        if (task_state(i) != TASK_RUNNING || pcb->background || pcb->terminal_id != terminal_id) continue;
+        fg = i;
+        for (j = 1; j < MAX_TASK; j++) {
+            if (task_state(j) == TASK_RUNNING && !get_pcb(j)->background && get_pcb(j)->parent_task_id == i) {
+                fg = -1;
+                break;
+            }
+        }
+    }
+    if (fg == -1) return;
+    for (i = 1; i < MAX_TASK; i++) {
+        pcb = get_pcb(i);
+        if (task_state(i) == TASK_RUNNING && pcb->background && pcb->parent_task_id == fg) {
+            send_signal(i, SIG_INTERRUPT);
+            sent = 1;
+        }
+    }
+    if (!sent && get_pcb(fg)->parent_task_id != 0) send_signal(fg, SIG_INTERRUPT);
+}
+
+/* signal_tick
+Description: counts down alarms, called from the pit every tick
+Input: ms since the last tick
+Output: none
+*/
+void signal_tick(uint32_t ms) {
+    int32_t i;
+    pcb_t* pcb;
+    for (i = 1; i < MAX_TASK; i++) {
+        pcb = get_pcb(i);
+        if (task_state(i) != TASK_RUNNING || pcb->alarm_period == 0) continue;
+        if (pcb->alarm_left > ms) {
+            pcb->alarm_left -= ms;
+            continue;
+        }
+        pcb->alarm_left = pcb->alarm_period;
+        pcb->sig_pending |= (1 << SIG_ALARM);
+    }
+}
+
+/* do_signal
+Description: acts on pending signals right before returning to user mode, either
+ends the task or builds a frame on the user stack and sends the program into its handler
+Input: registers and iret frame on the kernel stack
+Output: none
+*/
+void do_signal(pushal_regs_t* regs, iret_frame_t* frame) {
+    pcb_t* pcb = current_task_pcb;
+    user_signal_frame_t* uframe;
+    int32_t signum;
+    // only on the way back to a user program
+    if (current_task_id == 0 || (frame->cs & 0x3) != 0x3) return;
+    while (!pcb->sig_masked && pcb->sig_pending) {
+        for (signum = 0; !(pcb->sig_pending & (1 << signum)); signum++);
+        pcb->sig_pending &= ~(1 << signum);
+        if (pcb->sig_handler[signum] == 0) {
+            if (default_kills(signum)) end_program(KILLED_STATUS, get_exit_ebp(pcb));
+            continue;
+        }
+        uframe = (user_signal_frame_t*)((frame->esp & ~0x3) - sizeof(user_signal_frame_t));
+        // no room on the user stack, nothing sensible to return to
+        if ((uint32_t)uframe < USER_STACK_BASE || frame->esp > USER_STACK_END) {
+            end_program(KILLED_STATUS, get_exit_ebp(pcb));
+        }
+        memcpy(uframe->code, sigreturn_code, sizeof(sigreturn_code));
+        uframe->ctx.ebx = regs->ebx;
+        uframe->ctx.ecx = regs->ecx;
+        uframe->ctx.edx = regs->edx;
+        uframe->ctx.esi = regs->esi;
+        uframe->ctx.edi = regs->edi;
+        uframe->ctx.ebp = regs->ebp;
+        uframe->ctx.eax = regs->eax;
+        uframe->ctx.ds = uframe->ctx.es = uframe->ctx.fs = USER_DS;
+        uframe->ctx.err = signum;
+        uframe->ctx.eip = frame->eip;
+        uframe->ctx.cs = frame->cs;
+        uframe->ctx.eflags = frame->eflags;
+        uframe->ctx.esp = frame->esp;
+        uframe->ctx.ss = frame->ss;
+        uframe->signum = signum;
+        uframe->ret_addr = (uint32_t)uframe->code;
+        frame->eip = pcb->sig_handler[signum];
+        frame->esp = (uint32_t)uframe;
+        // everything waits until the handler calls sigreturn
+        pcb->sig_masked = 1;
+        return;
+    }
+}
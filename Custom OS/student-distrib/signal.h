@@ -0,0 +1,89 @@
+#ifndef SIGNAL_H
+#define SIGNAL_H
+
+#include "types.h"
+
+/* signal numbers, same as enum signums in ece391syscall.h */
+#define SIG_DIV_ZERO  0
+#define SIG_SEGFAULT  1
+#define SIG_INTERRUPT 2
+#define SIG_ALARM     3
+#define SIG_USER1     4
+#define NUM_SIGNALS   5
+
+/* registers saved by pushal on entry to the kernel */
+typedef struct pushal_regs {
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+} __attribute__((packed)) pushal_regs_t;
+
+/* pushed by the cpu on an interrupt from user mode */
+typedef struct iret_frame {
+    uint32_t eip, cs, eflags, esp, ss;
+} __attribute__((packed)) iret_frame_t;
+
+/* what a handler finds on its stack right after signum, so it can look at
+ * and change the registers of the interrupted program */
+typedef struct sig_context {
+    uint32_t ebx, ecx, edx, esi, edi, ebp, eax;
+    uint32_t ds, es, fs;
+    uint32_t err;
+    uint32_t eip, cs, eflags, esp, ss;
+} __attribute__((packed)) sig_context_t;
+
+/* set_handler
+Description: sets the user function called for a signal
+Input: signal number, handler address, 0 for the default action
+Output: 0 on success, -1 on fail
+*/
+extern int32_t set_handler(int32_t signum, void* handler_address);
+
+/* sigreturn
+Description: puts back the registers saved when the handler was called
+Input: none
+Output: eax of the interrupted program
+*/
+extern int32_t sigreturn(void);
+
+/* alarm
+Description: sends ALARM to the current task every ms milliseconds
+Input: period in ms, 0 turns it off
+Output: previous period
+*/
+extern int32_t alarm(uint32_t ms);
+
+/* send_signal
+Description: marks a signal pending, it is acted on when the task next returns to user mode
+Input: task number, signal number
+Output: 0 on success, -1 on fail
+*/
+extern int32_t send_signal(int32_t task_num, int32_t signum);
+
+/* signal_exception
+Description: turns an exception in a user program into a signal if it has a handler
+Input: exception number
+Output: 1 if a signal will be delivered, 0 if the program should be ended
+*/
+extern int32_t signal_exception(uint32_t irq);
+
+/* signal_interrupt
+Description: sends INTERRUPT to what is running in the foreground of a terminal
+Input: terminal id
+Output: none
+*/
+extern void signal_interrupt(int32_t terminal_id);
+
+/* signal_tick
+Description: counts down alarms, called from the pit every tick
+Input: ms since the last tick
+Output: none
+*/
+extern void signal_tick(uint32_t ms);
+
+/* do_signal
+Description: acts on pending signals right before returning to user mode
+Input: registers and iret frame on the kernel stack
+Output: none
+*/
+extern void do_signal(pushal_regs_t* regs, iret_frame_t* frame);
+
+#endif
@@ -5,16 +5,39 @@
 #include "paging.h"
 #include "tasks.h"
 #include "scheduler.h"
+#include "shm.h"
+#include "vfs.h"
 
 #include "drivers/fs.h"
 #include "drivers/term.h"
 #include "drivers/rtc.h"
+#include "drivers/pipe.h"
+#include "drivers/pit.h"
 
 #define PROGRAM_IMAGE_VIRT_BASE 0x08000000
 #define PROGRAM_IMAGE_PHYS_BASE 0x00800000
 #define PROGRAM_IMAGE_SIZE      0x00400000
 #define PROGRAM_IMAGE_OFFSET    0x00048000
 
+// open stdin and stdout handed to the next task started by spawn
+static file_desc_t* spawn_stdio[2];
+
+/* release_task_memory
+Description: drops every 4k user mapping of the current task, shared
+segments are detached first so their counts stay right, a vidmap is let go
+Input: none
+Output: none
+*/
+static void release_task_memory() {
+    shm_release_task();
+    release_user_pages();
+    // the terminal's screen can be switched without copying every row again
+    if (terms[current_task_pcb->terminal_id]._vidmap_task == current_task_id) terms[current_task_pcb->terminal_id]._vidmap_task = 0;
+    current_task_pcb->io_ring_addr = 0;
+    current_task_pcb->heap_brk = 0;
+    memset(current_task_pcb->mmap_regions, 0, sizeof(current_task_pcb->mmap_regions));
+}
+
 /* halt
 Description: ends currently executing program and return to previous program
 Input: status
@@ -24,9 +47,9 @@ int32_t halt (uint8_t status){
     cli();
     int i;
     // close all files
-    for (i = 2; i < 8; i++) {close(i);}
-    // handle closing extra terminals
-    if (current_task_pcb->parent_task_id == 0) {
+    for (i = 2; i < current_task_pcb->fd_max; i++) {close(i);}
+    // handle closing extra terminals, background tasks are never a terminal's shell
+    if (current_task_pcb->parent_task_id == 0 && !current_task_pcb->background) {
         // find a terminal we can switch to
         int next_term_id;
         next_term_id = -1;
@@ -38,6 +61,7 @@ int32_t halt (uint8_t status){
         if (next_term_id != -1) {
             // set this terminal as not started
             terms[current_task_pcb->terminal_id]._started = 0;
+            release_task_memory();
             change_term(next_term_id);
             // remove task from task arr
             delete_task();
@@ -46,7 +70,7 @@ int32_t halt (uint8_t status){
         }
     }
     // pass exit ebp and status code
-    end_program((uint32_t)status, get_pcb(current_task_pcb->parent_task_id)->exec_ebp);
+    end_program((uint32_t)status, get_exit_ebp(current_task_pcb));
     // should never get here
     return -1;
 }
@@ -68,9 +92,9 @@ int32_t execute (const uint8_t* command) {
     // strip leading spaces from args
     while(command[i] == ' ') i++;
     j = i;
-    while(command[j] != ' ' && command[j] != 0 && j < 32 + i) {j++;}
+    while(command[j] != ' ' && command[j] != 0 && j < FS_PATH_LENGTH + i) {j++;}
     // copy program name
-    uint8_t program_name[32];
+    uint8_t program_name[FS_PATH_LENGTH + 1];
     strncpy((int8_t*)program_name, (int8_t*)(&command[i]), j-i);
     program_name[j-i] = 0;
 
@@ -87,14 +111,16 @@ int32_t execute (const uint8_t* command) {
     disable_all_pages();
     init_kernel_page();
     init_vidmem_pages();
+    init_frame_pool_pages();
     // map program image page
     map_4m_page(PROGRAM_IMAGE_PHYS_BASE + (PROGRAM_IMAGE_SIZE*(current_task_id-1)), PROGRAM_IMAGE_VIRT_BASE);
     reload_page_directory();
 
     // check if program exists
+    if (-1 == set_fd(2, &fs_op_table, 0, 0, FD_OPEN)) {exit_status = -1; goto EXIT;}
     if (-1 == file_open(2, program_name)) {exit_status = -1; goto EXIT;}
-    // check if "program" is rtc or .
-    if (current_task_pcb->fd_arr[2].inode == 0) {exit_status = -1; goto EXIT;}
+    // check if "program" is rtc or a directory
+    if (fs_is_dir(fd_file(2)->inode)) {exit_status = -1; goto EXIT;}
     // load program image into new page, read all 4mb if can, file read will cut off by itself
     uint8_t* program_image_start = (uint8_t*) (PROGRAM_IMAGE_VIRT_BASE+PROGRAM_IMAGE_OFFSET);
     if (-1 == file_read(2, (void*)program_image_start, PROGRAM_IMAGE_SIZE)) {exit_status = -1; goto EXIT;}
@@ -107,11 +133,17 @@ int32_t execute (const uint8_t* command) {
         }
     }
     // update file directory, open stdin and stdout, close others
-    set_fd(0, stdin_op_table, 0, 0, 1);
-    set_fd(1, stdout_op_table, 0, 0, 1);
-    term_open(0, (uint8_t*)"term");
-    for (i = 2; i < 8; i++) {
-        set_fd(i, 0, 0, 0, 0);
+    fd_close(2);
+    if (current_task_pcb->background) {
+        // background tasks share the open stdin and stdout passed to spawn
+        for (i = 0; i < 2; i++) {
+            fd_install(i, spawn_stdio[i]);
+        }
+    }
+    else {
+        if (-1 == set_fd(0, &stdin_op_table, 0, 0, FD_OPEN)) {exit_status = -1; goto EXIT;}
+        if (-1 == set_fd(1, &stdout_op_table, 0, 0, FD_OPEN)) {exit_status = -1; goto EXIT;}
+        term_open(0, (uint8_t*)"term");
     }
     // set entry point as 32bit from bytes 24-27
     uint32_t entry_addr = *((uint32_t*)(program_image_start+24));
@@ -122,13 +154,26 @@ int32_t execute (const uint8_t* command) {
         // new terminals should not override exec_ebp of task 0, override so the ebp is saved to a useless location
         start_program(entry_addr, &(current_task_pcb->exec_ebp));
     }
+    // nobody is waiting in execute for background tasks, return to this execute instead
+    else if (current_task_pcb->background) {
+        exit_status = start_program(entry_addr, &(current_task_pcb->spawn_ebp));
+    }
     else {
         do {
             exit_status = start_program(entry_addr, &(get_pcb(current_task_pcb->parent_task_id)->exec_ebp));
+            release_task_memory();
         } while (current_task_pcb->parent_task_id == 0); // keep restarting if parent is 0 "kernel"
     }
     // returned from program, clean up task, and reload pd
     EXIT:
+        fd_close_all();
+        release_task_memory();
+        orphan_children(current_task_id);
+        // background task, let the parent reap it and never come back
+        if (current_task_pcb->background) {
+            exit_task(exit_status);
+            scheduler_exit();
+        }
         delete_task();
         reload_page_directory();
         return exit_status;
@@ -141,13 +186,12 @@ Input: arguements
 Output: none
 */
 int32_t read(int32_t fd, void* buf, int32_t nbytes) {
-    // check fd in bound
-    if (fd < 0 || fd > 7) return -1;
-    // return fail if file is not open
-    if (current_task_pcb->fd_arr[fd].flags == 0) return -1;
+    // return fail if fd is out of range or file is not open
+    file_desc_t* file = fd_file(fd);
+    if (!file) return -1;
     // get function pointer for read function
     int32_t (*func) (int32_t, void*, int32_t);
-    func = (int32_t (*)(int32_t, void*, int32_t)) current_task_pcb->fd_arr[fd].file_op_table_ptr[FILE_OP_READ];
+    func = file->file_op_table_ptr->read;
     // invoke function
     return func(fd, buf, nbytes);
 }
@@ -159,13 +203,12 @@ Input: arguements
 Output: none
 */
 int32_t write (int32_t fd, const void* buf, int32_t nbytes) {
-    // filter fd to between 0 and 7, (8 fd max)
-    if (fd < 0 || fd > 7) return -1;
-    // return fail if file is not open
-    if (current_task_pcb->fd_arr[fd].flags == 0) return -1;
+    // return fail if fd is out of range or file is not open
+    file_desc_t* file = fd_file(fd);
+    if (!file) return -1;
     // get pointer for write function
     int32_t (*func) (int32_t, const void*, int32_t);
-    func = (int32_t (*)(int32_t, const void*, int32_t)) current_task_pcb->fd_arr[fd].file_op_table_ptr[FILE_OP_WRITE];
+    func = file->file_op_table_ptr->write;
     // invoke function
     return func(fd, buf, nbytes);
 }
@@ -176,33 +219,27 @@ Input: arguements
 Output: fd of opened file,
 */
 int32_t open (const uint8_t* filename) {
-    // filter fd to between 0 and 7, (8 fd max)
-    int32_t fd;
-    for (fd = 2; fd < 9; fd++) {
-        // no fd available
-        if (fd == 8) return -1;
-        // found available fd
-        if ((current_task_pcb->fd_arr[fd]).flags == 0) break;
-    }
-    // check if opening rtc, if so set op table
-    if (strncmp((int8_t*) filename, (int8_t*) "rtc", 3) == 0) {
-        set_fd(fd, rtc_op_table, 0, 0, 0);
-    }
-    // else opening a fs file, set op table
-    else {
-        set_fd(fd, fs_op_table, 0, 0, 0);
-    }
-    // get pointer for open function
-    int32_t (*func) (int32_t, const uint8_t*);
-    func = (int32_t (*)(int32_t, const uint8_t*)) current_task_pcb->fd_arr[fd].file_op_table_ptr[FILE_OP_OPEN];
-    // invoke function, set flag to present if successful, and return
-    int32_t ret = func(fd, filename);
-    if (ret == 0) {
-        current_task_pcb->fd_arr[fd].flags = 1;
+    return open_flags(filename, 0);
+}
+
+/* open_flags
+Description: open with flags for the new fd
+Input: filename, flags, FD_NONBLOCK makes reads and writes fail instead of blocking,
+FD_CREATE makes the file if it doesn't exist, FD_TRUNC empties it
+Output: fd of opened file, -1 on fail
+*/
+int32_t open_flags (const uint8_t* filename, int32_t flags) {
+    // lowest free fd, the table grows if it is full
+    int32_t fd = fd_alloc(2);
+    if (fd == -1) return -1;
+    // the filesystem mounted at the path, or the device, sets up the file
+    if (vfs_open(fd, filename, flags & (FD_CREATE | FD_TRUNC)) == 0) {
+        fd_file(fd)->flags = FD_OPEN | (flags & FD_NONBLOCK);
         return fd;
     }
-    else return -1;
-
+    // never opened, so this just empties the fd
+    fd_close(fd);
+    return -1;
 }
 
 /* open
@@ -213,17 +250,11 @@ Output: none
 */
 int32_t close (int32_t fd) {
     // dont allow closing stdin stdout
-    // filter fd to between 0 and 7, (8 fd max)
-    if (fd < 2 || fd > 7) return -1;
+    if (fd < 2) return -1;
     // return fail if file is not open
-    if (current_task_pcb->fd_arr[fd].flags == 0) return -1;
-    // get pointer for close function
-    int32_t (*func) (int32_t);
-    func = (int32_t (*)(int32_t)) current_task_pcb->fd_arr[fd].file_op_table_ptr[FILE_OP_CLOSE];
-    // invoke function, clear flag if successful
-    int32_t ret = func(fd);
-    if (ret == 0) {(current_task_pcb->fd_arr[fd]).flags = 0;}
-    return ret;
+    if (!fd_file(fd)) return -1;
+    // driver close only runs once no other fd uses the open file
+    return fd_close(fd);
 }
 
 /* get args
@@ -249,8 +280,428 @@ Effects: maps virtual addr screen_start to physical vmem
 int32_t vidmap (uint8_t** screen_start) {
     // check to see if permission level is 1 for this address
     if (check_permission((uint32_t)screen_start) < 1) return -1;
-    // map video mem physical page to same location after the user program page
-    map_4k_page(V_MEM_BASE, PROGRAM_IMAGE_VIRT_BASE+PROGRAM_IMAGE_SIZE+V_MEM_BASE);
+    // map the terminal's screen page to same location after the user program page
+    map_4k_page(term_vidmap_page(current_task_pcb->terminal_id), PROGRAM_IMAGE_VIRT_BASE+PROGRAM_IMAGE_SIZE+V_MEM_BASE);
     *screen_start = (uint8_t*) PROGRAM_IMAGE_VIRT_BASE+PROGRAM_IMAGE_SIZE+V_MEM_BASE;
     return 0;
 }
+
+/* pipe
+Description: creates a pipe, and opens its read and write end in the current task
+Input: fds, array of 2 to put the read end and write end fd into
+Output: 0 on success, -1 on fail
+*/
+int32_t pipe (int32_t* fds) {
+    return pipe_flags(fds, 0);
+}
+
+/* pipe_flags
+Description: pipe with flags for both ends
+Input: fds, array of 2 to put the read end and write end fd into, flags,
+FD_NONBLOCK makes reads of an empty pipe and writes to a full one fail instead of blocking
+Output: 0 on success, -1 on fail
+*/
+int32_t pipe_flags (int32_t* fds, int32_t flags) {
+    int32_t read_fd, write_fd, pipe_id;
+    if (check_permission((uint32_t)fds) < 1) return -1;
+    // hold 2 fds with files that aren't open yet, closing those needs no pipe
+    if (-1 == (read_fd = fd_alloc(2))) return -1;
+    if (-1 == set_fd(read_fd, &pipe_read_op_table, 0, 0, 0)) return -1;
+    if (-1 == (write_fd = fd_alloc(2)) || -1 == set_fd(write_fd, &pipe_write_op_table, 0, 0, 0)) {
+        fd_close(read_fd);
+        return -1;
+    }
+    if (-1 == (pipe_id = pipe_alloc())) {
+        fd_close(read_fd);
+        fd_close(write_fd);
+        return -1;
+    }
+    set_fd(read_fd, &pipe_read_op_table, pipe_id, 0, FD_OPEN | (flags & FD_NONBLOCK));
+    set_fd(write_fd, &pipe_write_op_table, pipe_id, 0, FD_OPEN | (flags & FD_NONBLOCK));
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+    return 0;
+}
+
+/* spawn
+Description: starts a program in the background, running alongside the current task
+Input: command, fd of the current task to use as its stdin, and as its stdout
+Output: task id of the new task to pass to wait, -1 on fail
+*/
+int32_t spawn (const uint8_t* command, int32_t in_fd, int32_t out_fd) {
+    int32_t ret;
+    uint32_t flags;
+    if (check_permission((uint32_t)command) < 1) return -1;
+    if (!fd_file(in_fd) || !fd_file(out_fd)) return -1;
+    // spawn_stdio is shared, don't let another task spawn in between
+    cli_and_save(flags);
+    spawn_stdio[0] = fd_file(in_fd);
+    spawn_stdio[1] = fd_file(out_fd);
+    ret = scheduler_spawn(command);
+    restore_flags(flags);
+    return ret;
+}
+
+/* wait
+Description: blocks until a task started by spawn ends
+Input: task id returned by spawn
+Output: exit status like execute, -1 if not a spawned child of this task
+*/
+int32_t wait (int32_t task_num) {
+    return reap_task(task_num);
+}
+
+/* isatty
+Description: checks if a fd is the terminal
+Input: fd
+Output: 1 if terminal, 0 if not, -1 if fd is not open
+*/
+int32_t isatty (int32_t fd) {
+    if (!fd_file(fd)) return -1;
+    return term_is_tty(fd_file(fd)->file_op_table_ptr);
+}
+
+/* poll
+Description: waits until one of the fds is ready for the events asked for,
+or the timeout runs out
+Input: array of pollfd, number of entries, timeout in ms, -1 to wait forever, 0 to not wait
+Output: number of entries with revents set, 0 on timeout, -1 on fail
+*/
+int32_t poll (pollfd_t* fds, int32_t nfds, int32_t timeout) {
+    int32_t i, ready;
+    uint32_t flags, deadline;
+    int32_t (*func) (int32_t);
+    if (nfds < 0 || nfds > FD_TABLE_MAX) return -1;
+    if (nfds > 0 && check_permission((uint32_t)fds) < 1) return -1;
+    if (nfds > 0 && check_permission((uint32_t)(fds + nfds) - 1) < 1) return -1;
+    deadline = pit_ticks + (timeout + PIT_MS_PER_TICK - 1) / PIT_MS_PER_TICK;
+    // check and sleep with interrupts off so a wake up can't be missed
+    cli_and_save(flags);
+    while (1) {
+        ready = 0;
+        for (i = 0; i < nfds; i++) {
+            fds[i].revents = 0;
+            if (!fd_file(fds[i].fd)) {
+                fds[i].revents = POLLNVAL;
+            }
+            else {
+                func = fd_file(fds[i].fd)->file_op_table_ptr->poll;
+                // hang ups are always reported
+                fds[i].revents = func(fds[i].fd) & (fds[i].events | POLLHUP);
+            }
+            if (fds[i].revents) ready++;
+        }
+        if (ready || timeout == 0) break;
+        if (timeout > 0 && (int32_t)(pit_ticks - deadline) >= 0) break;
+        scheduler_poll_wait();
+    }
+    restore_flags(flags);
+    return ready;
+}
+
+/* mmap_record
+Description: keeps a region handed out by mmap so munmap can check against it
+Input: first page, number of pages, inode mapped or -1 for anonymous memory
+Output: 0 on success, -1 if the task has no free region slots
+*/
+static int32_t mmap_record(uint32_t addr, uint32_t n_pages, int32_t inode) {
+    int32_t i;
+    for (i = 0; i < MAX_MMAP; i++) {
+        if (current_task_pcb->mmap_regions[i].addr == 0) {
+            current_task_pcb->mmap_regions[i].addr = addr;
+            current_task_pcb->mmap_regions[i].n_pages = n_pages;
+            current_task_pcb->mmap_regions[i].inode = inode;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* mmap
+Description: maps a file read only into the current task, pages point straight
+at the filesystem image so nothing is copied, fd -1 maps anonymous memory instead
+that is filled with zeros the first time each page is touched
+Input: fd of an open file or -1, number of bytes to map, 0 for the whole file
+Output: address the file is mapped at, -1 on fail
+*/
+int32_t mmap (int32_t fd, uint32_t length) {
+    uint32_t i, n_pages, virt_base, block_addr, phys_base;
+    int32_t file_len;
+    if (fd == -1) {
+        if (length == 0 || length > USER_MAP_END - USER_MAP_BASE) return -1;
+        n_pages = (length + PAGE_SIZE_4K - 1) / PAGE_SIZE_4K;
+        if (0 == (virt_base = find_user_range(n_pages))) return -1;
+        for (i = 0; i < n_pages; i++) {
+            if (-1 == reserve_user_4k_page(virt_base + i*PAGE_SIZE_4K, 1)) goto FAIL;
+        }
+        if (-1 == mmap_record(virt_base, n_pages, -1)) goto FAIL;
+        return virt_base;
+    }
+    if (fd < 2 || !fd_file(fd)) return -1;
+    // only regular files in the image can be mapped
+    if (fd_file(fd)->file_op_table_ptr != &fs_op_table) return -1;
+    if (fs_is_dir(fd_file(fd)->inode)) return -1;
+    file_len = file_length(fd_file(fd)->inode);
+    if (file_len <= 0) return -1;
+    if (length == 0 || length > (uint32_t)file_len) length = file_len;
+    n_pages = (length + PAGE_SIZE_4K - 1) / PAGE_SIZE_4K;
+    if (0 == (virt_base = find_user_range(n_pages))) return -1;
+    for (i = 0; i < n_pages; i++) {
+        // a block from the buffer cache comes with a reference, so it stays if evicted
+        block_addr = file_block_addr(fd_file(fd)->inode, i);
+        if (block_addr == 0) goto FAIL;
+        phys_base = block_addr;
+        // image is page aligned by the boot loader, copy if it somehow isn't
+        if (block_addr & (PAGE_SIZE_4K-1)) {
+            if (0 != (phys_base = alloc_frame())) memcpy((void*)phys_base, (void*)block_addr, PAGE_SIZE_4K);
+            put_frame(block_addr);
+            if (phys_base == 0) goto FAIL;
+        }
+        if (-1 == map_user_4k_page(phys_base, virt_base + i*PAGE_SIZE_4K, 0)) {
+            put_frame(phys_base);
+            goto FAIL;
+        }
+        // page table holds its own reference now
+        put_frame(phys_base);
+    }
+    if (-1 == mmap_record(virt_base, n_pages, fd_file(fd)->inode)) goto FAIL;
+    return virt_base;
+    FAIL:
+    while (i-- > 0) unmap_user_4k_page(virt_base + i*PAGE_SIZE_4K);
+    return -1;
+}
+
+/* munmap
+Description: removes pages mapped by mmap, the range has to be inside one
+region mmap handed out, so the heap, shm segments and the io ring are left alone
+Input: address in a region from mmap, number of bytes to unmap
+Output: 0 on success, -1 on fail
+*/
+int32_t munmap (uint32_t addr, uint32_t length) {
+    mmap_region_t* r;
+    uint32_t virt, end, r_end;
+    int32_t i;
+    if (addr & (PAGE_SIZE_4K-1)) return -1;
+    if (length == 0 || addr + length < addr) return -1;
+    end = (addr + length + PAGE_SIZE_4K - 1) & ~(PAGE_SIZE_4K - 1);
+    for (i = 0; i < MAX_MMAP; i++) {
+        r = &current_task_pcb->mmap_regions[i];
+        r_end = r->addr + r->n_pages * PAGE_SIZE_4K;
+        if (r->addr != 0 && addr >= r->addr && end <= r_end) break;
+    }
+    if (i == MAX_MMAP) return -1;
+    // a hole in the middle leaves two regions
+    if (addr > r->addr && end < r_end) {
+        if (-1 == mmap_record(end, (r_end - end) / PAGE_SIZE_4K, r->inode)) return -1;
+    }
+    for (virt = addr; virt < end; virt += PAGE_SIZE_4K) {
+        unmap_user_4k_page(virt);
+    }
+    // keep what is left in front, or else what is left behind
+    if (addr > r->addr) r->n_pages = (addr - r->addr) / PAGE_SIZE_4K;
+    else if (end < r_end) {
+        r->n_pages = (r_end - end) / PAGE_SIZE_4K;
+        r->addr = end;
+    }
+    else r->addr = 0;
+    return 0;
+}
+
+/* sbrk
+Description: grows or shrinks the heap, which starts at the bottom of the user
+map range, new pages are demand zero so only touched pages use frames
+Input: bytes to add to the heap, negative to give back
+Output: old end of the heap, -1 on fail
+*/
+int32_t sbrk (int32_t increment) {
+    uint32_t old_brk, new_brk, virt, old_top, new_top;
+    if (current_task_pcb->heap_brk == 0) current_task_pcb->heap_brk = USER_MAP_BASE;
+    old_brk = current_task_pcb->heap_brk;
+    new_brk = old_brk + increment;
+    if (increment > 0 && (new_brk < old_brk || new_brk > USER_MAP_END)) return -1;
+    if (increment < 0 && (new_brk > old_brk || new_brk < USER_MAP_BASE)) return -1;
+    // pages the heap covers before and after
+    old_top = (old_brk + PAGE_SIZE_4K - 1) & ~(PAGE_SIZE_4K - 1);
+    new_top = (new_brk + PAGE_SIZE_4K - 1) & ~(PAGE_SIZE_4K - 1);
+    for (virt = old_top; virt < new_top; virt += PAGE_SIZE_4K) {
+        // ran into an mmap or shm mapping
+        if (-1 == reserve_user_4k_page(virt, 1)) {
+            while (virt > old_top) {
+                virt -= PAGE_SIZE_4K;
+                unmap_user_4k_page(virt);
+            }
+            return -1;
+        }
+    }
+    for (virt = new_top; virt < old_top; virt += PAGE_SIZE_4K) {
+        unmap_user_4k_page(virt);
+    }
+    current_task_pcb->heap_brk = new_brk;
+    return old_brk;
+}
+
+/* sendfile
+Description: copies from a file to another fd inside the kernel, the write op
+of the output is handed the filesystem blocks directly so no user buffer is used
+Input: fd to write to, fd of an open file to read from, max bytes to send
+Output: bytes sent, -1 on fail
+*/
+int32_t sendfile (int32_t out_fd, int32_t in_fd, int32_t count) {
+    uint32_t inode, pos, block_addr, off, n;
+    int32_t file_len, ret, sent = 0;
+    int32_t (*func) (int32_t, const void*, int32_t);
+    file_desc_t* in = fd_file(in_fd);
+    if (in_fd < 2 || !in || !fd_file(out_fd)) return -1;
+    if (count < 0) return -1;
+    // the input has to be a regular file in the image
+    if (in->file_op_table_ptr != &fs_op_table) return -1;
+    inode = in->inode;
+    if (fs_is_dir(inode)) return -1;
+    if (-1 == (file_len = file_length(inode))) return -1;
+    func = fd_file(out_fd)->file_op_table_ptr->write;
+    while (sent < count) {
+        pos = in->file_position;
+        if (pos >= (uint32_t)file_len) break;
+        if (0 == (block_addr = file_block_addr(inode, pos / BLOCK_SIZE))) break;
+        // send up to the end of this block at a time
+        off = pos % BLOCK_SIZE;
+        n = BLOCK_SIZE - off;
+        if (n > (uint32_t)file_len - pos) n = file_len - pos;
+        if (n > (uint32_t)(count - sent)) n = count - sent;
+        ret = func(out_fd, (const void*)(block_addr + off), n);
+        put_frame(block_addr);
+        if (ret == -1) break;
+        // terminal returns 0 for a full write, pipes return the bytes taken
+        if (ret > 0 && (uint32_t)ret < n) {
+            in->file_position += ret;
+            sent += ret;
+            break;
+        }
+        in->file_position += n;
+        sent += n;
+    }
+    if (sent == 0 && count > 0 && in->file_position < (uint32_t)file_len) return -1;
+    return sent;
+}
+
+/* dup
+Description: makes a new fd pointing at the same open file, both share the position
+Input: fd to copy
+Output: lowest free fd, -1 on fail
+*/
+int32_t dup (int32_t fd) {
+    int32_t new_fd;
+    if (!fd_file(fd)) return -1;
+    if (-1 == (new_fd = fd_alloc(0))) return -1;
+    if (-1 == fd_install(new_fd, fd_file(fd))) return -1;
+    return new_fd;
+}
+
+/* dup2
+Description: points new_fd at the open file of fd, closing whatever new_fd had open
+Input: fd to copy, fd to copy into
+Output: new_fd, -1 on fail
+*/
+int32_t dup2 (int32_t fd, int32_t new_fd) {
+    file_desc_t* file = fd_file(fd);
+    if (!file || new_fd < 0 || new_fd >= FD_TABLE_MAX) return -1;
+    if (fd == new_fd) return new_fd;
+    if (fd_file(new_fd)) fd_close(new_fd);
+    if (-1 == fd_install(new_fd, file)) return -1;
+    return new_fd;
+}
+
+/* truncate
+Description: sets the length of an open file, growing it adds bytes that read as 0
+Input: fd, new length
+Output: 0 on success, -1 on fail or if the file can't be resized
+*/
+int32_t truncate (int32_t fd, uint32_t length) {
+    file_desc_t* file = fd_file(fd);
+    if (fd < 2 || !file || !file->file_op_table_ptr->truncate) return -1;
+    return file->file_op_table_ptr->truncate(fd, length);
+}
+
+/* unlink
+Description: removes a file by name, open fds keep working until they are closed
+Input: path of the file
+Output: 0 on success, -1 on fail
+*/
+int32_t unlink (const uint8_t* filename) {
+    return vfs_unlink(filename);
+}
+
+/* mkdir
+Description: makes an empty directory
+Input: path of the directory
+Output: 0 on success, -1 on fail
+*/
+int32_t mkdir (const uint8_t* path) {
+    return vfs_mkdir(path);
+}
+
+/* getdents
+Description: reads as many entries of an open directory as fit in buf, names
+come with their type, inode and size so nothing else has to be opened
+Input: fd of a directory, buffer, size of buffer
+Output: bytes filled with dirent_t, 0 at the end, -1 on fail
+*/
+int32_t getdents (int32_t fd, void* buf, int32_t nbytes) {
+    file_desc_t* file = fd_file(fd);
+    if (!file || nbytes < 0 || !file->file_op_table_ptr->getdents) return -1;
+    if (nbytes > 0 && check_permission((uint32_t)buf) < 1) return -1;
+    if (nbytes > 0 && ((uint32_t)buf + nbytes - 1 < (uint32_t)buf || check_permission((uint32_t)buf + nbytes - 1) < 1)) return -1;
+    return file->file_op_table_ptr->getdents(fd, buf, nbytes);
+}
+
+/* stat
+Description: gets the type, inode, size and block count of a path without opening it
+Input: path, where to put the stat
+Output: 0 on success, -1 on fail
+*/
+int32_t stat (const uint8_t* path, stat_t* st) {
+    if (check_permission((uint32_t)path) < 1) return -1;
+    if (check_permission((uint32_t)st) < 1 || check_permission((uint32_t)(st + 1) - 1) < 1) return -1;
+    return vfs_stat(path, st);
+}
+
+/* fstat
+Description: gets the type, inode, size and block count of an open file,
+terminals, pipes and devices show up as devices with no size
+Input: fd, where to put the stat
+Output: 0 on success, -1 on fail
+*/
+int32_t fstat (int32_t fd, stat_t* st) {
+    file_desc_t* file = fd_file(fd);
+    if (!file) return -1;
+    if (check_permission((uint32_t)st) < 1 || check_permission((uint32_t)(st + 1) - 1) < 1) return -1;
+    if (file->file_op_table_ptr->fstat) return file->file_op_table_ptr->fstat(fd, st);
+    memset(st, 0, sizeof(stat_t));
+    st->type = DIRENT_DEVICE;
+    return 0;
+}
+
+/* lseek
+Description: moves the position of an open file, past the end is allowed and
+a write there fills the gap with 0, directories can only go back to the start
+Input: fd, offset, SEEK_SET, SEEK_CUR or SEEK_END to add the offset to
+Output: new position, -1 on fail or if the fd can't be seeked
+*/
+int32_t lseek (int32_t fd, int32_t offset, int32_t whence) {
+    file_desc_t* file = fd_file(fd);
+    stat_t st;
+    uint32_t base;
+    if (fd < 2 || !file || !file->file_op_table_ptr->fstat) return -1;
+    if (-1 == file->file_op_table_ptr->fstat(fd, &st)) return -1;
+    // directory positions count entries, not bytes
+    if (st.type != DIRENT_FILE && !(whence == SEEK_SET && offset == 0)) return -1;
+    if (whence == SEEK_SET) base = 0;
+    else if (whence == SEEK_CUR) base = file->file_position;
+    else if (whence == SEEK_END) base = st.size;
+    else return -1;
+    if (offset < 0 && (uint32_t)(-offset) > base) return -1;
+    // the new position has to fit in the return value
+    if (offset > 0 && base + offset > 0x7FFFFFFF) return -1;
+    file->file_position = base + offset;
+    return file->file_position;
+}
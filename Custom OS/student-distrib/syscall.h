@@ -2,6 +2,13 @@
 #define SYSCALL_H
 
 #include "types.h"
+#include "vfs.h"
+
+typedef struct pollfd {
+    int32_t  fd;
+    uint16_t events;  // POLLIN, POLLOUT wanted
+    uint16_t revents; // events that are ready
+} __attribute__((packed)) pollfd_t;
 
 /* Entry for system call */
 extern int32_t system_call_entry();
@@ -14,6 +21,26 @@ extern int32_t open (const uint8_t* filename);
 extern int32_t close (int32_t fd);
 extern int32_t getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t vidmap (uint8_t** screen_start);
+extern int32_t pipe (int32_t* fds);
+extern int32_t spawn (const uint8_t* command, int32_t in_fd, int32_t out_fd);
+extern int32_t wait (int32_t task_num);
+extern int32_t isatty (int32_t fd);
+extern int32_t poll (pollfd_t* fds, int32_t nfds, int32_t timeout);
+extern int32_t open_flags (const uint8_t* filename, int32_t flags);
+extern int32_t mmap (int32_t fd, uint32_t length);
+extern int32_t munmap (uint32_t addr, uint32_t length);
+extern int32_t sendfile (int32_t out_fd, int32_t in_fd, int32_t count);
+extern int32_t sbrk (int32_t increment);
+extern int32_t dup (int32_t fd);
+extern int32_t dup2 (int32_t fd, int32_t new_fd);
+extern int32_t truncate (int32_t fd, uint32_t length);
+extern int32_t unlink (const uint8_t* filename);
+extern int32_t mkdir (const uint8_t* path);
+extern int32_t getdents (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t stat (const uint8_t* path, stat_t* st);
+extern int32_t fstat (int32_t fd, stat_t* st);
+extern int32_t lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t pipe_flags (int32_t* fds, int32_t flags);
 
 int32_t start_program(uint32_t entry_addr, uint32_t* exit_ebp_ptr);
 int32_t end_program(uint32_t exit_status, uint32_t exit_ebp);
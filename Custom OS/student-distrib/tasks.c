@@ -1,18 +1,29 @@
 #include "tasks.h"
 #include "types.h"
 #include "x86_desc.h"
+#include "lib.h"
+#include "scheduler.h"
+#include "paging.h"
 #include "drivers/term.h"
 
 #define EIGHT_KB 0x00002000
 #define KERNEL_TOP 0x00400000
 #define KERNEL_BOTTOM 0x00800000
+// background tasks keep their execute frame at the top of their own kernel stack,
+// so interrupts from user mode must start below it
+#define SPAWN_STACK_RESERVE 0x00000400
 
 // task 0 will be occupied by the kernel itself
 int32_t current_task_id = 0;
-pcb_t* current_task_pcb = (pcb_t*)(KERNEL_BOTTOM - EIGHT_KB + 1);
+pcb_t* current_task_pcb = (pcb_t*)(KERNEL_BOTTOM - EIGHT_KB);
 
 int32_t task_arr[MAX_TASK] = {1,0,0,0,0,0,0};
+int32_t task_exit_status[MAX_TASK];
+// open files of every task, descriptors point into here
+static file_desc_t open_files[MAX_OPEN_FILES];
 int32_t num_open_tasks = 1;
+// let tasking know the next task is started by spawn, 0 means no, 1 means yes
+int32_t spawn_flag = 0;
 
 /* new_task
 Description: allocated task id for new tasks, changes into that task
@@ -28,20 +39,33 @@ int32_t new_task() {
     // allow up to max task
     if (task_num >= MAX_TASK) return -1;
     // mark this task as being used
-    task_arr[task_num] = 1;
+    task_arr[task_num] = TASK_RUNNING;
     num_open_tasks++;
     int parent_id = current_task_id;
-    change_task(task_num);
+    pcb_t* pcb = get_pcb(task_num);
     // if new terminal, set parent task as kernel
     if (new_term_flag != -1) {
-        current_task_pcb->parent_task_id = 0;
-        current_task_pcb->terminal_id = new_term_flag;
+        pcb->parent_task_id = 0;
+        pcb->terminal_id = new_term_flag;
     }
     // else, set parent task to previous task, and set terminal to parent's terminal
     else {
-        current_task_pcb->parent_task_id = parent_id;
-        current_task_pcb->terminal_id = get_pcb(parent_id)->terminal_id;
+        pcb->parent_task_id = parent_id;
+        pcb->terminal_id = get_pcb(parent_id)->terminal_id;
     }
+    pcb->background = spawn_flag;
+    spawn_flag = 0;
+    pcb->io_ring_addr = 0;
+    pcb->heap_brk = 0;
+    memset(pcb->mmap_regions, 0, sizeof(pcb->mmap_regions));
+    memset(pcb->sig_handler, 0, sizeof(pcb->sig_handler));
+    pcb->sig_pending = pcb->sig_masked = 0;
+    pcb->alarm_period = pcb->alarm_left = 0;
+    // stale descriptors from the last task in this slot should never be closed
+    pcb->fd_table = pcb->fd_small;
+    pcb->fd_max = FD_TABLE_INIT;
+    memset(pcb->fd_small, 0, sizeof(pcb->fd_small));
+    change_task(task_num);
     return current_task_id;
 }
 
@@ -52,7 +76,7 @@ Output: current task (parent)
 */
 int32_t delete_task() {
     // free up this task
-    task_arr[current_task_id] = 0;
+    task_arr[current_task_id] = TASK_FREE;
     num_open_tasks--;
     // change to its parent
     change_task(current_task_pcb->parent_task_id);
@@ -66,26 +90,272 @@ Output: 0 if successful, -1 if fail
 */
 int32_t change_task(uint32_t task_num) {
     current_task_id = task_num;
-    current_task_pcb = (pcb_t*) (KERNEL_BOTTOM - (task_num * EIGHT_KB) - EIGHT_KB + 1);
+    current_task_pcb = (pcb_t*) (KERNEL_BOTTOM - (task_num * EIGHT_KB) - EIGHT_KB);
     tss.esp0 = KERNEL_BOTTOM - (task_num * EIGHT_KB);
+    if (task_num != 0 && current_task_pcb->background) tss.esp0 -= SPAWN_STACK_RESERVE;
     return 0;
 }
 
 /* set_fd
-Description: set the parameters of the current pcb
-Input: none
+Description: set the parameters of the open file behind a fd of the current task,
+a new open file is made if the fd is empty
+Input: fd, op table, inode, position, flags
 Output: 0 if successful, -1 if fail
 */
-int32_t set_fd(int32_t fd, int32_t** file_op_table_ptr, uint32_t inode, uint32_t file_position, uint32_t flags) {
-    // filter fd to between 0 and 7, (8 fd max)
-    if (fd < 0 || fd > 7) return -1;
-    (current_task_pcb->fd_arr[fd]).file_op_table_ptr = file_op_table_ptr;
-    (current_task_pcb->fd_arr[fd]).inode = inode;
-    (current_task_pcb->fd_arr[fd]).file_position = file_position;
-    (current_task_pcb->fd_arr[fd]).flags = flags;
+int32_t set_fd(int32_t fd, file_operations_t* file_op_table_ptr, uint32_t inode, uint32_t file_position, uint32_t flags) {
+    int32_t i;
+    uint32_t save;
+    file_desc_t* file;
+    if (fd < 0 || fd >= current_task_pcb->fd_max) return -1;
+    if (!(file = current_task_pcb->fd_table[fd])) {
+        cli_and_save(save);
+        for (i = 0; i < MAX_OPEN_FILES; i++) {
+            if (open_files[i].refcount == 0) break;
+        }
+        if (i == MAX_OPEN_FILES) {
+            restore_flags(save);
+            return -1;
+        }
+        file = &open_files[i];
+        file->refcount = 1;
+        current_task_pcb->fd_table[fd] = file;
+        restore_flags(save);
+    }
+    file->file_op_table_ptr = file_op_table_ptr;
+    file->inode = inode;
+    file->file_position = file_position;
+    file->flags = flags;
+    return 0;
+}
+
+/* fd_file
+Description: gets the open file behind a fd of the current task
+Input: fd
+Output: open file, 0 if fd is out of range or not open
+*/
+file_desc_t* fd_file(int32_t fd) {
+    if (fd < 0 || fd >= current_task_pcb->fd_max) return 0;
+    return current_task_pcb->fd_table[fd];
+}
+
+/* grow_fd_table
+Description: moves the fd table of the current task out of the pcb into its
+own frame, which has room for FD_TABLE_MAX descriptors
+Input: none
+Output: 0 if successful, -1 if already grown or out of frames
+*/
+static int32_t grow_fd_table() {
+    file_desc_t** table;
+    if (current_task_pcb->fd_max != FD_TABLE_INIT) return -1;
+    if (0 == (table = (file_desc_t**)alloc_frame())) return -1;
+    memcpy(table, current_task_pcb->fd_small, sizeof(current_task_pcb->fd_small));
+    current_task_pcb->fd_table = table;
+    current_task_pcb->fd_max = FD_TABLE_MAX;
+    return 0;
+}
+
+/* fd_alloc
+Description: finds the lowest empty fd of the current task, growing the table if it is full
+Input: lowest fd to hand out
+Output: fd, -1 if there are no empty fds
+*/
+int32_t fd_alloc(int32_t lowest) {
+    int32_t fd;
+    for (fd = lowest; fd < FD_TABLE_MAX; fd++) {
+        if (fd >= current_task_pcb->fd_max && -1 == grow_fd_table()) return -1;
+        if (!current_task_pcb->fd_table[fd]) return fd;
+    }
+    return -1;
+}
+
+/* fd_install
+Description: points an empty fd of the current task at an open file, taking a reference
+Input: fd, open file
+Output: 0 if successful, -1 if fd is out of range or in use
+*/
+int32_t fd_install(int32_t fd, file_desc_t* file) {
+    uint32_t flags;
+    if (fd < 0 || fd >= FD_TABLE_MAX) return -1;
+    if (fd >= current_task_pcb->fd_max && -1 == grow_fd_table()) return -1;
+    if (current_task_pcb->fd_table[fd]) return -1;
+    cli_and_save(flags);
+    file->refcount++;
+    current_task_pcb->fd_table[fd] = file;
+    restore_flags(flags);
     return 0;
 }
 
+/* fd_close
+Description: empties a fd of the current task, the open file is closed by its
+driver once no fd in any task points at it
+Input: fd
+Output: return of the driver close, 0 if other fds still use the file, -1 if not open
+*/
+int32_t fd_close(int32_t fd) {
+    file_desc_t* file = fd_file(fd);
+    int32_t ret = 0;
+    uint32_t flags;
+    if (!file) return -1;
+    cli_and_save(flags);
+    // files that never finished opening have nothing for the driver to close
+    if (file->refcount == 1 && (file->flags & FD_OPEN)) {
+        // terminal is shared with the parent, leave its keyboard state alone
+        if (!term_is_tty(file->file_op_table_ptr)) {
+            ret = file->file_op_table_ptr->close(fd);
+        }
+        file->flags = 0;
+    }
+    file->refcount--;
+    current_task_pcb->fd_table[fd] = 0;
+    restore_flags(flags);
+    return ret;
+}
+
+/* fd_close_all
+Description: closes every fd of the current task and gives back a grown table
+Input: none
+Output: none
+*/
+void fd_close_all() {
+    int32_t fd;
+    for (fd = 0; fd < current_task_pcb->fd_max; fd++) {
+        if (current_task_pcb->fd_table[fd]) fd_close(fd);
+    }
+    if (current_task_pcb->fd_table != current_task_pcb->fd_small) {
+        put_frame((uint32_t)current_task_pcb->fd_table);
+        current_task_pcb->fd_table = current_task_pcb->fd_small;
+        current_task_pcb->fd_max = FD_TABLE_INIT;
+    }
+}
+
+/* get_pcb
+Description: gets the pcb at the bottom of a task's kernel stack
+Input: task number
+Output: pointer to pcb
+*/
 pcb_t* get_pcb(int32_t task_num) {
-    return (pcb_t*) (KERNEL_BOTTOM - (task_num * EIGHT_KB) - EIGHT_KB + 1);
+    return (pcb_t*) (KERNEL_BOTTOM - (task_num * EIGHT_KB) - EIGHT_KB);
+}
+
+/* get_exit_ebp
+Description: gets the ebp a task jumps to when it ends, background tasks
+return to their own execute, foreground tasks return to their parent's
+Input: pcb of task that is ending
+Output: ebp to pass to end_program
+*/
+uint32_t get_exit_ebp(pcb_t* pcb) {
+    if (pcb->background) return pcb->spawn_ebp;
+    return get_pcb(pcb->parent_task_id)->exec_ebp;
+}
+
+/* get_kernel_stack
+Description: gets the top of a task's kernel stack
+Input: task number
+Output: address just past the top of the stack
+*/
+uint32_t get_kernel_stack(int32_t task_num) {
+    return KERNEL_BOTTOM - (task_num * EIGHT_KB);
+}
+
+/* peek_free_task
+Description: finds the task id new_task will hand out next without taking it
+Input: none
+Output: task id, -1 if all tasks are used
+*/
+int32_t peek_free_task() {
+    int task_num;
+    for (task_num = 1; task_num < MAX_TASK; task_num++) {
+        if (task_arr[task_num] == TASK_FREE) return task_num;
+    }
+    return -1;
+}
+
+/* task_state
+Description: gets the state of a task slot
+Input: task number
+Output: TASK_FREE, TASK_RUNNING or TASK_ZOMBIE, -1 if out of range
+*/
+int32_t task_state(int32_t task_num) {
+    if (task_num <= 0 || task_num >= MAX_TASK) return -1;
+    return task_arr[task_num];
+}
+
+/* exit_task
+Description: ends the current background task, keeps its exit status around
+as a zombie until the parent reaps it, or frees it right away if it has no parent
+Input: exit status
+Output: 0
+Effect: wakes up anything waiting on this task, does not change the current task
+*/
+int32_t exit_task(int32_t status) {
+    task_exit_status[current_task_id] = status;
+    if (current_task_pcb->parent_task_id == 0) {
+        task_arr[current_task_id] = TASK_FREE;
+        num_open_tasks--;
+    }
+    else {
+        task_arr[current_task_id] = TASK_ZOMBIE;
+    }
+    scheduler_wake(&task_arr[current_task_id]);
+    return 0;
+}
+
+/* reap_task
+Description: waits for a background child of the current task to end, then frees it
+Input: task number of child
+Output: exit status of child, -1 if not a child of the current task
+*/
+int32_t reap_task(int32_t task_num) {
+    uint32_t flags;
+    int32_t status;
+    if (task_state(task_num) <= TASK_FREE) return -1;
+    if (!get_pcb(task_num)->background || get_pcb(task_num)->parent_task_id != current_task_id) return -1;
+    // check and sleep with interrupts off so the wake up can't be missed
+    cli_and_save(flags);
+    while (task_arr[task_num] == TASK_RUNNING) {
+        scheduler_sleep(&task_arr[task_num]);
+    }
+    status = task_exit_status[task_num];
+    task_arr[task_num] = TASK_FREE;
+    num_open_tasks--;
+    restore_flags(flags);
+    return status;
+}
+
+/* orphan_children
+Description: hands background children of an ending task to the kernel,
+zombies are freed, running children free themselves when they end
+Input: task number of ending task
+Output: none
+*/
+void orphan_children(int32_t task_num) {
+    int32_t i;
+    for (i = 1; i < MAX_TASK; i++) {
+        if (task_arr[i] == TASK_FREE || i == task_num) continue;
+        if (!get_pcb(i)->background || get_pcb(i)->parent_task_id != task_num) continue;
+        if (task_arr[i] == TASK_ZOMBIE) {
+            task_arr[i] = TASK_FREE;
+            num_open_tasks--;
+        }
+        else {
+            get_pcb(i)->parent_task_id = 0;
+        }
+    }
+}
+
+/* task_maps_inode
+Description: checks if a running task has part of a file mapped with mmap, its
+pages are the file's blocks so they can't be freed under it
+Input: inode
+Output: 1 if mapped, 0 if not
+*/
+int32_t task_maps_inode(uint32_t inode) {
+    int32_t i, j;
+    for (i = 1; i < MAX_TASK; i++) {
+        if (task_arr[i] != TASK_RUNNING) continue;
+        for (j = 0; j < MAX_MMAP; j++) {
+            if (get_pcb(i)->mmap_regions[j].addr && get_pcb(i)->mmap_regions[j].inode == (int32_t)inode) return 1;
+        }
+    }
+    return 0;
 }
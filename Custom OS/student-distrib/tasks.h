@@ -2,44 +2,102 @@
 #define TASKS_H
 
 #include "types.h"
+#include "signal.h"
+#include "vfs.h"
 
 #define MAX_TASK 7
+#define FD_TABLE_INIT 8     // descriptor slots built into the pcb
+#define FD_TABLE_MAX 1024   // descriptor slots once the table grows into its own frame
+#define MAX_OPEN_FILES 128  // open files shared by all tasks
 #define ARG_MAX_LENGTH 128
-#define FILE_OP_OPEN 0
-#define FILE_OP_READ 1
-#define FILE_OP_WRITE 2
-#define FILE_OP_CLOSE 3
+#define MAX_MMAP 16         // regions from mmap a task can have at once
 
+/* file_desc_t flags */
+#define FD_OPEN 0x1
+#define FD_NONBLOCK 0x2
+#define FD_CREATE 0x4 // only seen by open, makes the file if it doesn't exist
+#define FD_TRUNC 0x8  // only seen by open, empties the file
+#define FD_WRITTEN 0x10 // set by file_write, close writes the cache back to the disk
+
+/* readiness bits returned by the poll operation */
+#define POLLIN 0x1
+#define POLLOUT 0x2
+#define POLLHUP 0x4
+#define POLLNVAL 0x8
+
+#define TASK_FREE 0
+#define TASK_RUNNING 1
+#define TASK_ZOMBIE 2
+
+/* an open file, descriptors in any task point at it and share its position */
 typedef struct file_desc {
-    int32_t** file_op_table_ptr;
+    file_operations_t* file_op_table_ptr;
     uint32_t inode;
     uint32_t file_position;
-    uint32_t flags; // 1 if open, 0 if closed
+    uint32_t flags; // FD_OPEN if open, 0 if closed, plus FD_NONBLOCK
+    uint32_t refcount; // descriptors pointing at this, free when 0
 } __attribute__((packed)) file_desc_t;
 
+/* pages handed out by one mmap, munmap only takes pages inside one of these */
+typedef struct mmap_region {
+    uint32_t addr;    // first page, 0 if the slot is free
+    uint32_t n_pages;
+    int32_t inode;    // file mapped, -1 for anonymous memory
+} __attribute__((packed)) mmap_region_t;
+
+/* sits at the 8KB aligned bottom of a task's kernel stack, members stay 4 byte
+ * aligned so the scheduler and execute can take the address of the ebps */
 typedef struct pcb {
-    file_desc_t fd_arr[8]; // file descriptors
+    file_desc_t** fd_table; // file descriptors, fd_small until more are needed
+    uint32_t fd_max;        // number of slots in fd_table
+    file_desc_t* fd_small[FD_TABLE_INIT];
 
     uint32_t parent_task_id; // id of parent task to return to
     uint32_t sched_ebp; // ebp for scheduler to save/return to
     uint32_t exec_ebp;  // ebp for execute/halt to return to
+    uint32_t spawn_ebp; // ebp for a background task to return to its own execute
+    uint32_t background; // 1 if started by spawn, nobody is blocked in execute on it
+    uint32_t io_ring_addr; // user address of the io ring page, 0 if io_setup wasn't called
+    uint32_t heap_brk;     // end of the heap made by sbrk, 0 if sbrk wasn't called
+    mmap_region_t mmap_regions[MAX_MMAP]; // what mmap has handed out
+
+    uint32_t sig_handler[NUM_SIGNALS]; // user handler for each signal, 0 for the default action
+    uint32_t sig_pending; // bit for each signal waiting to be delivered
+    uint32_t sig_masked;  // 1 while a handler runs, cleared by sigreturn
+    uint32_t alarm_period; // ms between ALARM signals, 0 if off
+    uint32_t alarm_left;   // ms until the next ALARM
 
     uint32_t terminal_id; // terminal this task is running under
 
     uint8_t args[ARG_MAX_LENGTH]; // args 
     uint8_t args_length;
-} __attribute__((packed)) pcb_t;
+} __attribute__((packed, aligned(4))) pcb_t;
 
 extern int32_t current_task_id;
 extern pcb_t*  current_task_pcb;
 extern int32_t num_open_tasks;
+extern int32_t spawn_flag;
 
 extern int32_t new_task();
 extern int32_t delete_task();
 extern int32_t change_task(uint32_t task_num);
 
 extern pcb_t* get_pcb(int32_t task_num);
+extern uint32_t get_exit_ebp(pcb_t* pcb);
+extern uint32_t get_kernel_stack(int32_t task_num);
+
+extern int32_t peek_free_task();
+extern int32_t task_state(int32_t task_num);
+extern int32_t exit_task(int32_t status);
+extern int32_t reap_task(int32_t task_num);
+extern void orphan_children(int32_t task_num);
+extern int32_t task_maps_inode(uint32_t inode);
 
-extern int32_t set_fd(int32_t fd, int32_t** file_op_table_ptr, uint32_t inode, uint32_t file_position, uint32_t flags);
+extern int32_t set_fd(int32_t fd, file_operations_t* file_op_table_ptr, uint32_t inode, uint32_t file_position, uint32_t flags);
+extern file_desc_t* fd_file(int32_t fd);
+extern int32_t fd_alloc(int32_t lowest);
+extern int32_t fd_install(int32_t fd, file_desc_t* file);
+extern int32_t fd_close(int32_t fd);
+extern void fd_close_all();
 
 #endif
@@ -0,0 +1,224 @@
+#include "vfs.h"
+
+#include "lib.h"
+#include "tasks.h"
+#include "bcache.h"
+
+#include "drivers/fs.h"
+#include "drivers/rtc.h"
+#include "drivers/term.h"
+#include "drivers/tmpfs.h"
+
+typedef struct device {
+    uint8_t name[DEV_NAME_LENGTH];
+    file_operations_t* fops; // 0 if slot is empty
+} device_t;
+
+static int32_t devfs_open(int32_t fd, const uint8_t* filename);
+static int32_t devfs_unavail();
+static int32_t devfs_stat(const uint8_t* filename, stat_t* st);
+
+file_operations_t devfs_op_table = {devfs_open, devfs_unavail, devfs_unavail, devfs_unavail, devfs_unavail, 0, 0, 0, 0, devfs_stat};
+
+// open addressed by name hash
+static device_t devices[DEV_HASH_SIZE];
+static int32_t num_devices = 0;
+static mount_t mounts[MAX_MOUNTS];
+
+/* name_hash
+Description: hashes a device name, djb2
+Input: name
+Output: slot to start probing at
+*/
+static uint32_t name_hash(const uint8_t* name) {
+    uint32_t hash = 5381;
+    while (*name) hash = hash * 33 + *name++;
+    return hash & (DEV_HASH_SIZE - 1);
+}
+
+/* vfs_init
+Description: registers the built in devices and mounts the boot filesystem at /
+the devices at /dev and scratch files at /tmp
+Input: none
+Output: none
+*/
+void vfs_init() {
+    vfs_register_device((uint8_t*)"rtc", &rtc_op_table);
+    vfs_register_device((uint8_t*)"tty", &tty_op_table);
+    vfs_register_device((uint8_t*)"bcache", &bcache_op_table);
+    vfs_mount((uint8_t*)"/", &fs_op_table);
+    vfs_mount((uint8_t*)"/dev", &devfs_op_table);
+    vfs_mount((uint8_t*)"/tmp", &tmpfs_op_table);
+}
+
+/* vfs_register_device
+Description: adds a device that can be opened as /dev/name
+Input: name, operations of the device
+Output: 0 on success, -1 if the name is taken or the table is full
+*/
+int32_t vfs_register_device(const uint8_t* name, file_operations_t* fops) {
+    uint32_t i, slot;
+    if (num_devices == MAX_DEVICES || strlen((int8_t*)name) >= DEV_NAME_LENGTH) return -1;
+    if (vfs_find_device(name)) return -1;
+    slot = name_hash(name);
+    for (i = 0; i < DEV_HASH_SIZE; i++, slot = (slot + 1) & (DEV_HASH_SIZE - 1)) {
+        if (devices[slot].fops) continue;
+        strcpy((int8_t*)devices[slot].name, (int8_t*)name);
+        devices[slot].fops = fops;
+        num_devices++;
+        return 0;
+    }
+    return -1;
+}
+
+/* vfs_find_device
+Description: looks up a device by name
+Input: name without /dev/
+Output: operations of the device, 0 if there is none
+*/
+file_operations_t* vfs_find_device(const uint8_t* name) {
+    uint32_t i, slot = name_hash(name);
+    // devices are never removed, so the first empty slot ends the probe
+    for (i = 0; i < DEV_HASH_SIZE && devices[slot].fops; i++, slot = (slot + 1) & (DEV_HASH_SIZE - 1)) {
+        if (strncmp((int8_t*)devices[slot].name, (int8_t*)name, DEV_NAME_LENGTH) == 0) return devices[slot].fops;
+    }
+    return 0;
+}
+
+/* vfs_mount
+Description: mounts a filesystem at a path, replacing what was mounted there
+Input: absolute path, operations whose open is given the path inside the mount
+Output: 0 on success, -1 on fail
+*/
+int32_t vfs_mount(const uint8_t* path, file_operations_t* fops) {
+    int32_t i, free_slot = -1;
+    uint32_t length = strlen((int8_t*)path);
+    if (path[0] != '/' || length >= MOUNT_PATH_LENGTH) return -1;
+    // "/" is kept as an empty prefix so every path matches it
+    if (length == 1) length = 0;
+    for (i = 0; i < MAX_MOUNTS; i++) {
+        if (!mounts[i].fops) {
+            if (free_slot == -1) free_slot = i;
+            continue;
+        }
+        if (mounts[i].path_length == length && strncmp((int8_t*)mounts[i].path, (int8_t*)path, length) == 0) {
+            mounts[i].fops = fops;
+            return 0;
+        }
+    }
+    if (free_slot == -1) return -1;
+    strncpy((int8_t*)mounts[free_slot].path, (int8_t*)path, length);
+    mounts[free_slot].path[length] = '\0';
+    mounts[free_slot].path_length = length;
+    mounts[free_slot].fops = fops;
+    return 0;
+}
+
+/* find_mount
+Description: finds the longest mount a path is under, paths without a leading / start at /
+Input: path, where to put the rest of the path inside the mount
+Output: operations of the mount, 0 if nothing is mounted there
+*/
+static file_operations_t* find_mount(const uint8_t* path, const uint8_t** rest) {
+    int32_t i, best = -1;
+    uint32_t length;
+    if (path[0] == '/') path++;
+    // compare against mount paths without their leading /
+    for (i = 0; i < MAX_MOUNTS; i++) {
+        if (!mounts[i].fops) continue;
+        length = (mounts[i].path_length) ? mounts[i].path_length - 1 : 0;
+        if (strncmp((int8_t*)mounts[i].path + 1, (int8_t*)path, length) != 0) continue;
+        if (path[length] != '\0' && path[length] != '/' && length != 0) continue;
+        if (best == -1 || mounts[i].path_length > mounts[best].path_length) best = i;
+    }
+    if (best == -1) return 0;
+    *rest = path + ((mounts[best].path_length) ? mounts[best].path_length - 1 : 0);
+    while (**rest == '/') (*rest)++;
+    return mounts[best].fops;
+}
+
+/* vfs_open
+Description: opens a path on an empty fd of the current task, paths without
+a leading / start at /, the longest mount the path is under handles the open
+Input: fd, path, FD_CREATE and FD_TRUNC for filesystems that can write
+Output: 0 on success, -1 on fail, the fd holds a file that isn't open on fail
+*/
+int32_t vfs_open(int32_t fd, const uint8_t* path, uint32_t flags) {
+    const uint8_t* rest;
+    file_operations_t* fops = find_mount(path, &rest);
+    if (!fops) return -1;
+    // open sees the flags it was asked for, the file is only marked open after
+    if (-1 == set_fd(fd, fops, 0, 0, flags & ~FD_OPEN)) return -1;
+    // the filesystem may swap in the operations of what it found
+    return fops->open(fd, rest);
+}
+
+/* vfs_unlink
+Description: removes the name of a file from the filesystem it is on
+Input: path
+Output: 0 on success, -1 on fail
+*/
+int32_t vfs_unlink(const uint8_t* path) {
+    const uint8_t* rest;
+    file_operations_t* fops = find_mount(path, &rest);
+    if (!fops || !fops->unlink) return -1;
+    return fops->unlink(rest);
+}
+
+/* vfs_mkdir
+Description: makes a directory on the filesystem the path is under
+Input: path
+Output: 0 on success, -1 on fail
+*/
+int32_t vfs_mkdir(const uint8_t* path) {
+    const uint8_t* rest;
+    file_operations_t* fops = find_mount(path, &rest);
+    if (!fops || !fops->mkdir) return -1;
+    return fops->mkdir(rest);
+}
+
+/* vfs_stat
+Description: looks up a path without opening it
+Input: path, stat to fill in
+Output: 0 on success, -1 on fail
+*/
+int32_t vfs_stat(const uint8_t* path, stat_t* st) {
+    const uint8_t* rest;
+    file_operations_t* fops = find_mount(path, &rest);
+    if (!fops || !fops->stat) return -1;
+    return fops->stat(rest, st);
+}
+
+/* devfs_open
+Description: opens a registered device, the fd takes on its operations
+Input: fd, name of device
+Output: return of the device open, -1 if there is no such device
+*/
+static int32_t devfs_open(int32_t fd, const uint8_t* filename) {
+    file_operations_t* fops = vfs_find_device(filename);
+    if (!fops) return -1;
+    fd_file(fd)->file_op_table_ptr = fops;
+    return fops->open(fd, filename);
+}
+
+/* devfs_unavail
+Description: /dev itself can't be read or written
+Output: always -1
+*/
+static int32_t devfs_unavail() {
+    return -1;
+}
+
+/* devfs_stat
+Description: looks up a device, /dev itself is a directory
+Input: name of device, stat to fill in
+Output: 0 on success, -1 if there is no such device
+*/
+static int32_t devfs_stat(const uint8_t* filename, stat_t* st) {
+    if (filename[0] != '\0' && !vfs_find_device(filename)) return -1;
+    st->type = (filename[0] == '\0') ? DIRENT_DIR : DIRENT_DEVICE;
+    st->inode = 0;
+    st->size = 0;
+    st->blocks = 0;
+    return 0;
+}
@@ -0,0 +1,120 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include "types.h"
+
+#define MAX_DEVICES 16
+#define DEV_HASH_SIZE 32 // power of 2, at least twice MAX_DEVICES so probes stay short
+#define DEV_NAME_LENGTH 16
+#define MAX_MOUNTS 8
+#define MOUNT_PATH_LENGTH 32
+#define DIRENT_NAME_LENGTH 32
+
+/* lseek whence */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* dirent_t and stat_t types, same as f_type in the boot filesystem */
+#define DIRENT_DEVICE 0
+#define DIRENT_DIR 1
+#define DIRENT_FILE 2
+
+/* what stat and fstat fill in */
+typedef struct stat {
+    uint32_t type;   // DIRENT_DEVICE, DIRENT_DIR or DIRENT_FILE
+    uint32_t inode;
+    uint32_t size;   // bytes in the file
+    uint32_t blocks; // 4KB blocks holding its data
+} __attribute__((packed)) stat_t;
+
+/* what a driver or filesystem does for each call on an open file, every
+ * function gets the fd of the current task the call was made on */
+typedef struct file_operations {
+    int32_t (*open)(int32_t fd, const uint8_t* filename);
+    int32_t (*read)(int32_t fd, void* buf, int32_t nbytes);
+    int32_t (*write)(int32_t fd, const void* buf, int32_t nbytes);
+    int32_t (*close)(int32_t fd);
+    int32_t (*poll)(int32_t fd);
+    int32_t (*truncate)(int32_t fd, uint32_t length); // 0 if files can't be resized
+    int32_t (*unlink)(const uint8_t* filename); // called on the mount, 0 if nothing can be removed
+    int32_t (*mkdir)(const uint8_t* path); // called on the mount, 0 if it has no directories to make
+    int32_t (*getdents)(int32_t fd, void* buf, int32_t nbytes); // 0 if the file isn't a directory
+    int32_t (*stat)(const uint8_t* path, stat_t* st); // called on the mount, 0 if it can't look up paths
+    int32_t (*fstat)(int32_t fd, stat_t* st); // 0 for devices, which also can't be seeked
+} file_operations_t;
+
+/* what getdents fills the buffer with, one per directory entry */
+typedef struct dirent {
+    uint8_t  name[DIRENT_NAME_LENGTH]; // not terminated if it is 32 characters
+    uint32_t type;  // DIRENT_DEVICE, DIRENT_DIR or DIRENT_FILE
+    uint32_t inode;
+    uint32_t size;  // bytes in the file
+} __attribute__((packed)) dirent_t;
+
+/* a filesystem mounted at path, its open gets the rest of the path */
+typedef struct mount {
+    uint8_t path[MOUNT_PATH_LENGTH];
+    uint32_t path_length;
+    file_operations_t* fops;
+} mount_t;
+
+/* vfs_init
+Description: registers the built in devices and mounts the boot filesystem at /
+the devices at /dev and scratch files at /tmp
+Input: none
+Output: none
+*/
+extern void vfs_init();
+
+/* vfs_register_device
+Description: adds a device that can be opened as /dev/name
+Input: name, operations of the device
+Output: 0 on success, -1 if the name is taken or the table is full
+*/
+extern int32_t vfs_register_device(const uint8_t* name, file_operations_t* fops);
+
+/* vfs_find_device
+Description: looks up a device by name
+Input: name without /dev/
+Output: operations of the device, 0 if there is none
+*/
+extern file_operations_t* vfs_find_device(const uint8_t* name);
+
+/* vfs_mount
+Description: mounts a filesystem at a path, replacing what was mounted there
+Input: absolute path, operations whose open is given the path inside the mount
+Output: 0 on success, -1 on fail
+*/
+extern int32_t vfs_mount(const uint8_t* path, file_operations_t* fops);
+
+/* vfs_open
+Description: opens a path on an empty fd of the current task, paths without
+a leading / start at /
+Input: fd, path, FD_CREATE and FD_TRUNC for filesystems that can write
+Output: 0 on success, -1 on fail, the fd holds a file that isn't open on fail
+*/
+extern int32_t vfs_open(int32_t fd, const uint8_t* path, uint32_t flags);
+
+/* vfs_unlink
+Description: removes the name of a file from the filesystem it is on
+Input: path
+Output: 0 on success, -1 on fail
+*/
+extern int32_t vfs_unlink(const uint8_t* path);
+
+/* vfs_mkdir
+Description: makes a directory on the filesystem the path is under
+Input: path
+Output: 0 on success, -1 on fail
+*/
+extern int32_t vfs_mkdir(const uint8_t* path);
+
+/* vfs_stat
+Description: looks up a path without opening it
+Input: path, stat to fill in
+Output: 0 on success, -1 on fail
+*/
+extern int32_t vfs_stat(const uint8_t* path, stat_t* st);
+
+#endif
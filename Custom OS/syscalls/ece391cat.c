@@ -18,6 +18,13 @@ int main ()
 	return 2;
     }
 
+    /* let the kernel stream regular files straight to stdout */
+    while (0 < (cnt = ece391_sendfile (1, fd, 0x7FFFFFFF)))
+	;
+    if (0 == cnt)
+	return 0;
+
+    /* directories and devices go through a buffer */
     while (0 != (cnt = ece391_read (fd, buf, 1024))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"file read failed\n");
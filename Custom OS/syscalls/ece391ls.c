@@ -4,25 +4,57 @@
 #include "ece391syscall.h"
 
 #define SBUFSIZE 33
+#define NAME_COLUMN 34
+#define DENTS_PER_CALL 32
+
+/* Print one entry as "name  size", directories get a trailing '/'. */
+static int32_t
+print_entry (const ece391_dirent_t* ent)
+{
+    uint8_t line[SBUFSIZE + NAME_COLUMN + 12];
+    uint8_t num[12];
+    uint32_t len;
+
+    for (len = 0; len < SBUFSIZE - 1 && '\0' != ent->name[len]; len++)
+	line[len] = ent->name[len];
+    if (DT_DIR == ent->type)
+	line[len++] = '/';
+    while (len < NAME_COLUMN)
+	line[len++] = ' ';
+    if (DT_FILE == ent->type) {
+	ece391_itoa (ent->size, num, 10);
+	ece391_strcpy (line + len, num);
+	len += ece391_strlen (num);
+    }
+    line[len++] = '\n';
+    return ece391_write (1, line, len);
+}
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, i;
+    uint8_t path[SBUFSIZE * 4];
+    ece391_dirent_t ents[DENTS_PER_CALL];
+
+    /* list the directory given, or the root */
+    if (0 != ece391_getargs (path, sizeof (path)))
+	ece391_strcpy (path, (uint8_t*)".");
 
-    if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
+    if (-1 == (fd = ece391_open (path))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* each call returns as many entries as fit in ents */
+    while (0 != (cnt = ece391_getdents (fd, ents, sizeof (ents)))) {
         if (-1 == cnt) {
 	        ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	        return 3;
 	    }
-	    buf[cnt] = '\n';
-	    if (-1 == ece391_write (1, buf, cnt + 1))
-	        return 3;
+	for (i = 0; i < cnt / (int32_t)sizeof (ece391_dirent_t); i++) {
+	    if (-1 == print_entry (&ents[i]))
+		return 3;
+	}
     }
 
     return 0;
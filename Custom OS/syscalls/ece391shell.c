@@ -4,11 +4,82 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 4
+
+/* Strip leading and trailing spaces in place, returns the new start. */
+static uint8_t*
+trim (uint8_t* s)
+{
+    uint32_t len;
+
+    while (' ' == *s)
+	s++;
+    len = ece391_strlen (s);
+    while (len > 0 && ' ' == s[len - 1])
+	s[--len] = '\0';
+    return s;
+}
+
+/*
+ * Run "a | b | c": every stage is spawned in the background with its
+ * stdout on a pipe to the next stage's stdin.  The shell closes its copy
+ * of each pipe end once both stages have it, so readers see EOF when the
+ * writer ends.  Returns the status of the last stage.
+ */
+static int32_t
+run_pipeline (uint8_t* stages[], int32_t n_stages)
+{
+    int32_t fds[2], task[MAX_STAGES];
+    int32_t i, in_fd, out_fd, rval, status;
+
+    for (i = 0; i < n_stages; i++) {
+	stages[i] = trim (stages[i]);
+	if ('\0' == stages[i][0]) {
+	    ece391_fdputs (1, (uint8_t*)"invalid null command\n");
+	    return 0;
+	}
+    }
+
+    in_fd = 0;
+    for (i = 0; i < n_stages; i++) {
+	out_fd = 1;
+	if (i < n_stages - 1) {
+	    if (-1 == ece391_pipe (fds)) {
+		ece391_fdputs (1, (uint8_t*)"could not create pipe\n");
+		break;
+	    }
+	    out_fd = fds[1];
+	}
+	task[i] = ece391_spawn (stages[i], in_fd, out_fd);
+	if (0 != in_fd)
+	    ece391_close (in_fd);
+	if (1 != out_fd)
+	    ece391_close (out_fd);
+	in_fd = (i < n_stages - 1) ? fds[0] : 0;
+	if (-1 == task[i]) {
+	    ece391_fdputs (1, (uint8_t*)"too many processes\n");
+	    break;
+	}
+    }
+    /* drop the read end left over if a stage could not start */
+    if (i < n_stages && 0 != in_fd)
+	ece391_close (in_fd);
+
+    rval = 0;
+    n_stages = i;
+    for (i = 0; i < n_stages; i++) {
+	status = ece391_wait (task[i]);
+	if (i == n_stages - 1)
+	    rval = status;
+    }
+    return rval;
+}
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, rval, n_stages, i;
     uint8_t buf[BUFSIZE];
+    uint8_t* stages[MAX_STAGES];
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
@@ -24,7 +95,25 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
-	rval = ece391_execute (buf);
+	/* split the line into pipeline stages */
+	n_stages = 1;
+	stages[0] = buf;
+	for (i = 0; i < cnt; i++) {
+	    if ('|' != buf[i])
+		continue;
+	    if (MAX_STAGES == n_stages)
+		break;
+	    buf[i] = '\0';
+	    stages[n_stages++] = buf + i + 1;
+	}
+	if (i < cnt) {
+	    ece391_fdputs (1, (uint8_t*)"too many pipeline stages\n");
+	    continue;
+	}
+	if (1 == n_stages)
+	    rval = ece391_execute (buf);
+	else
+	    rval = run_pipeline (stages, n_stages);
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
 	else if (256 == rval)
@@ -33,4 +122,3 @@ int main ()
 	    ece391_fdputs (1, (uint8_t*)"program terminated abnormally\n");
     }
 }
-
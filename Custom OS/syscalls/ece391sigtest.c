@@ -24,6 +24,7 @@ int main ()
 		ece391_fdputs(1, (uint8_t*)"Installing signal handlers\n");
 		ece391_set_handler(SEGFAULT, segfault_sighandler);
 		ece391_set_handler(ALARM, alarm_sighandler);
+		ece391_alarm(10000);
 	}
 
     ece391_fdputs (1, (uint8_t*)"Hi, what's your name? ");
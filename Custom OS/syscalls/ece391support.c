@@ -102,3 +102,130 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/*
+ * Heap allocator.  Requests up to MALLOC_MAX_SMALL bytes are rounded up
+ * to a power of two size class from 16 to 2048 bytes; each class keeps a
+ * free list of blocks carved out of arenas taken from sbrk.  Bigger
+ * requests get their own anonymous mapping and give it back on free.
+ * Every block starts with a header naming its class, so free needs no
+ * size.
+ */
+
+#define MALLOC_MIN_SHIFT 4
+#define MALLOC_LARGE 0xFFFFFFFF
+#define ARENA_SIZE 0x4000
+#define PAGE_SIZE 0x1000
+
+typedef struct block_hdr {
+    uint32_t size_class;        /* class index, or MALLOC_LARGE */
+    uint32_t size;              /* bytes asked for */
+} block_hdr_t;
+
+typedef struct free_block {
+    struct free_block* next;
+} free_block_t;
+
+static free_block_t* free_lists[MALLOC_NUM_CLASSES];
+static ece391_malloc_stats_t malloc_stats;
+
+/* Find the smallest class that holds size bytes. */
+static uint32_t
+size_to_class (uint32_t size)
+{
+    uint32_t cls = 0;
+
+    while ((1U << (cls + MALLOC_MIN_SHIFT)) < size)
+        cls++;
+    return cls;
+}
+
+/* Carve a new arena into blocks of class cls; returns -1 if out of memory. */
+static int32_t
+refill_class (uint32_t cls)
+{
+    uint32_t block_size = sizeof (block_hdr_t) + (1U << (cls + MALLOC_MIN_SHIFT));
+    uint8_t* arena;
+    uint32_t off;
+    free_block_t* blk;
+
+    arena = ece391_sbrk (ARENA_SIZE);
+    if ((void*)-1 == arena)
+        return -1;
+    malloc_stats.bytes_from_kernel += ARENA_SIZE;
+    for (off = 0; off + block_size <= ARENA_SIZE; off += block_size) {
+        blk = (free_block_t*)(arena + off + sizeof (block_hdr_t));
+        ((block_hdr_t*)(arena + off))->size_class = cls;
+        blk->next = free_lists[cls];
+        free_lists[cls] = blk;
+    }
+    return 0;
+}
+
+/* Allocate size bytes; returns 0 for size 0 or when out of memory. */
+void* ece391_malloc(uint32_t size)
+{
+    block_hdr_t* hdr;
+    free_block_t* blk;
+    uint32_t cls, len;
+
+    if (0 == size)
+        return 0;
+    if (size > MALLOC_MAX_SMALL) {
+        len = (size + sizeof (block_hdr_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        if (len < size)
+            return 0;
+        hdr = (block_hdr_t*)ece391_mmap (-1, len);
+        if ((block_hdr_t*)-1 == hdr)
+            return 0;
+        hdr->size_class = MALLOC_LARGE;
+        hdr->size = size;
+        malloc_stats.bytes_from_kernel += len;
+        malloc_stats.n_large++;
+        malloc_stats.n_malloc++;
+        malloc_stats.bytes_in_use += size;
+        return hdr + 1;
+    }
+    cls = size_to_class (size);
+    if (0 == free_lists[cls] && -1 == refill_class (cls))
+        return 0;
+    blk = free_lists[cls];
+    free_lists[cls] = blk->next;
+    hdr = (block_hdr_t*)blk - 1;
+    hdr->size = size;
+    malloc_stats.n_malloc++;
+    malloc_stats.bytes_in_use += size;
+    malloc_stats.class_in_use[cls]++;
+    return blk;
+}
+
+/* Give back a block from ece391_malloc; 0 is ignored. */
+void ece391_free(void* ptr)
+{
+    block_hdr_t* hdr;
+    free_block_t* blk;
+    uint32_t len;
+
+    if (0 == ptr)
+        return;
+    hdr = (block_hdr_t*)ptr - 1;
+    malloc_stats.n_free++;
+    malloc_stats.bytes_in_use -= hdr->size;
+    if (MALLOC_LARGE == hdr->size_class) {
+        len = (hdr->size + sizeof (block_hdr_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        malloc_stats.bytes_from_kernel -= len;
+        malloc_stats.n_large--;
+        (void)ece391_munmap (hdr, len);
+        return;
+    }
+    malloc_stats.class_in_use[hdr->size_class]--;
+    blk = (free_block_t*)ptr;
+    blk->next = free_lists[hdr->size_class];
+    free_lists[hdr->size_class] = blk;
+}
+
+/* Copy out the allocator's counters. */
+void ece391_malloc_stats(ece391_malloc_stats_t* stats)
+{
+    *stats = malloc_stats;
+}
@@ -9,5 +9,22 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/* size classes used by ece391_malloc, bigger requests get their own mapping */
+#define MALLOC_NUM_CLASSES 8
+#define MALLOC_MAX_SMALL 2048
+
+typedef struct ece391_malloc_stats {
+    uint32_t n_malloc;          /* successful ece391_malloc calls */
+    uint32_t n_free;            /* ece391_free calls with a real pointer */
+    uint32_t bytes_in_use;      /* bytes asked for and not yet freed */
+    uint32_t bytes_from_kernel; /* heap and mappings taken from the kernel */
+    uint32_t n_large;           /* large blocks currently mapped */
+    uint32_t class_in_use[MALLOC_NUM_CLASSES]; /* blocks handed out per class */
+} ece391_malloc_stats_t;
+
+extern void* ece391_malloc(uint32_t size);
+extern void ece391_free(void* ptr);
+extern void ece391_malloc_stats(ece391_malloc_stats_t* stats);
+
 #endif /* ECE391SUPPORT_H */
 
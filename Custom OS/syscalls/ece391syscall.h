@@ -22,6 +22,199 @@ extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/*
+ * Pipes and background tasks.  pipe fills fds[0] with the read end and
+ * fds[1] with the write end.  spawn starts a command in the background
+ * with in_fd and out_fd of the caller as its stdin and stdout, and returns
+ * a task id; wait blocks until that task ends and returns its status the
+ * same way execute does.  pipe_flags takes O_NONBLOCK like open_flags,
+ * for both ends.
+ */
+extern int32_t ece391_pipe (int32_t fds[2]);
+extern int32_t ece391_pipe_flags (int32_t fds[2], int32_t flags);
+extern int32_t ece391_spawn (const uint8_t* command, int32_t in_fd, int32_t out_fd);
+extern int32_t ece391_wait (int32_t task);
+extern int32_t ece391_isatty (int32_t fd);
+
+/*
+ * Shared memory.  shm_create returns the id of the segment named by key,
+ * creating it with size bytes if no task has made it yet.  shm_map maps
+ * a segment at addr (page aligned, 0x08800000 to 0x10000000) or at an
+ * address the kernel picks if addr is 0, and returns that address.  A
+ * segment is freed once the last task unmaps it, or when the task that
+ * made it ends if nobody ever mapped it.
+ */
+extern int32_t ece391_shm_create (uint32_t key, uint32_t size);
+extern int32_t ece391_shm_map (int32_t id, void* addr);
+extern int32_t ece391_shm_unmap (void* addr);
+
+/*
+ * poll waits until one of nfds entries is ready for its events, or
+ * timeout ms pass (-1 waits forever, 0 just checks).  It returns the
+ * number of entries with revents set.  Reading stdin is ready once enter
+ * is pressed.  open_flags with O_NONBLOCK gives a fd whose reads and
+ * writes return -1 instead of waiting.
+ */
+#define O_NONBLOCK 0x2
+#define O_CREAT    0x4
+#define O_TRUNC    0x8
+
+#define POLLIN   0x1
+#define POLLOUT  0x2
+#define POLLHUP  0x4
+#define POLLNVAL 0x8
+
+typedef struct ece391_pollfd {
+	int32_t  fd;
+	uint16_t events;
+	uint16_t revents;
+} ece391_pollfd_t;
+
+extern int32_t ece391_poll (ece391_pollfd_t* fds, int32_t nfds, int32_t timeout);
+extern int32_t ece391_open_flags (const uint8_t* filename, int32_t flags);
+
+/*
+ * Batched I/O.  io_setup maps one ring page and returns its address.
+ * Fill sqes[sq_tail % sq_entries] and bump sq_tail for each request,
+ * then io_enter(n) runs up to n of them in order with one trap and posts
+ * a completion per request at cqes[cq_tail % cq_entries].  Consume
+ * completions by bumping cq_head.  res is what read/write/open/close
+ * would have returned.
+ */
+#define IO_OP_NOP   0
+#define IO_OP_READ  1
+#define IO_OP_WRITE 2
+#define IO_OP_OPEN  3
+#define IO_OP_CLOSE 4
+
+typedef struct ece391_io_sqe {
+	uint32_t opcode;
+	int32_t  fd;
+	uint32_t addr;
+	int32_t  len;
+	uint32_t user_data;
+} __attribute__((packed)) ece391_io_sqe_t;
+
+typedef struct ece391_io_cqe {
+	uint32_t user_data;
+	int32_t  res;
+} __attribute__((packed)) ece391_io_cqe_t;
+
+typedef struct ece391_io_ring {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	ece391_io_sqe_t sqes[64];
+	ece391_io_cqe_t cqes[128];
+} __attribute__((packed)) ece391_io_ring_t;
+
+extern int32_t ece391_io_setup (void);
+extern int32_t ece391_io_enter (int32_t to_submit);
+
+/*
+ * mmap maps length bytes (0 for all) of an open file read only and
+ * returns the address; the pages are the filesystem image itself, so
+ * nothing is copied.  With fd -1 it maps length bytes of writable
+ * memory that reads as zero.  munmap takes back pages inside one
+ * mapping, usually the same address and length; anything else fails.
+ */
+extern int32_t ece391_mmap (int32_t fd, uint32_t length);
+extern int32_t ece391_munmap (void* addr, uint32_t length);
+
+/*
+ * sendfile copies up to count bytes from the file at in_fd to out_fd
+ * without passing through user memory, and returns the bytes sent.
+ */
+extern int32_t ece391_sendfile (int32_t out_fd, int32_t in_fd, int32_t count);
+
+/*
+ * alarm sends ALARM to the caller every ms milliseconds, 0 turns it off.
+ * Returns the previous period.  Handlers set with set_handler get the
+ * signal number, followed on the stack by the interrupted registers
+ * (ebx, ecx, edx, esi, edi, ebp, eax, ...), and return normally.
+ */
+extern int32_t ece391_alarm (uint32_t ms);
+
+/*
+ * sbrk moves the end of the heap by increment bytes and returns the old
+ * end.  New heap memory reads as zero.  Use ece391_malloc instead unless
+ * you are managing memory yourself.
+ */
+extern void* ece391_sbrk (int32_t increment);
+
+/*
+ * dup returns the lowest free fd pointing at the same open file as fd;
+ * dup2 makes new_fd point at it, closing new_fd first if it was open.
+ * Copies share the file position, and the file is only closed once
+ * every copy is closed.
+ */
+extern int32_t ece391_dup (int32_t fd);
+extern int32_t ece391_dup2 (int32_t fd, int32_t new_fd);
+
+/*
+ * Files under /tmp live in memory and can be written.  open_flags with
+ * O_CREAT makes a missing file and O_TRUNC empties it; writes go at the
+ * file position and grow the file.  truncate sets the length of an open
+ * file, and unlink removes a name, the data stays readable through fds
+ * that still have it open.  Everything under /tmp is gone on reboot.
+ * Files in / can be made and written the same way; they are kept in the
+ * filesystem image, so other programs see them until reboot.  While a
+ * file in the image is mapped with mmap, unlink and truncating it shorter
+ * fail, and so does open_flags with O_TRUNC.
+ *
+ * Paths in the image can go through directories ("bin/ls"), for open,
+ * execute and unlink alike.  mkdir makes an empty directory; unlink
+ * removes a directory only once it is empty.  Reading a directory gives
+ * one name per read, "." and ".." included.
+ */
+extern int32_t ece391_truncate (int32_t fd, uint32_t length);
+extern int32_t ece391_unlink (const uint8_t* filename);
+extern int32_t ece391_mkdir (const uint8_t* path);
+
+/*
+ * getdents fills buf with one ece391_dirent_t per entry of the open
+ * directory fd, as many as fit, and returns the bytes filled; 0 means
+ * the whole directory was read.  Names of 32 characters have no '\0'.
+ */
+#define DT_DEVICE 0
+#define DT_DIR    1
+#define DT_FILE   2
+
+typedef struct ece391_dirent {
+	uint8_t  name[32];
+	uint32_t type;
+	uint32_t inode;
+	uint32_t size;
+} __attribute__((packed)) ece391_dirent_t;
+
+extern int32_t ece391_getdents (int32_t fd, void* buf, int32_t nbytes);
+
+/*
+ * stat and fstat give the type (DT_*), inode, size and number of 4KB
+ * blocks of a path or an open fd; terminals and pipes are DT_DEVICE with
+ * size 0.  lseek moves the position of an open file to offset from the
+ * start, the current position or the end, and returns the new position.
+ * Seeking past the end is fine, and writing there fills the gap with 0.
+ * Directories can only seek back to 0, and pipes and devices not at all.
+ */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+typedef struct ece391_stat {
+	uint32_t type;
+	uint32_t inode;
+	uint32_t size;
+	uint32_t blocks;
+} __attribute__((packed)) ece391_stat_t;
+
+extern int32_t ece391_stat (const uint8_t* path, ece391_stat_t* st);
+extern int32_t ece391_fstat (int32_t fd, ece391_stat_t* st);
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
@@ -292,19 +292,214 @@ int err_vidmap(void) {
 	return fail;
  }
 
+/* TEST 9 err_pipe_nonblock
+ * makes a pipe with O_NONBLOCK, reads it empty and writes it full
+ * neither should wait, the read fails and the write stops at what fit
+ * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
+ *     and then returns 0
+ * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
+ *     and then returns 2
+ */
+
+int err_pipe_nonblock(void)
+{
+	int fail = 0, i;
+	int32_t fds[2], cnt, total = 0;
+	uint8_t buf[1024];
+
+	if (-1 == ece391_pipe_flags(fds, O_NONBLOCK)) {
+		ece391_fdputs (1, (uint8_t*)"pipe_flags fail\n");
+		ece391_fdputs (1, (uint8_t*)"err_pipe_nonblock: FAIL\n");
+		return 2;
+	}
+	if (-1 != ece391_read(fds[0], buf, 31)) {
+		ece391_fdputs (1, (uint8_t*)"read from empty pipe fail\n");
+		fail = 2;
+	}
+	for (i = 0; i < 1024; i++) buf[i] = 'x';
+	// 16 writes are more than the pipe holds, the last ones can't go in
+	for (i = 0; i < 16; i++) {
+		if (-1 == (cnt = ece391_write(fds[1], buf, 1024))) break;
+		total += cnt;
+	}
+	if (i == 16 || total == 0) {
+		ece391_fdputs (1, (uint8_t*)"write to full pipe fail\n");
+		fail = 2;
+	}
+	if (ece391_read(fds[0], buf, 1024) != 1024) {
+		ece391_fdputs (1, (uint8_t*)"read from full pipe fail\n");
+		fail = 2;
+	}
+	ece391_close(fds[0]);
+	ece391_close(fds[1]);
+
+	if (fail) {
+		ece391_fdputs (1, (uint8_t*)"err_pipe_nonblock: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"err_pipe_nonblock: PASS\n");
+	}
+
+	return fail;
+}
+
+/* TEST 10 err_malloc
+ * mallocs and frees blocks in several size classes and one large block,
+ * checks the allocator's statistics after each step, then touches memory
+ * from sbrk and an anonymous mmap, which must read as zero
+ * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
+ *     and then returns 0
+ * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
+ *     and then returns 2
+ */
+
+#define MALLOC_TESTS 6
+#define LARGE_SIZE 10000
+
+int err_malloc(void)
+{
+	static const uint32_t sizes[MALLOC_TESTS] = {1, 16, 17, 100, 1000, 2048};
+	static const uint32_t classes[MALLOC_TESTS] = {0, 0, 1, 3, 6, 7};
+	ece391_malloc_stats_t before, st;
+	uint8_t* p[MALLOC_TESTS];
+	uint8_t* large;
+	uint8_t* mem;
+	uint32_t i, j, n, total = 0;
+	int fail = 0;
+
+	ece391_malloc_stats(&before);
+	for (i = 0; i < MALLOC_TESTS; i++) {
+		if (0 == (p[i] = ece391_malloc(sizes[i]))) {
+			ece391_fdputs (1, (uint8_t*)"malloc fail\n");
+			ece391_fdputs (1, (uint8_t*)"err_malloc: FAIL\n");
+			return 2;
+		}
+		for (j = 0; j < sizes[i]; j++) p[i][j] = i;
+		total += sizes[i];
+	}
+	// blocks don't overlap, so each still holds what was written to it
+	for (i = 0; i < MALLOC_TESTS; i++) {
+		for (j = 0; j < sizes[i]; j++) {
+			if (p[i][j] != i) {
+				ece391_fdputs (1, (uint8_t*)"malloc blocks overlap fail\n");
+				fail = 2;
+				break;
+			}
+		}
+	}
+	ece391_malloc_stats(&st);
+	if (st.n_malloc != before.n_malloc + MALLOC_TESTS || st.bytes_in_use != before.bytes_in_use + total) {
+		ece391_fdputs (1, (uint8_t*)"malloc stats count fail\n");
+		fail = 2;
+	}
+	// each block counts in its power of two class, 16 bytes and up
+	for (i = 0; i < MALLOC_NUM_CLASSES; i++) {
+		for (j = 0, n = 0; j < MALLOC_TESTS; j++) {
+			if (classes[j] == i) n++;
+		}
+		if (st.class_in_use[i] != before.class_in_use[i] + n) {
+			ece391_fdputs (1, (uint8_t*)"malloc stats class fail\n");
+			fail = 2;
+			break;
+		}
+	}
+
+	// a large block gets its own mapping, given back on free
+	if (0 == (large = ece391_malloc(LARGE_SIZE))) {
+		ece391_fdputs (1, (uint8_t*)"large malloc fail\n");
+		fail = 2;
+	} else {
+		for (j = 0; j < LARGE_SIZE; j++) large[j] = 0x5A;
+		ece391_malloc_stats(&st);
+		if (st.n_large != before.n_large + 1 || st.bytes_in_use != before.bytes_in_use + total + LARGE_SIZE) {
+			ece391_fdputs (1, (uint8_t*)"large malloc stats fail\n");
+			fail = 2;
+		}
+		ece391_free(large);
+	}
+
+	// freed blocks go back to their class, the last one freed comes back first
+	for (i = 0; i < MALLOC_TESTS; i++) ece391_free(p[i]);
+	ece391_malloc_stats(&st);
+	if (st.bytes_in_use != before.bytes_in_use || st.n_large != before.n_large ||
+		st.n_free != before.n_free + MALLOC_TESTS + (large ? 1 : 0)) {
+		ece391_fdputs (1, (uint8_t*)"free stats fail\n");
+		fail = 2;
+	}
+	for (i = 0; i < MALLOC_NUM_CLASSES; i++) {
+		if (st.class_in_use[i] != before.class_in_use[i]) {
+			ece391_fdputs (1, (uint8_t*)"free stats class fail\n");
+			fail = 2;
+			break;
+		}
+	}
+	if ((mem = ece391_malloc(100)) != p[3]) {
+		ece391_fdputs (1, (uint8_t*)"freed block not reused fail\n");
+		fail = 2;
+	}
+	ece391_free(mem);
+
+	// heap from sbrk reads as zero and can be written
+	if ((void*)-1 == (mem = ece391_sbrk(8192))) {
+		ece391_fdputs (1, (uint8_t*)"sbrk fail\n");
+		fail = 2;
+	} else {
+		for (j = 0; j < 8192; j++) {
+			if (mem[j] != 0) {
+				ece391_fdputs (1, (uint8_t*)"sbrk memory not zero fail\n");
+				fail = 2;
+				break;
+			}
+			mem[j] = 0xA5;
+		}
+		if (ece391_sbrk(0) != mem + 8192) {
+			ece391_fdputs (1, (uint8_t*)"sbrk end fail\n");
+			fail = 2;
+		}
+	}
+
+	// so does anonymous mmap, and it can only be unmapped once
+	if (-1 == (int32_t)(mem = (uint8_t*)ece391_mmap(-1, 3 * 4096))) {
+		ece391_fdputs (1, (uint8_t*)"anonymous mmap fail\n");
+		fail = 2;
+	} else {
+		for (j = 0; j < 3 * 4096; j++) {
+			if (mem[j] != 0) {
+				ece391_fdputs (1, (uint8_t*)"mmap memory not zero fail\n");
+				fail = 2;
+				break;
+			}
+			mem[j] = 0xA5;
+		}
+		if (0 != ece391_munmap(mem, 3 * 4096) || -1 != ece391_munmap(mem, 3 * 4096)) {
+			ece391_fdputs (1, (uint8_t*)"munmap fail\n");
+			fail = 2;
+		}
+	}
+
+	if (fail) {
+		ece391_fdputs (1, (uint8_t*)"err_malloc: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"err_malloc: PASS\n");
+	}
+
+	return fail;
+}
+
 
 int main ()
 {
-	int32_t cnt, select;
+	int32_t cnt, select, i;
     uint8_t buf[128];
 	int fail = 0;
 
-    ece391_fdputs (1, (uint8_t*)"Choose from tests 1-8. 0 to run all: ");
+    ece391_fdputs (1, (uint8_t*)"Choose from tests 1-10. 0 to run all: ");
     if (-1 == (cnt = ece391_read (0, buf, 127))) {
         ece391_fdputs (1, (uint8_t*)"Can't read test #\n");
 		return 2;
     }
-	select = (int)(buf[0] - '0');
+	// tests past 9 take two digits
+	select = 0;
+	for (i = 0; i < cnt && buf[i] >= '0' && buf[i] <= '9'; i++) select = select * 10 + (buf[i] - '0');
 	
 	switch(select) {
 		case 0:
@@ -316,6 +511,8 @@ int main ()
 			fail += err_vidmap();
 			fail += err_stdin_out();
 			fail += err_syscall_num();
+			fail += err_pipe_nonblock();
+			fail += err_malloc();
 			if(fail) {
 				ece391_fdputs (1, (uint8_t*)"\nOverall Tests: FAIL\n");
 			} else {
@@ -338,8 +535,12 @@ int main ()
 			return err_stdin_out();
 		case 8:
 			return err_syscall_num();
+		case 9:
+			return err_pipe_nonblock();
+		case 10:
+			return err_malloc();
 		default:
-			ece391_fdputs (1, (uint8_t*)"Invalid test number. Choose from tests 1-8 or 0");
+			ece391_fdputs (1, (uint8_t*)"Invalid test number. Choose from tests 1-10 or 0");
 			break;
 	}
     return 0;
@@ -11,5 +11,31 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_PIPE    11
+#define SYS_SPAWN   12
+#define SYS_WAIT    13
+#define SYS_ISATTY  14
+#define SYS_SHM_CREATE 15
+#define SYS_SHM_MAP    16
+#define SYS_SHM_UNMAP  17
+#define SYS_POLL       18
+#define SYS_OPEN_FLAGS 19
+#define SYS_IO_SETUP   20
+#define SYS_IO_ENTER   21
+#define SYS_MMAP       22
+#define SYS_MUNMAP     23
+#define SYS_SENDFILE   24
+#define SYS_ALARM      25
+#define SYS_SBRK       26
+#define SYS_DUP        27
+#define SYS_DUP2       28
+#define SYS_TRUNCATE   29
+#define SYS_UNLINK     30
+#define SYS_MKDIR      31
+#define SYS_GETDENTS   32
+#define SYS_STAT       33
+#define SYS_FSTAT      34
+#define SYS_LSEEK      35
+#define SYS_PIPE_FLAGS 36
 
 #endif /* ECE391SYSNUM_H */
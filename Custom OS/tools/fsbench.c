@@ -0,0 +1,493 @@
+/* fsbench - runs the kernel's drivers/fs.c on Linux against an image file
+ *
+ *     fsbench [-d] [-t ms] [image]
+ *
+ * fs.c is built with fsbench_stubs.c standing in for the rest of the
+ * kernel, and the image (../student-distrib/filesys_img by default) is
+ * handed to filesystem_init like the boot module, or with -d mounted as
+ * a disk so every block goes through the buffer cache.  First every
+ * answer of read_dentry_by_index, read_dentry_by_name, read_data and
+ * reads through an open file is checked against the image read here
+ * without fs.c.  Then each call is timed for -t milliseconds (default
+ * 200): lookups per second, and MB/s of read_data over the largest file
+ * for a range of chunk sizes, from a block boundary and from one byte
+ * past it, and at random offsets.
+ *
+ * The kernel keeps addresses in 32 bit integers, so the image and all
+ * frames are mapped below 4GB.  memcpy and the other string functions
+ * are the C library's, not the kernel's.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE 4096
+#define NAME_LENGTH 32
+#define MAX_DENTRIES 63
+#define FILE_TYPE_FILE 2
+#define INODE_BLOCKS (BLOCK_SIZE / 4 - 1)
+#define EXTENT_MAGIC 0x31545845
+#define DIR_MAGIC 0x31524944
+#define INODE_EXTENTS ((BLOCK_SIZE - 16) / 8)
+#define BLOCK_EXTENTS ((BLOCK_SIZE - 8) / 8)
+#define ZIMAGE_MAGIC 0x3153465A
+#define POOL_FRAMES 4096        /* 16MB, as much as the kernel's frame pool */
+#define BATCH 256               /* calls between looks at the clock */
+#define MAX_READ (1 << 20)
+
+/* the on-image layout, see student-distrib/drivers/fs.h */
+typedef struct dentry {
+    uint8_t f_name[NAME_LENGTH];
+    uint32_t f_type;
+    uint32_t inode_index;
+    uint8_t reserved[24];
+} __attribute__((packed)) dentry_t;
+
+/* fs.c, called with the kernel's types, which are the same size here */
+extern int32_t filesystem_init (uint32_t module_start, uint32_t module_end);
+extern int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry);
+extern int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
+extern int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+
+/* fsbench_stubs.c */
+extern void fsbench_task_init (void);
+extern int32_t fsbench_open (int32_t fd, const uint8_t* name);
+extern int32_t fsbench_read (int32_t fd, void* buf, int32_t nbytes);
+extern void fsbench_close (int32_t fd);
+extern int32_t fsbench_mount_disk (uint8_t* image, uint32_t size);
+extern void fsbench_cache_stats (uint32_t* out);
+
+static uint8_t* pool;
+static uint32_t pool_refs[POOL_FRAMES];
+static uint32_t frames_used;
+
+static const uint8_t* ref;      /* the image as it was read, fs.c may change its copy */
+static uint32_t num_dentries, num_inodes, num_blocks;
+static uint32_t errors;
+static double bench_ms = 200;
+
+/* ---- the kernel's frame allocator and itoa ---- */
+
+uint32_t
+alloc_frame (void)
+{
+    static uint32_t next;
+    uint32_t i, f;
+
+    for (i = 0; i < POOL_FRAMES; i++) {
+	f = (next + i) % POOL_FRAMES;
+	if (0 == pool_refs[f]) {
+	    next = f + 1;
+	    pool_refs[f] = 1;
+	    frames_used++;
+	    memset (pool + (size_t)f * BLOCK_SIZE, 0, BLOCK_SIZE);
+	    return (uint32_t)(uintptr_t)(pool + (size_t)f * BLOCK_SIZE);
+	}
+    }
+    return 0;
+}
+
+static uint32_t*
+frame_refs (uint32_t addr)
+{
+    uintptr_t a = addr;
+
+    if (a < (uintptr_t)pool || a >= (uintptr_t)pool + (size_t)POOL_FRAMES * BLOCK_SIZE) {
+	fprintf (stderr, "frame %#x isn't from alloc_frame\n", addr);
+	exit (1);
+    }
+    return &pool_refs[(a - (uintptr_t)pool) / BLOCK_SIZE];
+}
+
+void
+get_frame (uint32_t addr)
+{
+    (*frame_refs (addr))++;
+}
+
+void
+put_frame (uint32_t addr)
+{
+    uint32_t* r = frame_refs (addr);
+
+    if (0 == *r) {
+	fprintf (stderr, "frame %#x freed twice\n", addr);
+	exit (1);
+    }
+    if (0 == --*r)
+	frames_used--;
+}
+
+char*
+itoa (uint32_t value, char* buf, int32_t radix)
+{
+    sprintf (buf, 16 == radix ? "%x" : "%u", value);
+    return buf;
+}
+
+/* ---- the image read without fs.c ---- */
+
+static uint32_t
+read32 (const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static const uint8_t*
+ref_inode (uint32_t inode)
+{
+    return ref + (size_t)(1 + inode) * BLOCK_SIZE;
+}
+
+static const dentry_t*
+ref_dentry (uint32_t i)
+{
+    return (const dentry_t*)(ref + 64 + 64 * i);
+}
+
+/* Data block holding block n of a file, -1 if it has none. */
+static int64_t
+ref_block (uint32_t inode, uint32_t n)
+{
+    const uint8_t* in = ref_inode (inode);
+    const uint8_t* e = in + 16;
+    uint32_t i, left = INODE_EXTENTS, next = read32 (in + 12), count;
+
+    if (EXTENT_MAGIC != read32 (in + 4) && DIR_MAGIC != read32 (in + 4))
+	return n < INODE_BLOCKS ? read32 (in + 4 + 4 * n) : -1;
+    for (i = 0; i < read32 (in + 8); i++, e += 8) {
+	if (0 == left--) {
+	    if (next >= num_blocks)
+		return -1;
+	    e = ref + (size_t)(1 + num_inodes + next) * BLOCK_SIZE;
+	    next = read32 (e);
+	    e += 8;
+	    left = BLOCK_EXTENTS - 1;
+	}
+	count = read32 (e + 4);
+	if (n < count)
+	    return read32 (e) + n;
+	n -= count;
+    }
+    return -1;
+}
+
+/* What read_data should give for a read. */
+static uint32_t
+ref_read (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+    uint32_t len = read32 (ref_inode (inode)), done = 0, n, off;
+    int64_t b;
+
+    if (offset >= len)
+	return 0;
+    if (length > len - offset)
+	length = len - offset;
+    while (done < length) {
+	off = (offset + done) % BLOCK_SIZE;
+	n = BLOCK_SIZE - off < length - done ? BLOCK_SIZE - off : length - done;
+	if (-1 == (b = ref_block (inode, (offset + done) / BLOCK_SIZE)) || b >= num_blocks)
+	    break;
+	memcpy (buf + done, ref + (size_t)(1 + num_inodes + b) * BLOCK_SIZE + off, n);
+	done += n;
+    }
+    return done;
+}
+
+/* ---- checks ---- */
+
+static void
+fail (const char* fmt, ...)
+{
+    va_list ap;
+
+    va_start (ap, fmt);
+    vfprintf (stderr, fmt, ap);
+    va_end (ap);
+    fputc ('\n', stderr);
+    errors++;
+}
+
+/* The name of a dentry as a string. */
+static void
+dentry_name (const dentry_t* d, char* name)
+{
+    memcpy (name, d->f_name, NAME_LENGTH);
+    name[NAME_LENGTH] = '\0';
+}
+
+static int
+same_dentry (const dentry_t* a, const dentry_t* b)
+{
+    return 0 == memcmp (a->f_name, b->f_name, NAME_LENGTH) &&
+	a->f_type == b->f_type && a->inode_index == b->inode_index;
+}
+
+static void
+check_dentries (void)
+{
+    char name[NAME_LENGTH + 1];
+    char longer[NAME_LENGTH + 2];
+    dentry_t d;
+    uint32_t i;
+
+    for (i = 0; i < num_dentries; i++) {
+	dentry_name (ref_dentry (i), name);
+	if (0 != read_dentry_by_index (i, &d) || !same_dentry (&d, ref_dentry (i)))
+	    fail ("read_dentry_by_index %u: wrong dentry", i);
+	if (0 != read_dentry_by_name ((uint8_t*)name, &d) || !same_dentry (&d, ref_dentry (i)))
+	    fail ("read_dentry_by_name %s: wrong dentry", name);
+	/* only the first 32 characters of a longer name are compared, like walk_path */
+	if (NAME_LENGTH == strlen (name)) {
+	    sprintf (longer, "%sx", name);
+	    if (0 != read_dentry_by_name ((uint8_t*)longer, &d) || !same_dentry (&d, ref_dentry (i)))
+		fail ("read_dentry_by_name %s: should find %s", longer, name);
+	}
+    }
+    if (-1 != read_dentry_by_index (num_dentries, &d))
+	fail ("read_dentry_by_index %u: past the end but found", num_dentries);
+    if (-1 != read_dentry_by_name ((const uint8_t*)"no such file", &d))
+	fail ("read_dentry_by_name: missing name found");
+}
+
+/* The length given and the bytes read must match for reads of odd sizes
+   at offsets around block boundaries and the end, and reads through an
+   open file in odd chunks must give the whole file. */
+static void
+check_file (const dentry_t* de, uint8_t* got, uint8_t* want)
+{
+    static const uint32_t lengths[] = {0, 1, 100, 4095, 4096, 4097, 8192, 12345, MAX_READ};
+    char name[NAME_LENGTH + 1];
+    uint32_t inode = de->inode_index, len = read32 (ref_inode (inode));
+    uint32_t offsets[] = {0, 1, 4095, 4096, 4097, len / 2, len - 1, len, len + 1, 0xFFFFFFFF};
+    uint32_t i, j, n, total;
+    int32_t r;
+
+    dentry_name (de, name);
+    for (i = 0; i < sizeof (offsets) / sizeof (offsets[0]); i++)
+	for (j = 0; j < sizeof (lengths) / sizeof (lengths[0]); j++) {
+	    n = ref_read (inode, offsets[i], want, lengths[j]);
+	    memset (got, 0xAA, lengths[j]);
+	    r = read_data (inode, offsets[i], got, lengths[j]);
+	    if (r != (int32_t)n || 0 != memcmp (got, want, n))
+		fail ("read_data %s at %u for %u: %d bytes, should be %u", name, offsets[i], lengths[j], r, n);
+	}
+    if (len > MAX_READ)
+	return;
+    if (0 != fsbench_open (2, (uint8_t*)name)) {
+	fail ("open %s failed", name);
+	return;
+    }
+    for (total = 0; (r = fsbench_read (2, got + total, 777)) > 0; total += r);
+    fsbench_close (2);
+    if (total != len || total != ref_read (inode, 0, want, MAX_READ) || 0 != memcmp (got, want, len))
+	fail ("reading %s through a descriptor gave %u bytes, should be %u", name, total, len);
+}
+
+/* ---- timing ---- */
+
+static double
+now_ms (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static volatile int32_t sink;
+
+static void
+bench_lookups (const char* what, int by_name, char (*names)[NAME_LENGTH + 1], uint32_t n)
+{
+    double start = now_ms (), ms;
+    uint64_t calls = 0;
+    uint32_t i;
+    dentry_t d;
+
+    do {
+	for (i = 0; i < BATCH; i++, calls++)
+	    sink += by_name ? read_dentry_by_name ((uint8_t*)names[calls % n], &d)
+			    : read_dentry_by_index (calls % n, &d);
+    } while ((ms = now_ms () - start) < bench_ms);
+    printf ("%-36s %12.0f\n", what, calls / ms * 1e3);
+}
+
+/* Read a file from offset to its end in chunks over and over.  Returns MB/s. */
+static double
+bench_sequential (uint32_t inode, uint32_t len, uint32_t offset, uint32_t chunk, uint8_t* buf)
+{
+    double start = now_ms (), ms;
+    uint64_t bytes = 0;
+    uint32_t pos = offset;
+    int32_t r;
+
+    do {
+	for (r = 0; r < BATCH; r++) {
+	    if (pos >= len)
+		pos = offset;
+	    bytes += read_data (inode, pos, buf, chunk);
+	    pos += chunk;
+	}
+    } while ((ms = now_ms () - start) < bench_ms);
+    return bytes / ms / 1e3;
+}
+
+static double
+bench_random (uint32_t inode, uint32_t len, uint32_t chunk, uint8_t* buf, double* per_sec)
+{
+    double start = now_ms (), ms;
+    uint64_t bytes = 0, calls = 0;
+    uint32_t seed = 1;
+    int32_t r;
+
+    do {
+	for (r = 0; r < BATCH; r++, calls++) {
+	    seed = seed * 1103515245 + 12345;
+	    bytes += read_data (inode, (seed >> 8) % len, buf, chunk);
+	}
+    } while ((ms = now_ms () - start) < bench_ms);
+    *per_sec = calls / ms * 1e3;
+    return bytes / ms / 1e3;
+}
+
+static void
+bench_read (const dentry_t* de, uint8_t* buf)
+{
+    static const uint32_t chunks[] = {1, 64, 512, 4096, 65536, MAX_READ};
+    char name[NAME_LENGTH + 1];
+    uint32_t i, inode = de->inode_index, len = read32 (ref_inode (inode));
+    double per_sec, mb;
+
+    dentry_name (de, name);
+    printf ("\nread_data over %s, %u bytes\n", name, len);
+    printf ("%-12s %14s %14s %16s %12s\n", "chunk", "MB/s at 0", "MB/s at 1", "MB/s random", "reads/s");
+    for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++) {
+	printf ("%-12u %14.1f %14.1f", chunks[i],
+		bench_sequential (inode, len, 0, chunks[i], buf),
+		bench_sequential (inode, len, 1, chunks[i], buf));
+	mb = bench_random (inode, len, chunks[i], buf, &per_sec);
+	printf (" %16.1f %12.0f\n", mb, per_sec);
+    }
+}
+
+/* ---- main ---- */
+
+static uint8_t*
+load (const char* file, uint32_t* size)
+{
+    FILE* f = fopen (file, "rb");
+    uint8_t* img;
+    long len;
+
+    if (NULL == f || 0 != fseek (f, 0, SEEK_END) || 0 > (len = ftell (f))) {
+	perror (file);
+	exit (2);
+    }
+    rewind (f);
+    img = mmap (NULL, len + BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (MAP_FAILED == img || (size_t)len != fread (img, 1, len, f)) {
+	perror (file);
+	exit (2);
+    }
+    fclose (f);
+    *size = len;
+    return img;
+}
+
+int
+main (int argc, char* argv[])
+{
+    const char* file = "../student-distrib/filesys_img";
+    char names[MAX_DENTRIES][NAME_LENGTH + 1];
+    char misses[4][NAME_LENGTH + 1] = {"no such file", "shel", "shell2", "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz"};
+    uint8_t* img;
+    uint8_t* copy;
+    uint8_t* got;
+    uint8_t* want;
+    uint32_t size, i, largest = MAX_DENTRIES, stats[5];
+    int c, disk = 0;
+
+    while (-1 != (c = getopt (argc, argv, "dt:"))) {
+	switch (c) {
+	    case 'd': disk = 1; break;
+	    case 't': bench_ms = atof (optarg); break;
+	    default:
+		fprintf (stderr, "usage: %s [-d] [-t ms] [image]\n", argv[0]);
+		return 2;
+	}
+    }
+    if (optind < argc)
+	file = argv[optind];
+
+    pool = mmap (NULL, (size_t)POOL_FRAMES * BLOCK_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (MAP_FAILED == pool) {
+	perror ("mmap");
+	return 2;
+    }
+    img = load (file, &size);
+    if (size >= 4 && ZIMAGE_MAGIC == read32 (img)) {
+	fprintf (stderr, "%s is compressed, expand it with fscompress -d first\n", file);
+	return 1;
+    }
+    num_dentries = read32 (img);
+    num_inodes = read32 (img + 4);
+    num_blocks = read32 (img + 8);
+    if (size < BLOCK_SIZE || 0 == num_dentries || num_dentries > MAX_DENTRIES || 0 == num_inodes ||
+	(uint64_t)(1 + num_inodes + num_blocks) * BLOCK_SIZE > size) {
+	fprintf (stderr, "%s doesn't look like a filesystem image\n", file);
+	return 1;
+    }
+    if (NULL == (copy = malloc (size)) || NULL == (got = malloc (MAX_READ)) || NULL == (want = malloc (MAX_READ))) {
+	perror ("malloc");
+	return 2;
+    }
+    memcpy (copy, img, size);
+    ref = copy;
+
+    fsbench_task_init ();
+    if (0 != (disk ? fsbench_mount_disk (img, size)
+		   : filesystem_init ((uint32_t)(uintptr_t)img, (uint32_t)(uintptr_t)img + size))) {
+	fprintf (stderr, "%s: fs.c won't mount it\n", file);
+	return 1;
+    }
+    printf ("%s: %u dentries, %u inodes, %u data blocks, %s\n", file, num_dentries, num_inodes,
+	    num_blocks, disk ? "through the buffer cache" : "in memory");
+
+    check_dentries ();
+    for (i = 0; i < num_dentries; i++) {
+	dentry_name (ref_dentry (i), names[i]);
+	if (FILE_TYPE_FILE != ref_dentry (i)->f_type || ref_dentry (i)->inode_index >= num_inodes)
+	    continue;
+	check_file (ref_dentry (i), got, want);
+	if (MAX_DENTRIES == largest ||
+	    read32 (ref_inode (ref_dentry (i)->inode_index)) > read32 (ref_inode (ref_dentry (largest)->inode_index)))
+	    largest = i;
+    }
+    if (0 != errors) {
+	fprintf (stderr, "%u checks failed\n", errors);
+	return 1;
+    }
+    printf ("checks passed, %u frames held\n\n", frames_used);
+
+    printf ("%-36s %12s\n", "lookup", "calls/s");
+    bench_lookups ("read_dentry_by_index", 0, names, num_dentries);
+    bench_lookups ("read_dentry_by_name, every entry", 1, names, num_dentries);
+    bench_lookups ("read_dentry_by_name, missing names", 1, misses, 4);
+    if (MAX_DENTRIES != largest)
+	bench_read (ref_dentry (largest), got);
+    if (disk) {
+	fsbench_cache_stats (stats);
+	printf ("\nbuffer cache: %u hits, %u misses, %u read ahead, %u writes, %u evictions\n",
+		stats[0], stats[1], stats[2], stats[3], stats[4]);
+    }
+    return 0;
+}
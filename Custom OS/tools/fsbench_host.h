@@ -0,0 +1,12 @@
+/* fsbench_host.h - included ahead of everything when drivers/fs.c and
+ * bcache.c are built for Linux by fsbench.  The kernel's lib.h is used
+ * as is, its string functions come from the C library, and interrupts
+ * are never off since nothing runs but the benchmark.
+ */
+
+#include "../student-distrib/lib.h"
+
+#undef cli_and_save
+#define cli_and_save(flags) ((flags) = 0)
+#undef restore_flags
+#define restore_flags(flags) ((void)(flags))
@@ -0,0 +1,130 @@
+/* fsbench_stubs.c - the kernel that drivers/fs.c expects around it, for
+ * fsbench: one task with a few open files and no devices.  Built with the
+ * kernel's headers, frames come from fsbench.c.
+ */
+
+#include "../student-distrib/tasks.h"
+#include "../student-distrib/vfs.h"
+#include "../student-distrib/bcache.h"
+#include "../student-distrib/lib.h"
+#include "../student-distrib/drivers/fs.h"
+
+static file_desc_t files[FD_TABLE_INIT];
+static block_device_t disk;
+static uint8_t* disk_image;
+static pcb_t task;
+pcb_t* current_task_pcb;
+
+/* Give the task its descriptor table. */
+void
+fsbench_task_init (void)
+{
+    uint32_t i;
+
+    task.fd_table = task.fd_small;
+    task.fd_max = FD_TABLE_INIT;
+    for (i = 0; i < FD_TABLE_INIT; i++)
+	task.fd_small[i] = &files[i];
+    current_task_pcb = &task;
+}
+
+/* Open a file through fs_op_table the way the open syscall does.  Returns
+   0 on success, -1 if fs.c won't open it. */
+int32_t
+fsbench_open (int32_t fd, const uint8_t* name)
+{
+    files[fd].file_op_table_ptr = &fs_op_table;
+    files[fd].inode = 0;
+    files[fd].file_position = 0;
+    files[fd].flags = FD_OPEN;
+    files[fd].refcount = 1;
+    if (0 != fs_op_table.open (fd, name)) {
+	files[fd].flags = 0;
+	return -1;
+    }
+    return 0;
+}
+
+int32_t
+fsbench_read (int32_t fd, void* buf, int32_t nbytes)
+{
+    return fs_op_table.read (fd, buf, nbytes);
+}
+
+void
+fsbench_close (int32_t fd)
+{
+    fs_op_table.close (fd);
+    files[fd].flags = 0;
+}
+
+static int32_t
+disk_read (block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs)
+{
+    uint32_t i;
+
+    if (block >= dev->num_blocks || count > dev->num_blocks - block)
+	return -1;
+    for (i = 0; i < count; i++)
+	memcpy (bufs[i], disk_image + (block + i) * BLOCK_SIZE, BLOCK_SIZE);
+    return 0;
+}
+
+static int32_t
+disk_write (block_device_t* dev, uint32_t block, uint32_t count, uint8_t* const* bufs)
+{
+    uint32_t i;
+
+    if (block >= dev->num_blocks || count > dev->num_blocks - block)
+	return -1;
+    for (i = 0; i < count; i++)
+	memcpy (disk_image + (block + i) * BLOCK_SIZE, bufs[i], BLOCK_SIZE);
+    return 0;
+}
+
+/* Mount an image as a disk held in memory, so every block goes through
+   the buffer cache like an image on an ATA drive.  Returns 0 on success,
+   -1 if fs.c doesn't take it. */
+int32_t
+fsbench_mount_disk (uint8_t* image, uint32_t size)
+{
+    disk_image = image;
+    disk.num_blocks = size / BLOCK_SIZE;
+    disk.read = disk_read;
+    disk.write = disk_write;
+    disk.flush = 0;
+    return filesystem_init_disk (&disk);
+}
+
+/* Copy out the buffer cache counters in bcache_stats_t order. */
+void
+fsbench_cache_stats (uint32_t* out)
+{
+    bcache_stats_t st;
+
+    bcache_get_stats (&st);
+    memcpy (out, &st, sizeof (st));
+}
+
+/* same as tasks.c */
+file_desc_t*
+fd_file (int32_t fd)
+{
+    if (fd < 0 || fd >= current_task_pcb->fd_max)
+	return 0;
+    return current_task_pcb->fd_table[fd];
+}
+
+/* there are no devices, so rtc entries don't open */
+file_operations_t*
+vfs_find_device (const uint8_t* name)
+{
+    return 0;
+}
+
+/* nothing is mapped without tasks */
+int32_t
+task_maps_inode (uint32_t inode)
+{
+    return 0;
+}
@@ -0,0 +1,883 @@
+/* fsbuild - builds a filesystem image from a directory, and checks images
+ *
+ *     fsbuild [-r] [-a order] [-n inodes] [-s spare] -i dir -o image
+ *     fsbuild --verify image
+ *
+ * Takes the place of createfs.  Subdirectories of dir become directories of
+ * the image.  Every file gets one extent inode and its blocks in one run, and
+ * files go in the order given by the order file, one path relative to dir per
+ * line with the most used first, then the rest by name.  Directory blocks go
+ * first since every lookup reads them.  The root gets "." and "rtc" before its
+ * files.  The block and inode bitmaps are written so the kernel doesn't have to
+ * build them at boot, with spare free blocks and inodes for files made later.
+ * -r prints where everything went.  Every image built is checked the same way
+ * --verify checks an existing one before it is written.
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define BLOCK_SIZE 4096
+#define NAME_LENGTH 32
+#define MAX_DENTRIES 63
+#define FILE_TYPE_RTC 0
+#define FILE_TYPE_DIR 1
+#define FILE_TYPE_FILE 2
+#define FS_MAGIC 0x53465752     /* "RWFS" */
+#define FS_MAX_INODES 256
+#define FS_MAX_DEPTH 16
+#define FS_MAX_LENGTH 0xFFFFF000
+#define MAX_DATABLOCKS (BLOCK_SIZE * 8)  /* blocks the block bitmap has bits for */
+#define INODE_BLOCKS (BLOCK_SIZE / 4 - 1)
+#define EXTENT_MAGIC 0x31545845 /* "EXT1" */
+#define EXTENT_NONE 0xFFFFFFFF
+#define INODE_EXTENTS ((BLOCK_SIZE - 16) / 8)
+#define BLOCK_EXTENTS ((BLOCK_SIZE - 8) / 8)
+#define DIR_MAGIC 0x31524944    /* "DIR1" */
+#define DIR_ENTRIES 63
+#define DIR_BUCKETS 4
+#define ZIMAGE_MAGIC 0x3153465A /* "ZFS1" */
+#define DEFAULT_INODES 64
+#define DEFAULT_SPARE 64
+#define SPARE_INODES 16  /* free inodes left when there are more files than DEFAULT_INODES */
+#define UNRANKED 0xFFFFFFFF
+
+/* the on-image layout, see student-distrib/drivers/fs.h */
+typedef struct dentry {
+    uint8_t f_name[NAME_LENGTH];
+    uint32_t f_type;
+    uint32_t inode_index;
+    uint8_t reserved[24];
+} __attribute__((packed)) dentry_t;
+
+typedef struct boot_block {
+    uint32_t num_dentries;
+    uint32_t num_inodes;
+    uint32_t num_datablocks;
+    uint32_t fs_magic;
+    uint32_t bitmap_block;
+    uint8_t inode_bitmap[FS_MAX_INODES / 8];
+    uint8_t reserved[12];
+    dentry_t dentries[MAX_DENTRIES];
+} __attribute__((packed)) boot_block_t;
+
+typedef struct inode {
+    uint32_t length;
+    uint32_t db_index[INODE_BLOCKS];
+} __attribute__((packed)) inode_t;
+
+typedef struct extent {
+    uint32_t start;
+    uint32_t count;
+} __attribute__((packed)) extent_t;
+
+typedef struct extent_inode {
+    uint32_t length;
+    uint32_t magic;
+    uint32_t num_extents;
+    uint32_t indirect;
+    extent_t extents[INODE_EXTENTS];
+} __attribute__((packed)) extent_inode_t;
+
+typedef struct extent_block {
+    uint32_t next;
+    uint32_t reserved;
+    extent_t extents[BLOCK_EXTENTS];
+} __attribute__((packed)) extent_block_t;
+
+typedef struct dir_block {
+    uint32_t num_buckets;
+    uint32_t next;
+    uint32_t count;
+    uint8_t reserved[52];
+    dentry_t entries[DIR_ENTRIES];
+} __attribute__((packed)) dir_block_t;
+
+/* a file or directory found under the source directory */
+typedef struct node {
+    char name[NAME_LENGTH + 1];
+    char* path;                 /* on the host */
+    char* rel;                  /* relative to the source directory */
+    int is_dir;
+    uint32_t size;
+    uint32_t rank;              /* line in the order file, UNRANKED if not in it */
+    uint32_t seq;               /* place in name order, breaks ties in rank */
+    uint32_t inode;
+    uint32_t start;             /* first data block */
+    uint32_t blocks;
+    dir_block_t* dir;           /* built directory blocks */
+    struct node* parent;
+    struct node** kids;
+    uint32_t num_kids;
+} node_t;
+
+static node_t** all;            /* every node but the root, in name order */
+static uint32_t num_all;
+
+/* the image being checked */
+static const uint8_t* img;
+static const boot_block_t* boot;
+static uint32_t num_inodes, num_blocks;
+static uint8_t* block_refs;
+static uint8_t* inode_refs;
+static uint32_t errors, num_files, num_dirs, fragmented;
+
+static uint32_t
+name_hash (const uint8_t* name)
+{
+    uint32_t i, hash = 5381;
+
+    for (i = 0; i < NAME_LENGTH && name[i]; i++)
+	hash = hash * 33 + name[i];
+    return hash;
+}
+
+static void*
+xcalloc (size_t n, size_t size)
+{
+    void* p = calloc (n ? n : 1, size);
+
+    if (NULL == p) {
+	perror ("calloc");
+	exit (2);
+    }
+    return p;
+}
+
+static char*
+join (const char* a, const char* b)
+{
+    char* s = xcalloc (strlen (a) + strlen (b) + 2, 1);
+
+    if ('\0' == a[0])
+	strcpy (s, b);
+    else
+	sprintf (s, "%s/%s", a, b);
+    return s;
+}
+
+static int
+by_name (const void* a, const void* b)
+{
+    return strcmp ((*(node_t* const*)a)->name, (*(node_t* const*)b)->name);
+}
+
+static int
+by_rank (const void* a, const void* b)
+{
+    const node_t* x = *(node_t* const*)a;
+    const node_t* y = *(node_t* const*)b;
+
+    if (x->rank != y->rank)
+	return x->rank < y->rank ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+/* Read a directory of the host and everything under it.  Names too long
+   for a dentry are cut short, like createfs did. */
+static void
+scan (node_t* dir, uint32_t depth)
+{
+    DIR* d;
+    struct dirent* e;
+    struct stat st;
+    node_t* n;
+    uint32_t cap = 0;
+
+    if (depth > FS_MAX_DEPTH) {
+	fprintf (stderr, "%s: nested too deep\n", dir->path);
+	exit (1);
+    }
+    if (NULL == (d = opendir (dir->path))) {
+	perror (dir->path);
+	exit (2);
+    }
+    while (NULL != (e = readdir (d))) {
+	if (0 == strcmp (e->d_name, ".") || 0 == strcmp (e->d_name, ".."))
+	    continue;
+	n = xcalloc (1, sizeof (node_t));
+	n->path = join (dir->path, e->d_name);
+	if (0 != stat (n->path, &st)) {
+	    perror (n->path);
+	    exit (2);
+	}
+	if (!S_ISDIR (st.st_mode) && !S_ISREG (st.st_mode)) {
+	    fprintf (stderr, "%s: skipped, not a file or directory\n", n->path);
+	    continue;
+	}
+	if (strlen (e->d_name) > NAME_LENGTH)
+	    fprintf (stderr, "%s: name cut to %d characters\n", n->path, NAME_LENGTH);
+	memcpy (n->name, e->d_name, strnlen (e->d_name, NAME_LENGTH));
+	if (S_ISREG (st.st_mode) && st.st_size > FS_MAX_LENGTH) {
+	    fprintf (stderr, "%s: too big\n", n->path);
+	    exit (1);
+	}
+	n->is_dir = S_ISDIR (st.st_mode);
+	n->size = n->is_dir ? 0 : st.st_size;
+	n->rel = join (dir->rel, n->name);
+	n->rank = UNRANKED;
+	n->parent = dir;
+	if (dir->num_kids == cap &&
+	    NULL == (dir->kids = realloc (dir->kids, (cap = cap * 2 + 8) * sizeof (node_t*)))) {
+	    perror ("realloc");
+	    exit (2);
+	}
+	dir->kids[dir->num_kids++] = n;
+    }
+    closedir (d);
+    qsort (dir->kids, dir->num_kids, sizeof (node_t*), by_name);
+    for (cap = 1; cap < dir->num_kids; cap++)
+	if (0 == strcmp (dir->kids[cap - 1]->name, dir->kids[cap]->name)) {
+	    fprintf (stderr, "%s: same name as another once cut short\n", dir->kids[cap]->path);
+	    exit (1);
+	}
+}
+
+/* Number every node in name order, depth first. */
+static void
+scan_tree (node_t* dir, uint32_t depth)
+{
+    uint32_t i;
+
+    scan (dir, depth);
+    for (i = 0; i < dir->num_kids; i++) {
+	if (NULL == (all = realloc (all, (num_all + 1) * sizeof (node_t*)))) {
+	    perror ("realloc");
+	    exit (2);
+	}
+	dir->kids[i]->seq = num_all;
+	all[num_all++] = dir->kids[i];
+	if (dir->kids[i]->is_dir)
+	    scan_tree (dir->kids[i], depth + 1);
+    }
+}
+
+/* Rank the paths listed in the order file.  A listed directory ranks no
+   lower than the first file listed under it. */
+static void
+read_order (const char* name)
+{
+    FILE* f = fopen (name, "r");
+    char line[1024];
+    uint32_t i, rank = 0;
+    size_t len;
+    node_t* n;
+
+    if (NULL == f) {
+	perror (name);
+	exit (2);
+    }
+    while (NULL != fgets (line, sizeof (line), f)) {
+	len = strcspn (line, "\r\n");
+	line[len] = '\0';
+	while (len > 0 && '/' == line[len - 1])
+	    line[--len] = '\0';
+	if ('\0' == line[0] || '#' == line[0])
+	    continue;
+	for (i = 0; i < num_all && 0 != strcmp (all[i]->rel, line); i++);
+	if (i == num_all) {
+	    fprintf (stderr, "%s: %s isn't in the source directory\n", name, line);
+	    continue;
+	}
+	for (n = all[i]; NULL != n->parent; n = n->parent)
+	    if (UNRANKED == n->rank)
+		n->rank = rank;
+	rank++;
+    }
+    fclose (f);
+}
+
+static void
+set_name (dentry_t* d, const char* name, uint32_t type, uint32_t inode)
+{
+    memset (d, 0, sizeof (dentry_t));
+    memcpy (d->f_name, name, strnlen (name, NAME_LENGTH));
+    d->f_type = type;
+    d->inode_index = inode;
+}
+
+/* Lay out the blocks of a subdirectory: enough buckets to keep chains to
+   about one block, each name added to the end of its bucket's chain and a
+   full chain getting a block after the others. */
+static void
+build_dir (node_t* dir)
+{
+    uint32_t i, k, n = dir->num_kids + 2;
+    uint32_t buckets = (n + DIR_ENTRIES * 3 / 4 - 1) / (DIR_ENTRIES * 3 / 4);
+    uint32_t cap;
+    dentry_t d;
+
+    if (buckets < DIR_BUCKETS)
+	buckets = DIR_BUCKETS;
+    cap = buckets + n / DIR_ENTRIES + 1;
+    dir->dir = xcalloc (cap, sizeof (dir_block_t));
+    dir->blocks = buckets;
+    dir->dir[0].num_buckets = buckets;
+    for (i = 0; i < n; i++) {
+	if (0 == i)
+	    set_name (&d, ".", FILE_TYPE_DIR, dir->inode);
+	else if (1 == i)
+	    set_name (&d, "..", FILE_TYPE_DIR, dir->parent->inode);
+	else
+	    set_name (&d, dir->kids[i - 2]->name,
+		      dir->kids[i - 2]->is_dir ? FILE_TYPE_DIR : FILE_TYPE_FILE,
+		      dir->kids[i - 2]->inode);
+	for (k = name_hash (d.f_name) % buckets; dir->dir[k].next; k = dir->dir[k].next);
+	if (DIR_ENTRIES == dir->dir[k].count) {
+	    if (dir->blocks == cap &&
+		NULL == (dir->dir = realloc (dir->dir, ++cap * sizeof (dir_block_t)))) {
+		perror ("realloc");
+		exit (2);
+	    }
+	    memset (&dir->dir[dir->blocks], 0, sizeof (dir_block_t));
+	    dir->dir[k].next = dir->blocks;
+	    k = dir->blocks++;
+	}
+	dir->dir[k].entries[dir->dir[k].count++] = d;
+    }
+}
+
+static void
+set_bit (uint8_t* map, uint32_t bit)
+{
+    map[bit / 8] |= 1 << (bit % 8);
+}
+
+static int
+test_bit (const uint8_t* map, uint32_t bit)
+{
+    return (map[bit / 8] >> (bit % 8)) & 1;
+}
+
+/* ---- checking ---- */
+
+static void
+report_error (const char* path, const char* fmt, ...)
+{
+    va_list ap;
+
+    fprintf (stderr, "/%s: ", path);
+    va_start (ap, fmt);
+    vfprintf (stderr, fmt, ap);
+    va_end (ap);
+    fputc ('\n', stderr);
+    errors++;
+}
+
+static const uint8_t*
+data_block (uint32_t b)
+{
+    return img + (size_t)(1 + num_inodes + b) * BLOCK_SIZE;
+}
+
+static void
+use_block (const char* path, uint32_t b)
+{
+    if (b >= num_blocks)
+	report_error (path, "block %u is past the %u data blocks", b, num_blocks);
+    else if (1 < ++block_refs[b])
+	report_error (path, "block %u is used more than once", b);
+}
+
+/* Collect the data blocks of a file in order, the same ones the kernel
+   reads: as many as the length needs, and the indirect extent blocks.
+   Returns the number of blocks, -1 if the inode is bad. */
+static int32_t
+file_blocks (const char* path, uint32_t inode, uint32_t** out)
+{
+    const extent_inode_t* in = (const extent_inode_t*)(img + (size_t)(1 + inode) * BLOCK_SIZE);
+    const inode_t* old = (const inode_t*)in;
+    const extent_t* e = in->extents;
+    uint32_t i, j, left = INODE_EXTENTS, next = in->indirect, chain = 0, runs = 0;
+    uint32_t n = (in->length + BLOCK_SIZE - 1) / BLOCK_SIZE, got = 0;
+    uint32_t* list = xcalloc (n, sizeof (uint32_t));
+
+    *out = list;
+    if (EXTENT_MAGIC != in->magic && DIR_MAGIC != in->magic) {
+	if (n > INODE_BLOCKS) {
+	    report_error (path, "length %u is too long for an inode without extents", in->length);
+	    return -1;
+	}
+	for (got = 0; got < n; got++)
+	    list[got] = old->db_index[got];
+    }
+    else {
+	for (i = 0; i < in->num_extents && got < n; i++, e++, left--) {
+	    if (0 == left) {
+		if (EXTENT_NONE == next || next >= num_blocks || ++chain > num_blocks) {
+		    report_error (path, "extent %u is missing", i);
+		    return -1;
+		}
+		use_block (path, next);
+		e = ((const extent_block_t*)data_block (next))->extents;
+		next = ((const extent_block_t*)data_block (next))->next;
+		left = BLOCK_EXTENTS;
+	    }
+	    if (0 == e->count || e->start >= num_blocks || e->count > num_blocks - e->start) {
+		report_error (path, "extent %u (%u blocks at %u) is out of range", i, e->count, e->start);
+		return -1;
+	    }
+	    for (j = 0; j < e->count && got < n; j++)
+		list[got++] = e->start + j;
+	}
+	if (got < n) {
+	    report_error (path, "extents hold %u blocks, the length needs %u", got, n);
+	    return -1;
+	}
+	/* the kernel follows the whole chain when it frees or marks blocks */
+	for (; i < in->num_extents; i++, left--) {
+	    if (0 == left) {
+		if (EXTENT_NONE == next || next >= num_blocks || ++chain > num_blocks)
+		    break;
+		use_block (path, next);
+		next = ((const extent_block_t*)data_block (next))->next;
+		left = BLOCK_EXTENTS;
+	    }
+	}
+    }
+    for (i = 0; i < n; i++) {
+	use_block (path, list[i]);
+	if (0 == i || list[i] != list[i - 1] + 1)
+	    runs++;
+    }
+    if (runs > 1)
+	fragmented++;
+    return n;
+}
+
+static int
+is_name (const dentry_t* d, const char* name)
+{
+    return 0 == strncmp ((const char*)d->f_name, name, NAME_LENGTH);
+}
+
+static void check_dir (const char* path, uint32_t inode, uint32_t parent, uint32_t depth);
+
+/* Check one entry of a directory and what it leads to. */
+static void
+check_entry (const char* dir_path, const dentry_t* d, uint32_t dir, uint32_t parent, uint32_t depth)
+{
+    char name[NAME_LENGTH + 1];
+    char* path;
+    uint32_t* blocks;
+    const extent_inode_t* in;
+
+    memcpy (name, d->f_name, NAME_LENGTH);
+    name[NAME_LENGTH] = '\0';
+    path = join (dir_path, name);
+    if (is_name (d, ".") || is_name (d, "..")) {
+	if (FILE_TYPE_DIR != d->f_type)
+	    report_error (path, "isn't a directory");
+	else if (d->inode_index != (is_name (d, ".") ? dir : parent))
+	    report_error (path, "is inode %u, should be %u", d->inode_index, is_name (d, ".") ? dir : parent);
+	free (path);
+	return;
+    }
+    if (FILE_TYPE_RTC == d->f_type) {
+	free (path);
+	return;
+    }
+    if (FILE_TYPE_FILE != d->f_type && FILE_TYPE_DIR != d->f_type) {
+	report_error (path, "has unknown type %u", d->f_type);
+	free (path);
+	return;
+    }
+    if (0 == d->inode_index || d->inode_index >= num_inodes) {
+	report_error (path, "inode %u is out of range", d->inode_index);
+	free (path);
+	return;
+    }
+    if (1 < ++inode_refs[d->inode_index]) {
+	report_error (path, "inode %u is used by another entry", d->inode_index);
+	free (path);
+	return;
+    }
+    in = (const extent_inode_t*)(img + (size_t)(1 + d->inode_index) * BLOCK_SIZE);
+    if (FILE_TYPE_DIR == d->f_type) {
+	num_dirs++;
+	if (DIR_MAGIC != in->magic)
+	    report_error (path, "inode %u isn't a directory inode", d->inode_index);
+	else if (depth >= FS_MAX_DEPTH)
+	    report_error (path, "nested too deep");
+	else
+	    check_dir (path, d->inode_index, dir, depth + 1);
+    }
+    else {
+	num_files++;
+	if (DIR_MAGIC == in->magic)
+	    report_error (path, "inode %u is a directory inode", d->inode_index);
+	else
+	    file_blocks (path, d->inode_index, &blocks), free (blocks);
+    }
+    free (path);
+}
+
+/* Check that no name is in a directory twice. */
+static void
+check_names (const char* path, const dentry_t** names, uint32_t n)
+{
+    uint32_t i, j;
+
+    for (i = 0; i < n; i++)
+	for (j = i + 1; j < n; j++)
+	    if (0 == strncmp ((const char*)names[i]->f_name, (const char*)names[j]->f_name, NAME_LENGTH))
+		report_error (path, "%.32s is in the directory twice", names[i]->f_name);
+}
+
+/* Check a subdirectory: every block on exactly one chain, every name on the
+   chain of its bucket, counts right, and . and .. present. */
+static void
+check_dir (const char* path, uint32_t inode, uint32_t parent, uint32_t depth)
+{
+    const extent_inode_t* in = (const extent_inode_t*)(img + (size_t)(1 + inode) * BLOCK_SIZE);
+    const dir_block_t* blk;
+    const dentry_t** names;
+    uint32_t* blocks;
+    int32_t* chain;
+    int32_t n;
+    uint32_t i, j, k, used, buckets, num_names = 0, dots = 0;
+
+    if (0 == in->length || 0 != in->length % BLOCK_SIZE) {
+	report_error (path, "directory length %u isn't whole blocks", in->length);
+	return;
+    }
+    if (0 >= (n = file_blocks (path, inode, &blocks))) {
+	free (blocks);
+	return;
+    }
+    buckets = ((const dir_block_t*)data_block (blocks[0]))->num_buckets;
+    if (0 == buckets || buckets > (uint32_t)n) {
+	report_error (path, "has %u buckets in %d blocks", buckets, n);
+	free (blocks);
+	return;
+    }
+    chain = xcalloc (n, sizeof (int32_t));
+    for (i = 0; i < (uint32_t)n; i++)
+	chain[i] = -1;
+    for (i = 0; i < buckets; i++)
+	for (k = i; ; k = blk->next) {
+	    if (-1 != chain[k]) {
+		report_error (path, "block %u is on more than one chain", k);
+		break;
+	    }
+	    chain[k] = i;
+	    blk = (const dir_block_t*)data_block (blocks[k]);
+	    if (0 == blk->next)
+		break;
+	    if (blk->next >= (uint32_t)n || blk->next < buckets) {
+		report_error (path, "block %u goes on to block %u", k, blk->next);
+		break;
+	    }
+	}
+    names = xcalloc ((size_t)n * DIR_ENTRIES, sizeof (dentry_t*));
+    for (k = 0; k < (uint32_t)n; k++) {
+	blk = (const dir_block_t*)data_block (blocks[k]);
+	for (i = used = 0; i < DIR_ENTRIES; i++) {
+	    if ('\0' == blk->entries[i].f_name[0])
+		continue;
+	    used++;
+	    if (-1 == chain[k])
+		report_error (path, "%.32s is in block %u, which is on no chain", blk->entries[i].f_name, k);
+	    else if (name_hash (blk->entries[i].f_name) % buckets != (uint32_t)chain[k])
+		report_error (path, "%.32s is on the chain of bucket %d, not %u", blk->entries[i].f_name,
+			      chain[k], name_hash (blk->entries[i].f_name) % buckets);
+	    if (is_name (&blk->entries[i], ".") || is_name (&blk->entries[i], ".."))
+		dots++;
+	    names[num_names++] = &blk->entries[i];
+	}
+	if (used != blk->count)
+	    report_error (path, "block %u counts %u entries, has %u", k, blk->count, used);
+    }
+    if (2 != dots)
+	report_error (path, "needs one . and one ..");
+    check_names (path, names, num_names);
+    for (j = 0; j < num_names; j++)
+	check_entry (path, names[j], inode, parent, depth);
+    free (names);
+    free (chain);
+    free (blocks);
+}
+
+/* Check an image in memory, printing every problem.  Returns the number of
+   problems found. */
+static uint32_t
+check_image (const char* name, const uint8_t* image, size_t size)
+{
+    const dentry_t* names[MAX_DENTRIES];
+    uint32_t i, used = 0;
+
+    img = image;
+    boot = (const boot_block_t*)image;
+    errors = num_files = num_dirs = fragmented = 0;
+    if (size >= 4 && ZIMAGE_MAGIC == *(const uint32_t*)image) {
+	fprintf (stderr, "%s is compressed, expand it with fscompress -d first\n", name);
+	return 1;
+    }
+    if (size < BLOCK_SIZE) {
+	fprintf (stderr, "%s is smaller than a boot block\n", name);
+	return 1;
+    }
+    num_inodes = boot->num_inodes;
+    num_blocks = boot->num_datablocks;
+    if (0 == boot->num_dentries || boot->num_dentries > MAX_DENTRIES || 0 == num_inodes ||
+	num_inodes > size / BLOCK_SIZE || num_blocks > size / BLOCK_SIZE - 1 - num_inodes) {
+	fprintf (stderr, "%s: boot block has %u dentries, %u inodes, %u data blocks for %zu bytes\n",
+		 name, boot->num_dentries, num_inodes, num_blocks, size);
+	return 1;
+    }
+    if (!is_name (&boot->dentries[0], ".") || FILE_TYPE_DIR != boot->dentries[0].f_type)
+	report_error ("", "first dentry isn't .");
+    block_refs = xcalloc (num_blocks, 1);
+    inode_refs = xcalloc (num_inodes, 1);
+    for (i = 0; i < boot->num_dentries; i++)
+	names[i] = &boot->dentries[i];
+    check_names ("", names, boot->num_dentries);
+    for (i = 0; i < boot->num_dentries; i++) {
+	if (is_name (&boot->dentries[i], ".."))
+	    report_error ("", "the root has no ..");
+	else
+	    check_entry ("", &boot->dentries[i], 0, 0, 0);
+    }
+    if (FS_MAGIC == boot->fs_magic) {
+	const uint8_t* bitmap;
+	if (boot->bitmap_block >= num_blocks || num_inodes > FS_MAX_INODES || num_blocks > MAX_DATABLOCKS) {
+	    report_error ("", "bitmap block %u is out of range", boot->bitmap_block);
+	}
+	else {
+	    use_block ("block bitmap", boot->bitmap_block);
+	    bitmap = data_block (boot->bitmap_block);
+	    for (i = 0; i < num_blocks; i++) {
+		if (block_refs[i] && !test_bit (bitmap, i))
+		    report_error ("", "block %u is used but free in the bitmap", i);
+		else if (!block_refs[i] && test_bit (bitmap, i))
+		    report_error ("", "block %u is set but nothing uses it", i);
+	    }
+	    inode_refs[0] = 1;
+	    for (i = 0; i < num_inodes; i++) {
+		if (inode_refs[i] && !test_bit (boot->inode_bitmap, i))
+		    report_error ("", "inode %u is used but free in the bitmap", i);
+		else if (!inode_refs[i] && test_bit (boot->inode_bitmap, i))
+		    report_error ("", "inode %u is set but nothing uses it", i);
+	    }
+	}
+    }
+    for (i = 0; i < num_blocks; i++)
+	used += (0 != block_refs[i]);
+    printf ("%s: %u files, %u directories, %u of %u blocks used, %u files in more than one run%s\n",
+	    name, num_files, num_dirs, used, num_blocks, fragmented,
+	    FS_MAGIC == boot->fs_magic ? "" : ", no bitmaps");
+    free (block_refs);
+    free (inode_refs);
+    return errors;
+}
+
+/* ---- building ---- */
+
+static int
+build (const char* src, const char* out, const char* order, uint32_t inodes,
+       uint32_t spare, int report)
+{
+    node_t root;
+    node_t** place;
+    uint32_t i, k, n, next_inode = 1, next_block = 0, bitmap;
+    size_t size;
+    uint8_t* image;
+    boot_block_t* b;
+    extent_inode_t* in;
+    FILE* f;
+
+    memset (&root, 0, sizeof (root));
+    root.path = (char*)src;
+    root.rel = "";
+    root.is_dir = 1;
+    scan_tree (&root, 0);
+    if (NULL != order)
+	read_order (order);
+    if (root.num_kids > MAX_DENTRIES - 2) {
+	fprintf (stderr, "%s: the root holds %d entries besides . and rtc\n", src, MAX_DENTRIES - 2);
+	return 1;
+    }
+
+    /* directories first, then files, each in rank then name order */
+    place = xcalloc (num_all, sizeof (node_t*));
+    for (i = n = 0; i < num_all; i++)
+	if (all[i]->is_dir)
+	    place[n++] = all[i];
+    qsort (place, n, sizeof (node_t*), by_rank);
+    for (i = 0, k = n; i < num_all; i++)
+	if (!all[i]->is_dir)
+	    place[k++] = all[i];
+    qsort (place + n, num_all - n, sizeof (node_t*), by_rank);
+    for (i = 0; i < num_all; i++) {
+	place[i]->inode = next_inode++;
+	qsort (place[i]->kids, place[i]->num_kids, sizeof (node_t*), by_rank);
+    }
+    qsort (root.kids, root.num_kids, sizeof (node_t*), by_rank);
+    for (i = 0; i < num_all; i++) {
+	if (place[i]->is_dir)
+	    build_dir (place[i]);
+	else
+	    place[i]->blocks = (place[i]->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	place[i]->start = next_block;
+	next_block += place[i]->blocks;
+    }
+    bitmap = next_block++;
+    if (0 == inodes) {
+	inodes = next_inode + SPARE_INODES;
+	if (inodes < DEFAULT_INODES)
+	    inodes = DEFAULT_INODES;
+	if (inodes > FS_MAX_INODES && next_inode <= FS_MAX_INODES)
+	    inodes = FS_MAX_INODES;
+    }
+    if (inodes > FS_MAX_INODES) {
+	fprintf (stderr, "%u inodes needed, at most %u fit\n", inodes, FS_MAX_INODES);
+	return 1;
+    }
+    if (inodes < next_inode) {
+	fprintf (stderr, "%u inodes needed, only %u asked for\n", next_inode, inodes);
+	return 1;
+    }
+    if ((uint64_t)next_block + spare > MAX_DATABLOCKS) {
+	fprintf (stderr, "%u data blocks needed, at most %u fit\n", next_block + spare, MAX_DATABLOCKS);
+	return 1;
+    }
+    n = next_block + spare;
+    size = (size_t)(1 + inodes + n) * BLOCK_SIZE;
+    image = xcalloc (size, 1);
+
+    b = (boot_block_t*)image;
+    b->num_inodes = inodes;
+    b->num_datablocks = n;
+    b->fs_magic = FS_MAGIC;
+    b->bitmap_block = bitmap;
+    set_name (&b->dentries[b->num_dentries++], ".", FILE_TYPE_DIR, 0);
+    set_name (&b->dentries[b->num_dentries++], "rtc", FILE_TYPE_RTC, 0);
+    for (i = 0; i < root.num_kids; i++)
+	set_name (&b->dentries[b->num_dentries++], root.kids[i]->name,
+		  root.kids[i]->is_dir ? FILE_TYPE_DIR : FILE_TYPE_FILE, root.kids[i]->inode);
+    set_bit (b->inode_bitmap, 0);
+    for (i = 0; i < bitmap + 1; i++)
+	set_bit (image + (size_t)(1 + inodes + bitmap) * BLOCK_SIZE, i);
+
+    for (i = 0; i < num_all; i++) {
+	node_t* p = place[i];
+	uint8_t* data = image + (size_t)(1 + inodes + p->start) * BLOCK_SIZE;
+	set_bit (b->inode_bitmap, p->inode);
+	in = (extent_inode_t*)(image + (size_t)(1 + p->inode) * BLOCK_SIZE);
+	in->magic = p->is_dir ? DIR_MAGIC : EXTENT_MAGIC;
+	in->length = p->is_dir ? p->blocks * BLOCK_SIZE : p->size;
+	in->indirect = EXTENT_NONE;
+	if (p->blocks) {
+	    in->num_extents = 1;
+	    in->extents[0].start = p->start;
+	    in->extents[0].count = p->blocks;
+	}
+	if (p->is_dir) {
+	    memcpy (data, p->dir, (size_t)p->blocks * BLOCK_SIZE);
+	}
+	else if (p->size) {
+	    if (NULL == (f = fopen (p->path, "rb")) || p->size != fread (data, 1, p->size, f)) {
+		perror (p->path);
+		return 2;
+	    }
+	    fclose (f);
+	}
+    }
+
+    if (0 != check_image (out, image, size)) {
+	fprintf (stderr, "%s: built image is bad, not written\n", out);
+	return 1;
+    }
+    if (NULL == (f = fopen (out, "wb")) || size != fwrite (image, 1, size, f) || 0 != fclose (f)) {
+	perror (out);
+	return 2;
+    }
+    if (report) {
+	printf ("%5s %7s %7s %10s  %s\n", "inode", "start", "blocks", "bytes", "path");
+	for (i = 0; i < num_all; i++)
+	    printf ("%5u %7u %7u %10u  /%s%s\n", place[i]->inode, place[i]->start, place[i]->blocks,
+		    place[i]->is_dir ? place[i]->blocks * BLOCK_SIZE : place[i]->size,
+		    place[i]->rel, place[i]->is_dir ? "/" : "");
+	printf ("%5s %7u %7u %10s  block bitmap\n", "", bitmap, 1, "");
+	printf ("%5s %7u %7u %10s  free, and %u free inodes\n", "", bitmap + 1, spare, "", inodes - next_inode);
+    }
+    return 0;
+}
+
+static int
+verify (const char* name)
+{
+    FILE* f = fopen (name, "rb");
+    uint8_t* image;
+    long len;
+
+    if (NULL == f || 0 != fseek (f, 0, SEEK_END) || 0 > (len = ftell (f))) {
+	perror (name);
+	return 2;
+    }
+    rewind (f);
+    image = xcalloc (len, 1);
+    if ((size_t)len != fread (image, 1, len, f)) {
+	perror (name);
+	return 2;
+    }
+    fclose (f);
+    if (0 != (errors = check_image (name, image, len))) {
+	fprintf (stderr, "%s: %u problem%s\n", name, errors, 1 == errors ? "" : "s");
+	return 1;
+    }
+    return 0;
+}
+
+static void
+usage (const char* prog)
+{
+    fprintf (stderr, "usage: %s [-r] [-a order] [-n inodes] [-s spare] -i dir -o image\n"
+	     "       %s --verify image\n"
+	     "  -a, --order FILE   paths under dir, most used first, placed first\n"
+	     "  -n, --inodes N     inodes in the image, default %u or %u more than needed\n"
+	     "  -s, --spare N      free data blocks for new files, default %u\n"
+	     "  -r, --report       print where every file went\n",
+	     prog, prog, DEFAULT_INODES, SPARE_INODES, DEFAULT_SPARE);
+    exit (2);
+}
+
+int
+main (int argc, char* argv[])
+{
+    static const struct option opts[] = {
+	{"order", required_argument, NULL, 'a'},
+	{"inodes", required_argument, NULL, 'n'},
+	{"spare", required_argument, NULL, 's'},
+	{"report", no_argument, NULL, 'r'},
+	{"verify", required_argument, NULL, 'v'},
+	{NULL, 0, NULL, 0}
+    };
+    const char* src = NULL;
+    const char* out = NULL;
+    const char* order = NULL;
+    uint32_t inodes = 0, spare = DEFAULT_SPARE;
+    int c, report = 0;
+
+    while (-1 != (c = getopt_long (argc, argv, "i:o:a:n:s:r", opts, NULL))) {
+	switch (c) {
+	    case 'i': src = optarg; break;
+	    case 'o': out = optarg; break;
+	    case 'a': order = optarg; break;
+	    case 'n': inodes = strtoul (optarg, NULL, 0); break;
+	    case 's': spare = strtoul (optarg, NULL, 0); break;
+	    case 'r': report = 1; break;
+	    case 'v': return verify (optarg);
+	    default: usage (argv[0]);
+	}
+    }
+    if (NULL == src || NULL == out || optind != argc)
+	usage (argv[0]);
+    return build (src, out, order, inodes, spare, report);
+}
@@ -0,0 +1,284 @@
+/* fscompress - turns a filesystem image into the compressed image the kernel
+ * reads through drivers/zimage.c, and back
+ *
+ *     fscompress [-d] in out
+ *
+ * Each 4KB block is compressed on its own as an LZ4 block so the kernel can
+ * decompress any block without the ones before it.  A block of zeros takes no
+ * bytes and a block that doesn't get smaller is stored as is.  Every block is
+ * decompressed again and compared before the output is written.  With -d a
+ * compressed image is expanded back to a plain one.  in and out may be the
+ * same file.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_SIZE 4096
+#define ZIMAGE_MAGIC 0x3153465A /* "ZFS1" */
+#define MIN_MATCH 4
+#define RUN_MASK 15
+#define MAX_OFFSET 65535
+#define LAST_LITERALS 5  /* LZ4 ends every block with at least this many literals */
+#define MATCH_LIMIT 12   /* and starts no match this close to the end */
+#define HASH_BITS 12
+
+static uint32_t
+read32 (const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void
+write32 (uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* Write a length that didn't fit in its nibble as bytes of 255 and the rest. */
+static uint8_t*
+put_length (uint8_t* op, uint32_t len)
+{
+    for (len -= RUN_MASK; len >= 255; len -= 255)
+	*op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/* Write one sequence: literals, then a match unless match_len is 0. */
+static uint8_t*
+put_sequence (uint8_t* op, const uint8_t* lit, uint32_t lit_len,
+	      uint32_t offset, uint32_t match_len)
+{
+    uint8_t* token = op++;
+    uint32_t m = match_len ? match_len - MIN_MATCH : 0;
+
+    *token = ((lit_len < RUN_MASK ? lit_len : RUN_MASK) << 4) |
+	     (m < RUN_MASK ? m : RUN_MASK);
+    if (lit_len >= RUN_MASK)
+	op = put_length (op, lit_len);
+    memcpy (op, lit, lit_len);
+    op += lit_len;
+    if (0 == match_len)
+	return op;
+    *op++ = offset;
+    *op++ = offset >> 8;
+    if (m >= RUN_MASK)
+	op = put_length (op, m);
+    return op;
+}
+
+/* Greedy LZ4 compression of one block, matches found through a hash of the
+   4 bytes at each position.  Returns the compressed size, which may be more
+   than the block for data that doesn't compress. */
+static uint32_t
+lz4_compress (const uint8_t* src, uint32_t n, uint8_t* dst)
+{
+    int32_t table[1 << HASH_BITS];
+    const uint8_t* anchor = src;
+    const uint8_t* ip = src;
+    const uint8_t* ref;
+    uint8_t* op = dst;
+    uint32_t h, len;
+
+    memset (table, -1, sizeof (table));
+    while (n >= MATCH_LIMIT && ip + MATCH_LIMIT <= src + n) {
+	h = (read32 (ip) * 2654435761u) >> (32 - HASH_BITS);
+	ref = (table[h] < 0) ? NULL : src + table[h];
+	table[h] = ip - src;
+	if (NULL == ref || ip - ref > MAX_OFFSET || read32 (ref) != read32 (ip)) {
+	    ip++;
+	    continue;
+	}
+	for (len = MIN_MATCH; ip + len < src + n - LAST_LITERALS && ref[len] == ip[len]; len++);
+	op = put_sequence (op, anchor, ip - anchor, ip - ref, len);
+	ip += len;
+	anchor = ip;
+    }
+    op = put_sequence (op, anchor, src + n - anchor, 0, 0);
+    return op - dst;
+}
+
+/* Decode an LZ4 block the way the kernel does.  Returns the bytes produced
+   or -1 if the block is bad. */
+static int32_t
+lz4_decompress (const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len)
+{
+    const uint8_t* end = src + src_len;
+    uint32_t i, len, offset, out = 0;
+    uint8_t token, b;
+
+    while (src < end) {
+	token = *src++;
+	len = token >> 4;
+	if (RUN_MASK == len)
+	    do {
+		if (src >= end)
+		    return -1;
+		len += (b = *src++);
+	    } while (255 == b);
+	if (len > (uint32_t)(end - src) || len > dst_len - out)
+	    return -1;
+	memcpy (dst + out, src, len);
+	src += len;
+	out += len;
+	if (src == end)
+	    break;
+	if (end - src < 2)
+	    return -1;
+	offset = src[0] | (src[1] << 8);
+	src += 2;
+	if (0 == offset || offset > out)
+	    return -1;
+	len = token & RUN_MASK;
+	if (RUN_MASK == len)
+	    do {
+		if (src >= end)
+		    return -1;
+		len += (b = *src++);
+	    } while (255 == b);
+	len += MIN_MATCH;
+	if (len > dst_len - out)
+	    return -1;
+	for (i = 0; i < len; i++, out++)
+	    dst[out] = dst[out - offset];
+    }
+    return out;
+}
+
+static uint8_t*
+read_file (const char* name, uint32_t* size)
+{
+    FILE* f = fopen (name, "rb");
+    uint8_t* buf;
+    long len;
+
+    if (NULL == f || 0 != fseek (f, 0, SEEK_END) || 0 > (len = ftell (f))) {
+	perror (name);
+	exit (2);
+    }
+    rewind (f);
+    if (NULL == (buf = malloc (len + 1)) || (size_t)len != fread (buf, 1, len, f)) {
+	perror (name);
+	exit (2);
+    }
+    fclose (f);
+    *size = len;
+    return buf;
+}
+
+static void
+write_file (const char* name, const uint8_t* buf, uint32_t size)
+{
+    FILE* f = fopen (name, "wb");
+
+    if (NULL == f || size != fwrite (buf, 1, size, f) || 0 != fclose (f)) {
+	perror (name);
+	exit (2);
+    }
+}
+
+static int
+compress (const char* in, const char* out)
+{
+    uint8_t check[BLOCK_SIZE];
+    uint8_t* img;
+    uint8_t* z;
+    uint8_t* op;
+    uint32_t size, n, i, len, hdr;
+    static const uint8_t zero[BLOCK_SIZE];
+
+    img = read_file (in, &size);
+    if (size >= 4 && ZIMAGE_MAGIC == read32 (img)) {
+	fprintf (stderr, "%s is already compressed\n", in);
+	return 1;
+    }
+    /* a partial last block is padded with zeros */
+    n = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    img = realloc (img, (size_t)n * BLOCK_SIZE);
+    memset (img + size, 0, (size_t)n * BLOCK_SIZE - size);
+    hdr = 8 + 4 * (n + 1);
+    /* worst case LZ4 output is a little over the input, but those are stored raw */
+    if (NULL == (z = malloc (hdr + (size_t)n * (BLOCK_SIZE + BLOCK_SIZE / 255 + 16)))) {
+	perror ("malloc");
+	return 2;
+    }
+    write32 (z, ZIMAGE_MAGIC);
+    write32 (z + 4, n);
+    op = z + hdr;
+    for (i = 0; i < n; i++) {
+	const uint8_t* blk = img + (size_t)i * BLOCK_SIZE;
+	write32 (z + 8 + 4 * i, op - z);
+	if (0 == memcmp (blk, zero, BLOCK_SIZE))
+	    continue;
+	len = lz4_compress (blk, BLOCK_SIZE, op);
+	if (len >= BLOCK_SIZE) {
+	    memcpy (op, blk, BLOCK_SIZE);
+	    op += BLOCK_SIZE;
+	    continue;
+	}
+	if (BLOCK_SIZE != lz4_decompress (op, len, check, BLOCK_SIZE) ||
+	    0 != memcmp (check, blk, BLOCK_SIZE)) {
+	    fprintf (stderr, "block %u didn't survive compression\n", i);
+	    return 1;
+	}
+	op += len;
+    }
+    write32 (z + 8 + 4 * n, op - z);
+    write_file (out, z, op - z);
+    printf ("%u blocks, %u bytes -> %u bytes (%u%%)\n", n, n * BLOCK_SIZE,
+	    (uint32_t)(op - z), (uint32_t)((uint64_t)(op - z) * 100 / ((uint64_t)n * BLOCK_SIZE)));
+    return 0;
+}
+
+static int
+decompress (const char* in, const char* out)
+{
+    uint8_t* z;
+    uint8_t* img;
+    uint32_t size, n, i, start, end;
+
+    z = read_file (in, &size);
+    if (size < 8 || ZIMAGE_MAGIC != read32 (z)) {
+	fprintf (stderr, "%s isn't a compressed image\n", in);
+	return 1;
+    }
+    n = read32 (z + 4);
+    if (n >= (size - 8) / 4 || NULL == (img = calloc (n, BLOCK_SIZE))) {
+	fprintf (stderr, "%s has a bad header\n", in);
+	return 1;
+    }
+    for (i = 0; i < n; i++) {
+	start = read32 (z + 8 + 4 * i);
+	end = read32 (z + 12 + 4 * i);
+	if (start > end || end > size || end - start > BLOCK_SIZE) {
+	    fprintf (stderr, "block %u is out of range\n", i);
+	    return 1;
+	}
+	if (BLOCK_SIZE == end - start)
+	    memcpy (img + (size_t)i * BLOCK_SIZE, z + start, BLOCK_SIZE);
+	else if (end > start &&
+		 BLOCK_SIZE != lz4_decompress (z + start, end - start, img + (size_t)i * BLOCK_SIZE, BLOCK_SIZE)) {
+	    fprintf (stderr, "block %u is bad\n", i);
+	    return 1;
+	}
+    }
+    write_file (out, img, n * BLOCK_SIZE);
+    return 0;
+}
+
+int
+main (int argc, char* argv[])
+{
+    if (4 == argc && 0 == strcmp (argv[1], "-d"))
+	return decompress (argv[2], argv[3]);
+    if (3 == argc)
+	return compress (argv[1], argv[2]);
+    fprintf (stderr, "usage: %s [-d] in out\n", argv[0]);
+    return 2;
+}